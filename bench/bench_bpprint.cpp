@@ -0,0 +1,967 @@
+/*! \file
+ *
+ * Benchmarks of representative formatting workloads
+ *
+ * Each workload is formatted with BPPrint (runtime, cached C string,
+ * compiled, and compile-time format strings) as well as with snprintf and
+ * std::ostringstream for comparison. Reported for each are the
+ * time per call and the memory allocated per call.
+ *
+ * Global operator new/delete are replaced with versions that
+ * count allocations.
+ */
+
+#include <bpprint/Arena.hpp>
+#include <bpprint/AsyncLogger.hpp>
+#include <bpprint/Batch.hpp>
+#include <bpprint/FdSink.hpp>
+#include <bpprint/FixedString.hpp>
+#include <bpprint/BinaryLog.hpp>
+#include <bpprint/Format.hpp>
+#include <bpprint/Lazy.hpp>
+#include <bpprint/Range.hpp>
+#include <bpprint/StaticFormat.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <unistd.h>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+static size_t nalloc = 0;
+static size_t nbytes = 0;
+
+void * operator new(size_t n)
+{
+    nalloc++;
+    nbytes += n;
+    void * p = malloc(n == 0 ? 1 : n);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+    free(p);
+}
+
+
+// Prevents results from being optimized away
+static size_t sink = 0;
+
+
+/*! \brief Time a single method of a workload and print the results
+ *
+ * \param [in] name Name of the method
+ * \param [in] niter Number of times to call \p f
+ * \param [in] f Function returning the formatted string
+ */
+template<typename F>
+void run(const char * name, size_t niter, F f)
+{
+    // warm up
+    for(size_t i = 0; i < niter/10 + 1; i++)
+        sink += f(i).size();
+
+    const size_t alloc_before = nalloc;
+    const size_t bytes_before = nbytes;
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < niter; i++)
+        sink += f(i).size();
+    auto end = std::chrono::steady_clock::now();
+
+    const double n = static_cast<double>(niter);
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+
+    printf("    %-14s %12.1f %12.1f %12.2f\n", name,
+           elapsed.count() / n,
+           static_cast<double>(nbytes - bytes_before) / n,
+           static_cast<double>(nalloc - alloc_before) / n);
+}
+
+
+// Prints the header for a workload
+void header(const char * name, const char * fmt)
+{
+    printf("\n%s: \"%s\"\n", name, fmt);
+    printf("    %-14s %12s %12s %12s\n", "method", "ns/op", "bytes/op", "allocs/op");
+}
+
+
+// Formats with snprintf into a std::string, as a caller would
+template<typename... Targs>
+std::string snprintf_string(const char * fmt, Targs... args)
+{
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf), fmt, args...);
+    if(n < static_cast<int>(sizeof(buf)))
+        return std::string(buf, static_cast<size_t>(n));
+
+    std::string str(static_cast<size_t>(n), '\0');
+    snprintf(&str[0], str.size()+1, fmt, args...);
+    return str;
+}
+
+
+void bench_log_line(size_t niter)
+{
+    static const char * levels[] = { "INFO", "WARN", "DEBUG", "ERROR" };
+    const char * fmt = "[%-5s] %s:%d: %s\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+    const std::string msg("connection established");
+
+    header("Short log line", fmt);
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, levels[i%4], "server.cpp", static_cast<int>(i), msg.c_str());
+    });
+    run("ostringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << "[" << std::left << std::setw(5) << levels[i%4] << "] "
+           << "server.cpp" << ":" << i << ": " << msg << "\n";
+        return ss.str();
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, levels[i%4], "server.cpp", static_cast<int>(i), msg);
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, levels[i%4], "server.cpp", static_cast<int>(i), msg);
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, levels[i%4], "server.cpp", static_cast<int>(i), msg);
+    });
+    run("BPPRINT_FMT", niter, [&](size_t i) {
+        return bpprint::format_string(BPPRINT_FMT("[%-5s] %s:%d: %s\n"),
+                                      levels[i%4], "server.cpp", static_cast<int>(i), msg);
+    });
+}
+
+
+void bench_numeric_row(size_t niter)
+{
+    const char * fmt = "%6d %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+
+    header("Wide numeric row", fmt);
+
+    #define NUMERIC_ARGS static_cast<int>(i), 0.1*i, -0.2*i, 1.0/(i+1), 3.14159, \
+                         -2.71828, 1e3+i, 1e-3*i, 42.0
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, NUMERIC_ARGS);
+    });
+    run("ostringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(8) << std::setw(6) << i;
+        const double vals[] = { 0.1*i, -0.2*i, 1.0/(i+1), 3.14159, -2.71828, 1e3+i, 1e-3*i, 42.0 };
+        for(double v : vals)
+            ss << " " << std::setw(14) << v;
+        ss << "\n";
+        return ss.str();
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, NUMERIC_ARGS);
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, NUMERIC_ARGS);
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, NUMERIC_ARGS);
+    });
+    run("BPPRINT_FMT", niter, [&](size_t i) {
+        return bpprint::format_string(BPPRINT_FMT("%6d %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f %14.8f\n"),
+                                      NUMERIC_ARGS);
+    });
+
+    #undef NUMERIC_ARGS
+}
+
+
+void bench_long_string(size_t niter, size_t len)
+{
+    const char * fmt = "payload(%d): %s\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+    const std::string payload(len, 'x');
+
+    char name[64];
+    snprintf(name, sizeof(name), "Long string (%zu bytes)", len);
+    header(name, fmt);
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, static_cast<int>(i), payload.c_str());
+    });
+    run("ostringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << "payload(" << i << "): " << payload << "\n";
+        return ss.str();
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, static_cast<int>(i), payload);
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, static_cast<int>(i), payload);
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, static_cast<int>(i), payload);
+    });
+    run("BPPRINT_FMT", niter, [&](size_t i) {
+        return bpprint::format_string(BPPRINT_FMT("payload(%d): %s\n"), static_cast<int>(i), payload);
+    });
+}
+
+
+void bench_auto(size_t niter)
+{
+    // snprintf needs the actual specifiers
+    const char * pffmt = "%d %f %s %lu %p\n";
+    const char * fmt = "%? %? %? %? %?\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+    const std::string str("some string");
+
+    header("Automatic types", fmt);
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(pffmt, static_cast<int>(i), 0.5*i, str.c_str(), 10ul*i,
+                               static_cast<const void *>(&str));
+    });
+    run("ostringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << i << " " << std::fixed << 0.5*i << " " << str << " " << 10ul*i
+           << " " << static_cast<const void *>(&str) << "\n";
+        return ss.str();
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, static_cast<int>(i), 0.5*i, str, 10ul*i,
+                                      static_cast<const void *>(&str));
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, static_cast<int>(i), 0.5*i, str, 10ul*i,
+                                      static_cast<const void *>(&str));
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, static_cast<int>(i), 0.5*i, str, 10ul*i,
+                                      static_cast<const void *>(&str));
+    });
+    run("BPPRINT_FMT", niter, [&](size_t i) {
+        return bpprint::format_string(BPPRINT_FMT("%? %? %? %? %?\n"), static_cast<int>(i), 0.5*i, str, 10ul*i,
+                                      static_cast<const void *>(&str));
+    });
+}
+
+
+void bench_many_args(size_t niter)
+{
+    const char * fmt = "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d "
+                       "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+
+    header("Many arguments", "%d x 32");
+
+    #define INT_ARGS_8(n) static_cast<int>(i+n), static_cast<int>(i+n+1), \
+                          static_cast<int>(i+n+2), static_cast<int>(i+n+3), \
+                          static_cast<int>(i+n+4), static_cast<int>(i+n+5), \
+                          static_cast<int>(i+n+6), static_cast<int>(i+n+7)
+    #define INT_ARGS INT_ARGS_8(0), INT_ARGS_8(8), INT_ARGS_8(16), INT_ARGS_8(24)
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, INT_ARGS);
+    });
+    run("ostringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        for(size_t j = 0; j < 32; j++)
+            ss << (i+j) << (j == 31 ? "\n" : " ");
+        return ss.str();
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, INT_ARGS);
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, INT_ARGS);
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, INT_ARGS);
+    });
+    run("BPPRINT_FMT", niter, [&](size_t i) {
+        return bpprint::format_string(BPPRINT_FMT("%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d "
+                                                  "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n"),
+                                      INT_ARGS);
+    });
+
+    #undef INT_ARGS
+    #undef INT_ARGS_8
+}
+
+
+// Stand-in for a logging function with a level filter
+static volatile int log_level = 0;
+
+template<typename T>
+std::string debug_message(const T & msg)
+{
+    if(log_level > 1)
+        return msg;
+    return std::string();
+}
+
+
+// Cost of a debug message that is filtered out
+void bench_filtered(size_t niter)
+{
+    const std::string msg("connection established");
+
+    header("Filtered debug message", "[%-5s] %s:%d: %s\n");
+
+    run("format_string", niter, [&](size_t i) {
+        return debug_message(bpprint::format_string("[%-5s] %s:%d: %s\n", "DEBUG",
+                                                    "server.cpp", static_cast<int>(i), msg));
+    });
+    run("lazy", niter, [&](size_t i) {
+        return debug_message(bpprint::lazy("[%-5s] %s:%d: %s\n", "DEBUG",
+                                           "server.cpp", static_cast<int>(i), msg));
+    });
+}
+
+
+// Cost to the caller of the asynchronous logger
+//
+// Messages are logged in bursts that fit in the queue, and the
+// queue is flushed (untimed) between bursts. This measures only
+// the caller, and not how fast the background thread is.
+void bench_async(size_t niter)
+{
+    static const char * levels[] = { "INFO", "WARN", "DEBUG", "ERROR" };
+    const std::string msg("connection established");
+    const size_t burst = 4096;
+
+    const int fd = open("/dev/null", O_WRONLY);
+    bpprint::AsyncLogger logger(fd, 1 << 20, bpprint::AsyncLogger::OverflowPolicy::Drop);
+
+    header("Async logger (caller only)", "[%-5s] %s:%d: %s\n");
+
+    std::chrono::duration<double, std::nano> elapsed(0);
+    size_t alloc_count = 0;
+    size_t alloc_bytes = 0;
+
+    // first pass is a warm up
+    for(size_t pass = 0; pass < 2; pass++)
+    {
+        const size_t alloc_before = nalloc;
+        const size_t bytes_before = nbytes;
+
+        for(size_t b = 0; b < niter; b += burst)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for(size_t i = b; i < b + burst; i++)
+                logger.log("[%-5s] %s:%d: %s\n", levels[i%4], "server.cpp", static_cast<int>(i), msg);
+            auto end = std::chrono::steady_clock::now();
+
+            elapsed += end - start;
+            logger.flush();
+        }
+
+        alloc_count = nalloc - alloc_before;
+        alloc_bytes = nbytes - bytes_before;
+        if(pass == 0)
+            elapsed = elapsed.zero();
+    }
+
+    const double n = static_cast<double>((niter + burst - 1) / burst * burst);
+    printf("    %-14s %12.1f %12.1f %12.2f\n", "log",
+           elapsed.count() / n,
+           static_cast<double>(alloc_bytes) / n,
+           static_cast<double>(alloc_count) / n);
+    printf("    (%llu messages dropped)\n", logger.dropped());
+
+    close(fd);
+}
+
+
+// Formatting a batch of rows with the same format
+//
+// Each call of a method formats the whole batch into a reused
+// buffer. Times and allocations are reported per row.
+void bench_batch(size_t niter)
+{
+    const char * fmt = "%d,%u,%.6f,%s\n";
+    const std::string sfmt(fmt);
+    const bpprint::CompiledFormat cf(sfmt);
+    const size_t nrows = 10000;
+
+    std::vector<int> ints;
+    std::vector<unsigned int> uints;
+    std::vector<double> doubles;
+    std::vector<std::string> strs;
+    std::vector<std::tuple<int, unsigned int, double, std::string>> rows;
+
+    for(size_t i = 0; i < nrows; i++)
+    {
+        ints.push_back(static_cast<int>(i*7919) - 5000000);
+        uints.push_back(static_cast<unsigned int>(i*104729));
+        doubles.push_back(static_cast<double>(i) * 1.000123);
+        strs.push_back("item" + std::to_string(i % 100));
+        rows.emplace_back(ints.back(), uints.back(), doubles.back(), strs.back());
+    }
+
+    header("Batch of rows (per row)", fmt);
+
+    bpprint::MemoryBuffer buf;
+    const size_t nbatch = niter / nrows + 1;
+
+    auto run_batch = [&](const char * name, std::function<void(void)> f)
+    {
+        f();  // warm up
+
+        const size_t alloc_before = nalloc;
+        const size_t bytes_before = nbytes;
+
+        auto start = std::chrono::steady_clock::now();
+        for(size_t b = 0; b < nbatch; b++)
+        {
+            buf.clear();
+            f();
+            sink += buf.size();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        const double n = static_cast<double>(nbatch * nrows);
+        std::chrono::duration<double, std::nano> elapsed = end - start;
+        printf("    %-14s %12.1f %12.1f %12.2f\n", name,
+               elapsed.count() / n,
+               static_cast<double>(nbytes - bytes_before) / n,
+               static_cast<double>(nalloc - alloc_before) / n);
+    };
+
+    run_batch("snprintf", [&]{
+        char line[128];
+        for(size_t i = 0; i < nrows; i++)
+        {
+            const int len = snprintf(line, sizeof(line), fmt, ints[i], uints[i], doubles[i], strs[i].c_str());
+            buf.append(line, static_cast<size_t>(len));
+        }
+    });
+
+    run_batch("C string", [&]{
+        for(size_t i = 0; i < nrows; i++)
+            bpprint::format_to(buf, fmt, ints[i], uints[i], doubles[i], strs[i]);
+    });
+
+    run_batch("compiled", [&]{
+        for(size_t i = 0; i < nrows; i++)
+            bpprint::format_to(buf, cf, ints[i], uints[i], doubles[i], strs[i]);
+    });
+
+    run_batch("columns", [&]{
+        bpprint::format_columns(buf, cf, nrows, ints.data(), uints.data(), doubles.data(), strs.data());
+    });
+
+    run_batch("rows", [&]{
+        bpprint::format_rows(buf, cf, rows.begin(), rows.end());
+    });
+}
+
+
+// A template that is mostly literal text, with a few specifications
+//
+// Scanning for % matters most when the format is parsed on every call
+// (format_string) and when it is compiled.
+void bench_long_literal(size_t niter)
+{
+    const std::string text(300, '-');
+    const std::string sfmt = "<html>" + text + "%s" + text + "%d" + text + "100%%" + text + "%s</html>\n";
+    const char * fmt = sfmt.c_str();
+    const bpprint::CompiledFormat cf(sfmt);
+
+    char name[64];
+    snprintf(name, sizeof(name), "Long literal text (%zu chars)", sfmt.size());
+    header(name, "<html>---...%s---...%d---...100%%---...%s</html>\n");
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, "title", static_cast<int>(i), "footer");
+    });
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(sfmt, "title", static_cast<int>(i), "footer");
+    });
+    run("C string", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, "title", static_cast<int>(i), "footer");
+    });
+    run("compiled", niter, [&](size_t i) {
+        return bpprint::format_string(cf, "title", static_cast<int>(i), "footer");
+    });
+    run("compile only", niter/4, [&](size_t) {
+        return bpprint::CompiledFormat(sfmt).segments();
+    });
+}
+
+
+// Result of methods that write their output elsewhere
+struct Written
+{
+    size_t n;
+    size_t size(void) const { return n; }
+};
+
+
+// Writing messages to a file descriptor (/dev/null)
+//
+// Each message is written with its own system call,
+// except for the batched FdSink and buffered fprintf.
+void bench_fd(size_t niter)
+{
+    static const char * levels[] = { "INFO", "WARN", "DEBUG", "ERROR" };
+    const char * fmt = "%s [%-5s] request handled by worker %d of the connection pool: %s\n";
+    const std::string msg("connection established");
+
+    const int fd = open("/dev/null", O_WRONLY);
+    FILE * f = fdopen(dup(fd), "w");
+
+    header("Output to a file descriptor", fmt);
+
+    run("write+string", niter, [&](size_t i) {
+        const std::string str = bpprint::format_string(fmt, "2024-01-01", levels[i%4], static_cast<int>(i), msg);
+        return Written{ static_cast<size_t>(::write(fd, str.data(), str.size())) };
+    });
+    run("write+buffer", niter, [&](size_t i) {
+        bpprint::MemoryBuffer buf;
+        bpprint::format_to(buf, fmt, "2024-01-01", levels[i%4], static_cast<int>(i), msg);
+        return Written{ static_cast<size_t>(::write(fd, buf.data(), buf.size())) };
+    });
+    run("format_fd", niter, [&](size_t i) {
+        bpprint::format_fd(fd, fmt, "2024-01-01", levels[i%4], static_cast<int>(i), msg);
+        return Written{ 1 };
+    });
+
+    bpprint::FdSink sink(fd, 65536);
+    run("FdSink batched", niter, [&](size_t i) {
+        sink.format(fmt, "2024-01-01", levels[i%4], static_cast<int>(i), msg);
+        return Written{ 1 };
+    });
+    run("fprintf (FILE)", niter, [&](size_t i) {
+        return Written{ static_cast<size_t>(fprintf(f, fmt, "2024-01-01", levels[i%4], static_cast<int>(i), msg.c_str())) };
+    });
+
+    fclose(f);
+    close(fd);
+}
+
+
+// A trade identifier, as an application would define it
+struct TradeId
+{
+    unsigned long long order;
+    unsigned int fill;
+};
+
+// Conversion to a string, as needed without a Formatter
+std::string to_string(const TradeId & t)
+{
+    char tmp[48];
+    const int n = snprintf(tmp, sizeof(tmp), "TRD-%08llu-%04u", t.order, t.fill);
+    return std::string(tmp, static_cast<size_t>(n));
+}
+
+namespace bpprint {
+template<>
+struct Formatter<TradeId>
+{
+    static constexpr const char * pftype = "s";
+
+    static void format(OutputBuffer & out, const ConvSpec & cs, char, const TradeId & t)
+    {
+        char tmp[48];
+        const int n = snprintf(tmp, sizeof(tmp), "TRD-%08llu-%04u", t.order, t.fill);
+        write_field(out, cs, tmp, static_cast<size_t>(n));
+    }
+};
+}
+
+
+// User-defined types, converted to strings first or written directly
+void bench_user_type(size_t niter)
+{
+    const char * fmt = "fill %s of %s: %d @ %.2f\n";
+    const std::string sym("ACME");
+
+    header("User-defined types", fmt);
+
+    run("to_string", niter, [&](size_t i) {
+        const TradeId t{ i, static_cast<unsigned int>(i%16) };
+        return bpprint::format_string(fmt, to_string(t), sym, 100, 12.5);
+    });
+    run("Formatter", niter, [&](size_t i) {
+        const TradeId t{ i, static_cast<unsigned int>(i%16) };
+        return bpprint::format_string(fmt, t, sym, 100, 12.5);
+    });
+}
+
+
+// A vector of values in a single log line
+void bench_range(size_t niter)
+{
+    const char * fmt = "tick %d: [%s]\n";
+    std::vector<double> values;
+    for(int i = 0; i < 16; i++)
+        values.push_back(100.0 + i*0.25);
+
+    header("Range of 16 values", fmt);
+
+    run("stringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << "tick " << i << ": [" << std::fixed << std::setprecision(2);
+        for(size_t j = 0; j < values.size(); j++)
+            ss << (j ? ", " : "") << values[j];
+        ss << "]\n";
+        return ss.str();
+    });
+    run("concatenate", niter, [&](size_t i) {
+        std::string joined;
+        for(size_t j = 0; j < values.size(); j++)
+            joined += bpprint::format_string(j ? ", %.2f" : "%.2f", values[j]);
+        return bpprint::format_string(fmt, static_cast<int>(i), joined);
+    });
+    run("join", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, static_cast<int>(i), bpprint::join(values, ", ", "%.2f"));
+    });
+    run("join (limit 4)", niter, [&](size_t i) {
+        return bpprint::format_string(fmt, static_cast<int>(i), bpprint::join(values, ", ", "%.2f", 4));
+    });
+}
+
+
+// A short message copied into a fixed-size protocol field
+void bench_fixed(size_t niter)
+{
+    const char * fmt = "order %u %s x%d @ %.2f";
+    const bpprint::CompiledFormat cf(fmt);
+    const std::string sym("ACME");
+    struct Field { char text[64]; };
+    Field field;
+
+    header("Fixed-size field", fmt);
+
+    run("snprintf", niter, [&](size_t i) {
+        const int n = snprintf(field.text, sizeof(field.text), fmt, static_cast<unsigned int>(i),
+                               sym.c_str(), 100, 12.5);
+        return Written{ static_cast<size_t>(n) };
+    });
+    run("format_string", niter, [&](size_t i) {
+        const std::string s = bpprint::format_string(cf, static_cast<unsigned int>(i), sym, 100, 12.5);
+        const size_t n = std::min(s.size(), sizeof(field.text) - 1);
+        memcpy(field.text, s.data(), n);
+        field.text[n] = '\0';
+        return Written{ n };
+    });
+    run("format_fixed", niter, [&](size_t i) {
+        const auto f = bpprint::format_fixed<63>(cf, static_cast<unsigned int>(i), sym, 100, 12.5);
+        memcpy(field.text, f.c_str(), f.size() + 1);
+        return Written{ f.size() };
+    });
+}
+
+
+// Sizing a frame before formatting into it
+void bench_size(size_t niter)
+{
+    const char * fmt = "%s|%08x|%-12s|%10d|%.3f|%s\n";
+    const bpprint::CompiledFormat cf(fmt);
+    const std::string topic("market.data.equities");
+
+    header("Length of the output", fmt);
+
+    run("stringstream", niter, [&](size_t i) {
+        std::ostringstream ss;
+        ss << topic << '|' << std::hex << std::setw(8) << std::setfill('0') << i
+           << std::dec << std::setfill(' ') << '|' << std::left << std::setw(12) << "ACME"
+           << std::right << '|' << std::setw(10) << static_cast<int>(i)
+           << '|' << std::fixed << std::setprecision(3) << 12.5 << '|' << topic << '\n';
+        return Written{ ss.str().size() };
+    });
+    run("snprintf NULL", niter, [&](size_t i) {
+        return Written{ static_cast<size_t>(snprintf(nullptr, 0, fmt, topic.c_str(), static_cast<unsigned int>(i),
+                                                     "ACME", static_cast<int>(i), 12.5, topic.c_str())) };
+    });
+    run("format_string", niter, [&](size_t i) {
+        return Written{ bpprint::format_string(cf, topic, static_cast<unsigned int>(i), "ACME",
+                                               static_cast<int>(i), 12.5, topic).size() };
+    });
+    run("formatted_size", niter, [&](size_t i) {
+        return Written{ bpprint::formatted_size(cf, topic, static_cast<unsigned int>(i), "ACME",
+                                                static_cast<int>(i), 12.5, topic) };
+    });
+}
+
+
+// A translated message, with the arguments in a different order
+void bench_positional(size_t niter)
+{
+    const char * fmt = "%2$s: %1$d items at %3$.2f (%4$s)\n";
+    const bpprint::CompiledFormat cf(fmt);
+    const bpprint::CompiledFormat ordered("%s: %d items at %.2f (%s)\n");
+    const std::string name("warehouse");
+
+    header("Positional arguments", fmt);
+
+    run("snprintf", niter, [&](size_t i) {
+        return snprintf_string(fmt, static_cast<int>(i), name.c_str(), 2.5, "ok");
+    });
+    run("in order", niter, [&](size_t i) {
+        return bpprint::format_string(ordered, name, static_cast<int>(i), 2.5, "ok");
+    });
+    run("positional", niter, [&](size_t i) {
+        return bpprint::format_string(cf, static_cast<int>(i), name, 2.5, "ok");
+    });
+}
+
+
+// Formats applied to arguments that do not match them, as when a
+// format string is taken from configuration
+void bench_errors(size_t niter)
+{
+    const char * fmt = "%d items from %s\n";
+    const bpprint::CompiledFormat cf(fmt);
+    const std::string src("warehouse");
+
+    header("Mismatched arguments", fmt);
+
+    run("format_error", niter, [&](size_t i) {
+        bpprint::MemoryBuffer buf;
+        try {
+            bpprint::format_to(buf, cf, 0.5*static_cast<double>(i), src);
+        }
+        catch(bpprint::format_error & ex) {
+            return std::string(ex.what());
+        }
+        return buf.str();
+    });
+    run("try_format_to", niter, [&](size_t i) {
+        bpprint::MemoryBuffer buf;
+        const bpprint::FormatResult res = bpprint::try_format_to(buf, cf, 0.5*static_cast<double>(i), src);
+        return res.ok() ? buf.str() : std::string(bpprint::format_errc_str(res.errc));
+    });
+}
+
+
+// Messages built while handling a request, and discarded together
+//
+// With an arena that is reset after each request (here, every 64
+// messages), the results do not use the global heap at all.
+void bench_arena(size_t niter)
+{
+    const char * fmt = "request %d from %s: status %d, %lu bytes in %.3f ms (%s)\n";
+    const bpprint::CompiledFormat cf(fmt);
+    const std::string agent("Mozilla/5.0 (X11; Linux x86_64)");
+
+    header("Messages of a request", fmt);
+
+    run("format_string", niter, [&](size_t i) {
+        return bpprint::format_string(cf, static_cast<int>(i), "10.0.0.1", 200, i*10, 0.25, agent);
+    });
+
+    bpprint::Arena arena(65536);
+    const bpprint::ArenaAllocator<char> alloc(arena);
+    run("arena", niter, [&](size_t i) {
+        if(i % 64 == 0)
+            arena.reset();
+        return bpprint::format_string(std::allocator_arg, alloc, cf,
+                                      static_cast<int>(i), "10.0.0.1", 200, i*10, 0.25, agent);
+    });
+}
+
+
+// Scaling of parallel batch formatting with the number of threads
+void bench_parallel(size_t niter)
+{
+    const char * fmt = "%d,%u,%.6f,%s\n";
+    const bpprint::CompiledFormat cf(fmt);
+    const size_t nrows = niter * 5;
+
+    std::vector<int> ints;
+    std::vector<unsigned int> uints;
+    std::vector<double> doubles;
+    std::vector<std::string> strs;
+
+    for(size_t i = 0; i < nrows; i++)
+    {
+        ints.push_back(static_cast<int>(i*7919) - 5000000);
+        uints.push_back(static_cast<unsigned int>(i*104729));
+        doubles.push_back(static_cast<double>(i) * 1.000123);
+        strs.push_back("item" + std::to_string(i % 100));
+    }
+
+    printf("\n%s: \"%s\" (%zu rows, %u cores)\n", "Parallel batch", fmt, nrows,
+           std::thread::hardware_concurrency());
+    printf("    %-14s %12s %12s\n", "threads", "ns/row", "speedup");
+
+    // warm up (and grow the buffer to its full size)
+    bpprint::MemoryBuffer buf;
+    bpprint::format_columns(buf, cf, nrows, ints.data(), uints.data(), doubles.data(), strs.data());
+    double base = 0.0;
+
+    for(size_t nthreads : { 1, 2, 4, 8 })
+    {
+        bpprint::ParallelOptions opts;
+        opts.nthreads = nthreads;
+
+        buf.clear();
+        auto start = std::chrono::steady_clock::now();
+        bpprint::format_columns_parallel(buf, cf, opts, nrows, ints.data(), uints.data(),
+                                         doubles.data(), strs.data());
+        auto end = std::chrono::steady_clock::now();
+        sink += buf.size();
+
+        std::chrono::duration<double, std::nano> elapsed = end - start;
+        const double per_row = elapsed.count() / static_cast<double>(nrows);
+        if(nthreads == 1)
+            base = per_row;
+
+        printf("    %-14zu %12.1f %12.2f\n", nthreads, per_row, base / per_row);
+    }
+}
+
+
+// Discards output, counting the bytes written
+class CountingBuf : public std::streambuf
+{
+    public:
+        size_t count = 0;
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            count++;
+            return c;
+        }
+
+        std::streamsize xsputn(const char *, std::streamsize n) override
+        {
+            count += static_cast<size_t>(n);
+            return n;
+        }
+};
+
+
+// Writing a log as text vs. as a binary log
+//
+// Reports the time per message and the size of the log per message
+// (in place of the allocation columns).
+void bench_binary_log(size_t niter)
+{
+    static const char * levels[] = { "INFO", "WARN", "DEBUG", "ERROR" };
+    const char * fmt = "[%-5s] %s:%d: value=%f id=%llu %s\n";
+    const std::string msg("connection established");
+
+    printf("\n%s: \"%s\"\n", "Text vs. binary log", fmt);
+    printf("    %-14s %12s %12s\n", "method", "ns/op", "log bytes/op");
+
+    auto report = [&](const char * name, std::chrono::duration<double, std::nano> elapsed,
+                      const CountingBuf & cb)
+    {
+        const double n = static_cast<double>(niter);
+        printf("    %-14s %12.1f %12.1f\n", name, elapsed.count() / n,
+               static_cast<double>(cb.count) / n);
+    };
+
+    {
+        CountingBuf cb;
+        std::ostream os(&cb);
+        bpprint::MemoryBuffer buf;
+
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < niter; i++)
+        {
+            buf.clear();
+            bpprint::format_to(buf, fmt, levels[i%4], "server.cpp", static_cast<int>(i),
+                               0.5*static_cast<double>(i), static_cast<unsigned long long>(i*7), msg);
+            os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        }
+        auto end = std::chrono::steady_clock::now();
+        report("text", end - start, cb);
+    }
+
+    {
+        CountingBuf cb;
+        std::ostream os(&cb);
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            bpprint::BinaryLogWriter writer(os);
+            for(size_t i = 0; i < niter; i++)
+                writer.write(fmt, levels[i%4], "server.cpp", static_cast<int>(i),
+                             0.5*static_cast<double>(i), static_cast<unsigned long long>(i*7), msg);
+        }
+        auto end = std::chrono::steady_clock::now();
+        report("binary", end - start, cb);
+    }
+}
+
+
+int main(int argc, char ** argv)
+{
+    // Optional scale factor for the number of iterations
+    const size_t scale = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1;
+    const size_t niter = 200000 * (scale > 0 ? scale : 1);
+
+    bench_log_line(niter);
+    bench_numeric_row(niter);
+    bench_long_string(niter, 200);
+    bench_long_string(niter, 300);
+    bench_long_string(niter/10, 10000);
+    bench_auto(niter);
+    bench_many_args(niter/4);
+    bench_filtered(niter);
+    bench_long_literal(niter);
+    bench_fd(niter);
+    bench_arena(niter);
+    bench_user_type(niter);
+    bench_range(niter/4);
+    bench_size(niter);
+    bench_fixed(niter);
+    bench_positional(niter);
+    bench_errors(niter/10);
+    bench_batch(niter);
+    bench_parallel(niter);
+    bench_async(niter);
+    bench_binary_log(niter);
+
+    if(sink == 0)
+        printf("\n");
+
+    return 0;
+}
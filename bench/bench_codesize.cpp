@@ -0,0 +1,89 @@
+/*! \file
+ *
+ * Many call sites, each with a different sequence of argument types
+ *
+ * This is what a large program looks like to the compiler: every
+ * distinct sequence of argument types instantiates the formatting
+ * functions again. The interesting numbers are the time taken to
+ * compile this file and the size of the resulting object file
+ * (see measure_codesize.sh). Running the program just checks that the
+ * output is sensible.
+ */
+
+#include <bpprint/Format.hpp>
+#include <cstdio>
+#include <string>
+#include <tuple>
+
+
+// Argument types, combined in sequences of three
+typedef std::tuple<int, unsigned int, long, double,
+                   const char *, std::string, char, unsigned long long> ArgTypes;
+
+static const size_t ntypes = std::tuple_size<ArgTypes>::value;
+static const size_t nsites = ntypes * ntypes * ntypes;
+
+template<size_t I>
+using ArgType = typename std::tuple_element<I % ntypes, ArgTypes>::type;
+
+
+// A value of each type
+template<typename T> T value(size_t i) { return static_cast<T>(i); }
+template<> const char * value<const char *>(size_t) { return "text"; }
+template<> std::string value<std::string>(size_t) { return "string"; }
+template<> char value<char>(size_t) { return 'c'; }
+
+
+// Generates a sequence 0..N-1 for expanding the call sites
+template<size_t... I> struct Indices { };
+
+template<size_t N, size_t... I>
+struct MakeIndices : public MakeIndices<N-1, N-1, I...> { };
+
+template<size_t... I>
+struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+
+// A single call site, using each kind of format string
+template<size_t I>
+size_t call_site(bpprint::OutputBuffer & out, const bpprint::CompiledFormat & cf,
+                 const std::string & fmt, size_t i)
+{
+    typedef ArgType<I> A;
+    typedef ArgType<I / ntypes> B;
+    typedef ArgType<I / (ntypes*ntypes)> C;
+
+    const A a = value<A>(i);
+    const B b = value<B>(i);
+    const C c = value<C>(i);
+
+    bpprint::format_to(out, "site: %? %? %?\n", a, b, c);
+    bpprint::format_to(out, cf, a, b, c);
+    return bpprint::format_string(fmt, a, b, c).size();
+}
+
+
+template<size_t... I>
+size_t call_sites(bpprint::OutputBuffer & out, Indices<I...>)
+{
+    const bpprint::CompiledFormat cf("site: %? %? %?\n");
+    const std::string fmt("site: %? %? %?\n");
+
+    const size_t sizes[] = { call_site<I>(out, cf, fmt, I)... };
+
+    size_t total = 0;
+    for(size_t s : sizes)
+        total += s;
+    return total;
+}
+
+
+int main(void)
+{
+    bpprint::MemoryBuffer buf;
+    const size_t total = call_sites(buf, MakeIndices<nsites>::type());
+
+    printf("%lu call sites, %lu characters\n", static_cast<unsigned long>(nsites),
+           static_cast<unsigned long>(buf.size() + total));
+    return 0;
+}
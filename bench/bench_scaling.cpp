@@ -0,0 +1,74 @@
+/*! \file
+ *
+ * Measures how the cost of formatting scales with the
+ * number of specifications in the format string.
+ *
+ * Each field of the format string has the same amount of
+ * literal text, so the length of the format string grows
+ * with the number of specifications. The time per
+ * specification should stay (roughly) constant.
+ */
+
+#include <bpprint/Format.hpp>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+
+
+// Generates a sequence 0..N-1 for expanding the arguments
+template<size_t... I> struct Indices { };
+
+template<size_t N, size_t... I>
+struct MakeIndices : public MakeIndices<N-1, N-1, I...> { };
+
+template<size_t... I>
+struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+
+template<size_t... I>
+double time_format(const std::string & fmt, size_t niter, Indices<I...>)
+{
+    size_t total = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < niter; i++)
+        total += bpprint::format_string(fmt, static_cast<int>(I+i)...).size();
+    auto end = std::chrono::steady_clock::now();
+
+    // prevent the loop from being optimized away
+    if(total == 0)
+        std::cout << "";
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / static_cast<double>(niter);
+}
+
+
+template<size_t N>
+void run_scaling(void)
+{
+    std::string fmt;
+    for(size_t i = 0; i < N; i++)
+        fmt += "some_metric_name_field=%d, ";
+
+    const size_t niter = 200000 / N;
+    const double ns = time_format(fmt, niter, typename MakeIndices<N>::type());
+
+    printf("%6zu %10zu %14.1f %14.2f\n", N, fmt.size(), ns, ns / N);
+}
+
+
+int main(void)
+{
+    printf("%6s %10s %14s %14s\n", "nspec", "fmt_len", "ns/op", "ns/spec");
+
+    run_scaling<1>();
+    run_scaling<2>();
+    run_scaling<4>();
+    run_scaling<8>();
+    run_scaling<16>();
+    run_scaling<32>();
+    run_scaling<64>();
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Measures the cost of bench_codesize.cpp to the compiler: the time to
+# compile it, and the size of the object file.
+#
+# Usage: measure_codesize.sh [source tree] [compiler flags...]
+#
+# The headers are taken from the given source tree (by default, the one
+# containing this script), so other versions can be compared with the
+# same call sites. The default flags are -O2.
+
+here=$(cd "$(dirname "$0")" && pwd)
+src=${1:-"$here/.."}
+[ $# -gt 0 ] && shift
+flags=${*:-"-O2"}
+cxx=${CXX:-c++}
+obj=$(mktemp /tmp/bench_codesize.XXXXXX.o)
+
+start=$(date +%s.%N)
+$cxx -std=c++11 $flags -I"$src" -c "$here/bench_codesize.cpp" -o "$obj" || exit 1
+end=$(date +%s.%N)
+
+echo "compile time (s): $(awk "BEGIN { print $end - $start }")"
+echo "object size (bytes):"
+size "$obj"
+echo "functions: $(nm -C "$obj" | grep -c ' [TtWw] ')"
+
+rm -f "$obj"
@@ -0,0 +1,126 @@
+#include <cstdint>
+#include <new>
+
+#include "bpprint/Arena.hpp"
+
+
+namespace bpprint {
+
+
+namespace {
+
+// Round \p p up to a multiple of \p align
+char * align_up_(char * p, size_t align) noexcept
+{
+    const std::uintptr_t u = reinterpret_cast<std::uintptr_t>(p);
+    return p + ((align - (u & (align - 1))) & (align - 1));
+}
+
+} // close anonymous namespace
+
+
+
+Arena::Arena(size_t block_size) noexcept
+    : Arena(nullptr, 0, block_size)
+{ }
+
+
+Arena::Arena(void * buffer, size_t size, size_t block_size) noexcept
+    : initial_(static_cast<char *>(buffer)), initial_size_(size),
+      block_size_(block_size > 64 ? block_size : 64),
+      first_(nullptr), current_(nullptr),
+      begin_(initial_), pos_(initial_), end_(initial_ + size),
+      used_(0), heap_size_(0)
+{ }
+
+
+Arena::~Arena()
+{
+    release();
+}
+
+
+void * Arena::allocate(size_t n, size_t align)
+{
+    char * p = align_up_(pos_, align);
+    if(pos_ == nullptr || p > end_ || static_cast<size_t>(end_ - p) < n)
+    {
+        // A block this large could not be addressed
+        if(n > SIZE_MAX - align - sizeof(Block_))
+            throw std::bad_alloc();
+
+        next_block_(n, align);
+        p = align_up_(pos_, align);
+    }
+
+    pos_ = p + n;
+    return p;
+}
+
+
+void Arena::next_block_(size_t n, size_t align)
+{
+    used_ += static_cast<size_t>(pos_ - begin_);
+
+    // Reuse blocks kept by reset(), if they are large enough
+    Block_ * next = current_ ? current_->next : first_;
+    while(next != nullptr && next->size < n + align)
+    {
+        used_ += next->size;  // skipped
+        current_ = next;
+        next = next->next;
+    }
+
+    if(next == nullptr)
+    {
+        // Double the block size, without going past what can be allocated
+        const size_t max_size = SIZE_MAX - sizeof(Block_);
+        size_t size = (block_size_ < max_size) ? block_size_ : max_size;
+        while(size < n + align)
+            size = (size <= max_size/2) ? size*2 : max_size;
+
+        next = static_cast<Block_ *>(::operator new(sizeof(Block_) + size));
+        next->next = nullptr;
+        next->size = size;
+
+        if(current_ != nullptr)
+            current_->next = next;
+        else
+            first_ = next;
+
+        heap_size_ += size;
+        block_size_ = (size <= max_size/2) ? size*2 : max_size;
+    }
+
+    current_ = next;
+    begin_ = pos_ = block_data_(next);
+    end_ = begin_ + next->size;
+}
+
+
+void Arena::reset(void) noexcept
+{
+    current_ = nullptr;
+    begin_ = pos_ = initial_;
+    end_ = initial_ + initial_size_;
+    used_ = 0;
+}
+
+
+void Arena::release(void) noexcept
+{
+    Block_ * b = first_;
+    while(b != nullptr)
+    {
+        Block_ * next = b->next;
+        ::operator delete(b);
+        b = next;
+    }
+
+    first_ = nullptr;
+    heap_size_ = 0;
+    reset();
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+
+/*! \file
+ *
+ * Arena (monotonic) allocation of formatting output
+ *
+ * An Arena hands out memory from large blocks, and never frees individual
+ * allocations. Everything is released at once with reset() (which keeps
+ * the blocks for reuse) or release(). Combined with ArenaAllocator, this
+ * allows, for example, all the messages of a request to be formatted
+ * without using the global heap.
+ */
+
+namespace bpprint {
+
+
+/*! \brief A monotonic allocator of memory
+ *
+ * Memory is taken from an optional caller-provided buffer, then from blocks
+ * obtained from the global heap (each larger than the last). Individual
+ * allocations are never freed.
+ *
+ * An arena is not thread safe. Typically, one is used per thread or per request.
+ */
+class Arena
+{
+    public:
+        /*! \brief Create an arena that starts empty
+         *
+         * \param [in] block_size The size of the first block taken from the heap
+         */
+        explicit Arena(size_t block_size = 4096) noexcept;
+
+
+        /*! \brief Create an arena that uses the given storage first
+         *
+         * \param [in] buffer Storage to use before the heap. It must outlive the arena.
+         * \param [in] size The size of \p buffer
+         * \param [in] block_size The size of the first block taken from the heap
+         */
+        Arena(void * buffer, size_t size, size_t block_size = 4096) noexcept;
+
+
+        /*! \brief Frees all blocks taken from the heap */
+        ~Arena();
+
+        Arena(const Arena &) = delete;
+        Arena & operator=(const Arena &) = delete;
+
+
+        /*! \brief Allocate memory
+         *
+         * \throw std::bad_alloc if a new block cannot be obtained from the heap,
+         *        or if \p n is too large for any block
+         *
+         * \param [in] n The number of bytes
+         * \param [in] align The alignment (must be a power of two)
+         */
+        void * allocate(size_t n, size_t align = alignof(std::max_align_t));
+
+
+        /*! \brief Make all memory available again, keeping the blocks
+         *
+         * All allocations from this arena become invalid. After the first
+         * few uses, an arena that is reset (say, after every request) no
+         * longer uses the heap at all.
+         */
+        void reset(void) noexcept;
+
+
+        /*! \brief Return all blocks to the heap
+         *
+         * All allocations from this arena become invalid
+         */
+        void release(void) noexcept;
+
+
+        /*! \brief Number of bytes allocated since the last reset (including alignment) */
+        size_t used(void) const noexcept { return used_ + static_cast<size_t>(pos_ - begin_); }
+
+
+        /*! \brief Number of bytes obtained from the heap */
+        size_t heap_size(void) const noexcept { return heap_size_; }
+
+
+    private:
+        //! Header at the start of each block from the heap
+        struct Block_
+        {
+            Block_ * next;
+            size_t size;   //!< Usable size (after the header)
+        };
+
+        char * initial_;      //!< Caller-provided storage
+        size_t initial_size_;
+        size_t block_size_;   //!< Size of the next new block
+
+        Block_ * first_;      //!< First block from the heap
+        Block_ * current_;    //!< Block being used (nullptr while in initial_)
+
+        char * begin_;        //!< Start of the current storage
+        char * pos_;          //!< Next free byte of the current storage
+        char * end_;          //!< End of the current storage
+
+        size_t used_;         //!< Bytes used in previous storage since the last reset
+        size_t heap_size_;
+
+        //! Start of the usable part of a block
+        static char * block_data_(Block_ * b) noexcept
+        {
+            return reinterpret_cast<char *>(b) + sizeof(Block_);
+        }
+
+        //! Move to the next block with room for \p n bytes (with alignment)
+        void next_block_(size_t n, size_t align);
+};
+
+
+
+/*! \brief A standard allocator that takes memory from an Arena
+ *
+ * Deallocation does nothing. The memory is reclaimed when the
+ * arena is reset or released.
+ *
+ * \tparam T The type to allocate
+ */
+template<typename T>
+class ArenaAllocator
+{
+    public:
+        typedef T value_type;
+
+        ArenaAllocator(Arena & arena) noexcept : arena_(&arena) { }
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U> & other) noexcept : arena_(other.arena()) { }
+
+        T * allocate(size_t n)
+        {
+            if(n > SIZE_MAX / sizeof(T))
+                throw std::bad_alloc();
+            return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, size_t) noexcept { }
+
+        //! The arena memory is taken from
+        Arena * arena(void) const noexcept { return arena_; }
+
+    private:
+        Arena * arena_;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) noexcept
+{
+    return a.arena() == b.arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) noexcept
+{
+    return a.arena() != b.arena();
+}
+
+
+//! A string whose memory is taken from an Arena
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+
+} // close namespace bpprint
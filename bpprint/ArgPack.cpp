@@ -0,0 +1,181 @@
+#include <stdexcept>
+
+#include "bpprint/ArgPack.hpp"
+
+
+namespace bpprint {
+namespace detail {
+
+
+namespace {
+
+// Reads stored arguments, checking that the data is not exhausted
+class ArgReader_
+{
+    public:
+        ArgReader_(const char * data, size_t size) noexcept
+            : p_(data), end_(data + size)
+        { }
+
+        bool empty(void) const noexcept { return p_ == end_; }
+
+        const char * take(size_t n)
+        {
+            if(static_cast<size_t>(end_ - p_) < n)
+                throw std::runtime_error("Corrupt binary argument data");
+
+            const char * ret = p_;
+            p_ += n;
+            return ret;
+        }
+
+        //! Read a value stored as its raw bytes
+        template<typename T>
+        T read(void)
+        {
+            T value;
+            memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        //! Read a variable length integer
+        unsigned long long read_varint(void)
+        {
+            unsigned long long value = 0;
+            for(unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                const unsigned char c = static_cast<unsigned char>(*take(1));
+                value |= static_cast<unsigned long long>(c & 0x7F) << shift;
+                if((c & 0x80) == 0)
+                    return value;
+            }
+
+            throw std::runtime_error("Corrupt binary argument data");
+        }
+
+        //! Read an integer (zigzag encoded if signed)
+        template<typename T>
+        T read_int(void)
+        {
+            const unsigned long long u = read_varint();
+            if(std::is_signed<T>::value)
+                return static_cast<T>(static_cast<long long>((u >> 1) ^ (~(u & 1) + 1)));
+            return static_cast<T>(u);
+        }
+
+    private:
+        const char * p_;
+        const char * end_;
+};
+
+
+// Format the next stored argument
+FormatErrc format_next_(OutputBuffer & out, const FormatSpec & fs, ArgReader_ & rd,
+                        const char *& type_name)
+{
+    const ArgTag tag = static_cast<ArgTag>(rd.read<unsigned char>());
+
+    switch(tag)
+    {
+        #define FORMAT_STORED_(tg, type, value) \
+            case ArgTag::tg: type_name = PFTypeMap<type>::name; return handle_fmt_(out, fs, value);
+
+        FORMAT_STORED_(Char,       char,               rd.read_int<char>())
+        FORMAT_STORED_(SChar,      signed char,        rd.read_int<signed char>())
+        FORMAT_STORED_(Short,      signed short,       rd.read_int<signed short>())
+        FORMAT_STORED_(Int,        signed int,         rd.read_int<signed int>())
+        FORMAT_STORED_(Long,       signed long,        rd.read_int<signed long>())
+        FORMAT_STORED_(LongLong,   signed long long,   rd.read_int<signed long long>())
+        FORMAT_STORED_(UChar,      unsigned char,      rd.read_int<unsigned char>())
+        FORMAT_STORED_(UShort,     unsigned short,     rd.read_int<unsigned short>())
+        FORMAT_STORED_(UInt,       unsigned int,       rd.read_int<unsigned int>())
+        FORMAT_STORED_(ULong,      unsigned long,      rd.read_int<unsigned long>())
+        FORMAT_STORED_(ULongLong,  unsigned long long, rd.read_int<unsigned long long>())
+        FORMAT_STORED_(Double,     double,             rd.read<double>())
+        FORMAT_STORED_(LongDouble, long double,        rd.read<long double>())
+        FORMAT_STORED_(Pointer,    const void *,       rd.read<const void *>())
+
+        #undef FORMAT_STORED_
+
+        case ArgTag::CString:
+        {
+            // Stored as length+1 (or zero for a null pointer), then the pointer
+            const unsigned long long len = rd.read_varint();
+            const char * text = len > 0 ? rd.take(len-1) : nullptr;
+            const void * ptr = rd.read<const void *>();
+            type_name = PFTypeMap<const char *>::name;
+
+            // Anything other than a string is checked and formatted as the pointer
+            if(fs.spec != 's' && fs.spec != '?')
+                return handle_fmt_(out, fs, ptr);
+
+            if(text == nullptr)
+                return handle_fmt_(out, fs, static_cast<const char *>(nullptr));
+            else
+                return handle_fmt_(out, fs, StringRef(text, len-1));
+        }
+
+        case ArgTag::String:
+        {
+            const unsigned long long len = rd.read_varint();
+            type_name = PFTypeMap<std::string>::name;
+            return handle_fmt_(out, fs, StringRef(rd.take(len), len));
+        }
+
+        default:
+            throw std::runtime_error("Corrupt binary argument data");
+    }
+}
+
+} // close anonymous namespace
+
+
+
+void format_packed_(OutputBuffer & out, const CompiledFormat & cf,
+                    const char * data, size_t size)
+{
+    ArgReader_ rd(data, size);
+    FormatResult res;
+
+    // Arguments are read in order
+    if(cf.indexed())
+    {
+        set_error_(res, FormatErrc::Unsupported, FormatResult::npos, cf.segments()[0].offset);
+        throw_format_error_(res);
+    }
+
+    size_t idx = 0;
+    for(const auto & seg : cf.segments())
+    {
+        out.append(seg.literal);
+
+        if(!seg.has_spec)
+            break;
+
+        if(rd.empty())
+        {
+            set_error_(res, FormatErrc::NotEnoughArgs, idx, seg.offset);
+            throw_format_error_(res);
+        }
+
+        const char * type_name = nullptr;
+        const FormatErrc errc = format_next_(out, seg.spec, rd, type_name);
+        if(errc != FormatErrc::Ok)
+        {
+            set_error_(res, errc, idx, seg.offset, type_name);
+            throw_format_error_(res);
+        }
+
+        idx++;
+    }
+
+    if(!rd.empty())
+    {
+        set_error_(res, FormatErrc::TooManyArgs, idx, cf.str().size());
+        throw_format_error_(res);
+    }
+}
+
+
+} // close namespace detail
+} // close namespace bpprint
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+
+#include "bpprint/CompiledFormat.hpp"
+
+/*! \file
+ *
+ * Storage of format arguments in binary form
+ *
+ * Each argument is stored as its tag (see ArgTag) followed by its value,
+ * converted to its PFTypeMap::cast_type. Integers are stored as variable
+ * length integers (LEB128, with zigzag encoding for signed types), and
+ * floating point values and pointers as their raw bytes. Strings are
+ * copied, preceded by their length.
+ *
+ * The stored arguments can be formatted later (possibly in another thread,
+ * or another process), giving the same output as formatting the original
+ * arguments. C strings are stored both as text and as the pointer value,
+ * since they may be used with %s or with %p.
+ */
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief Number of bytes needed to store \p v as a variable length integer */
+inline size_t varint_size_(unsigned long long v) noexcept
+{
+    size_t n = 1;
+    while(v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+
+/*! \brief Store \p v as a variable length integer
+ *
+ * \return The end of the stored data
+ */
+inline char * write_varint_(char * p, unsigned long long v) noexcept
+{
+    while(v >= 0x80)
+    {
+        *p++ = static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+
+/*! \brief Map signed integers to unsigned, so that small magnitudes stay small */
+inline unsigned long long zigzag_(long long v) noexcept
+{
+    const unsigned long long u = static_cast<unsigned long long>(v);
+    return (u << 1) ^ (v < 0 ? ~0ull : 0ull);
+}
+
+
+/*! \brief Stores a single value of a basic type
+ *
+ * \tparam T The type of the value (a PFTypeMap::cast_type)
+ */
+template<typename T, bool Integral = std::is_integral<T>::value,
+                     bool Signed = std::is_signed<T>::value>
+struct ValuePacker_
+{
+    static size_t size(T) noexcept { return sizeof(T); }
+
+    static char * pack(char * p, T value) noexcept
+    {
+        memcpy(p, &value, sizeof(value));
+        return p + sizeof(value);
+    }
+};
+
+template<typename T>
+struct ValuePacker_<T, true, false>
+{
+    static size_t size(T value) noexcept { return varint_size_(value); }
+    static char * pack(char * p, T value) noexcept { return write_varint_(p, value); }
+};
+
+template<typename T>
+struct ValuePacker_<T, true, true>
+{
+    static size_t size(T value) noexcept { return varint_size_(zigzag_(value)); }
+    static char * pack(char * p, T value) noexcept { return write_varint_(p, zigzag_(value)); }
+};
+
+
+
+/*! \brief Can all the (decayed) types be stored in binary form?
+ *
+ * User-defined types (with a Formatter) cannot, since they are
+ * formatted by code that may not be available when reading.
+ */
+template<typename... Targs> struct PackableArgs_ : public std::true_type { };
+
+template<typename T, typename... Targs>
+struct PackableArgs_<T, Targs...>
+    : public std::integral_constant<bool, !HasFormatter_<typename std::decay<T>::type>::value &&
+                                          PackableArgs_<Targs...>::value> { };
+
+
+
+/*! \brief Stores a single argument in binary form
+ *
+ * \tparam T The (decayed) type of the argument
+ */
+template<typename T>
+struct ArgPacker_
+{
+    typedef typename PFTypeMap<T>::cast_type cast_type;
+    typedef ValuePacker_<cast_type> Packer;
+
+    //! Number of bytes needed to store \p arg
+    static size_t size(const T & arg) noexcept
+    {
+        return 1 + Packer::size(static_cast<cast_type>(arg));
+    }
+
+    //! Store \p arg at \p p, returning the end of the stored data
+    static char * pack(char * p, const T & arg) noexcept
+    {
+        *p = static_cast<char>(PFTypeMap<T>::tag);
+        return Packer::pack(p+1, static_cast<cast_type>(arg));
+    }
+};
+
+
+// Pointers are always stored as void *
+template<typename T>
+struct ArgPacker_<T *>
+{
+    static size_t size(const T *) noexcept
+    {
+        return 1 + sizeof(const void *);
+    }
+
+    static char * pack(char * p, const T * arg) noexcept
+    {
+        const void * value = arg;
+        *p = static_cast<char>(ArgTag::Pointer);
+        memcpy(p+1, &value, sizeof(value));
+        return p + 1 + sizeof(value);
+    }
+};
+
+
+// C strings store the length plus one (zero for a null pointer),
+// the characters, and the pointer itself (for %p)
+template<>
+struct ArgPacker_<const char *>
+{
+    static size_t size(const char * arg) noexcept
+    {
+        const size_t len = arg ? strlen(arg) : 0;
+        return 1 + varint_size_(arg ? len+1 : 0) + len + sizeof(const void *);
+    }
+
+    static char * pack(char * p, const char * arg) noexcept
+    {
+        const size_t len = arg ? strlen(arg) : 0;
+        const void * value = arg;
+        *p++ = static_cast<char>(ArgTag::CString);
+        p = write_varint_(p, arg ? len+1 : 0);
+        memcpy(p, arg ? arg : "", len);
+        memcpy(p + len, &value, sizeof(value));
+        return p + len + sizeof(value);
+    }
+};
+
+template<>
+struct ArgPacker_<char *> : public ArgPacker_<const char *> { };
+
+
+// Other strings store the length and the characters
+template<>
+struct ArgPacker_<StringRef>
+{
+    static size_t size(StringRef arg) noexcept
+    {
+        return 1 + varint_size_(arg.size()) + arg.size();
+    }
+
+    static char * pack(char * p, StringRef arg) noexcept
+    {
+        *p++ = static_cast<char>(ArgTag::String);
+        p = write_varint_(p, arg.size());
+        memcpy(p, arg.data(), arg.size());
+        return p + arg.size();
+    }
+};
+
+// std::string is formatted as a C string, so it ends at the first null
+template<>
+struct ArgPacker_<std::string>
+{
+    static size_t size(const std::string & arg) noexcept
+    {
+        return ArgPacker_<StringRef>::size(StringRef(arg.c_str(), strlen(arg.c_str())));
+    }
+
+    static char * pack(char * p, const std::string & arg) noexcept
+    {
+        return ArgPacker_<StringRef>::pack(p, StringRef(arg.c_str(), strlen(arg.c_str())));
+    }
+};
+
+#if __cplusplus >= 201703L
+template<>
+struct ArgPacker_<std::string_view> : public ArgPacker_<StringRef> { };
+#endif
+
+
+
+/*! \brief Number of bytes needed to store arguments in binary form */
+inline size_t packed_size_(void) noexcept
+{
+    return 0;
+}
+
+
+/*! \brief Number of bytes needed to store arguments in binary form */
+template<typename T, typename... Targs>
+size_t packed_size_(const T & arg, const Targs &... args) noexcept
+{
+    return ArgPacker_<typename std::decay<T>::type>::size(arg) + packed_size_(args...);
+}
+
+
+/*! \brief Store arguments in binary form
+ *
+ * \param [in] p Where to store the arguments. There must be
+ *               at least packed_size_(args...) bytes available.
+ * \return The end of the stored data
+ */
+inline char * pack_args_(char * p) noexcept
+{
+    return p;
+}
+
+
+/*! \brief Store arguments in binary form
+ *
+ * \param [in] p Where to store the arguments. There must be
+ *               at least packed_size_(arg, args...) bytes available.
+ * \return The end of the stored data
+ */
+template<typename T, typename... Targs>
+char * pack_args_(char * p, const T & arg, const Targs &... args) noexcept
+{
+    p = ArgPacker_<typename std::decay<T>::type>::pack(p, arg);
+    return pack_args_(p, args...);
+}
+
+
+/*! \brief Format arguments stored by pack_args_
+ *
+ * The output is the same as formatting the original arguments
+ * with the compiled format.
+ *
+ * \throw format_error if the correct number of arguments is not given,
+ *        or if an argument does not match its specification
+ * \throw std::runtime_error if the data is corrupt
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] data The stored arguments
+ * \param [in] size The number of bytes in \p data
+ */
+void format_packed_(OutputBuffer & out, const CompiledFormat & cf,
+                    const char * data, size_t size);
+
+
+} // close namespace detail
+} // close namespace bpprint
@@ -0,0 +1,396 @@
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <unistd.h>
+
+#include "bpprint/AsyncLogger.hpp"
+#include "bpprint/FormatCache.hpp"
+
+
+namespace bpprint {
+namespace detail {
+
+
+namespace {
+
+//! Marks the rest of the queue (up to the end of the storage) as unused
+const std::uint32_t ring_padding_ = 0xFFFFFFFF;
+
+} // close anonymous namespace
+
+
+
+SpscRing_::SpscRing_(size_t capacity)
+    : pushed(0), dropped(0), popped(0), orphaned(false), closed(false),
+      buf_(new char[capacity]), capacity_(capacity),
+      head_(0), cached_tail_(0), pending_(0),
+      tail_(0), cached_head_(0)
+{ }
+
+
+char * SpscRing_::try_reserve(size_t n) noexcept
+{
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t offset = head & (capacity_ - 1);
+    const size_t contig = capacity_ - offset;
+
+    // If the record doesn't fit before the end of
+    // the storage, skip to the beginning
+    const size_t needed = (contig < n) ? contig + n : n;
+
+    if(head + needed - cached_tail_ > capacity_)
+    {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if(head + needed - cached_tail_ > capacity_)
+            return nullptr;
+    }
+
+    pending_ = needed;
+
+    if(contig < n)
+    {
+        memcpy(buf_.get() + offset, &ring_padding_, sizeof(ring_padding_));
+        return buf_.get();
+    }
+
+    return buf_.get() + offset;
+}
+
+
+void SpscRing_::publish(void) noexcept
+{
+    head_.store(head_.load(std::memory_order_relaxed) + pending_, std::memory_order_release);
+    pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+const char * SpscRing_::front(size_t & n) noexcept
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+
+    if(tail == cached_head_)
+    {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if(tail == cached_head_)
+            return nullptr;
+    }
+
+    size_t offset = tail & (capacity_ - 1);
+    std::uint32_t size;
+    memcpy(&size, buf_.get() + offset, sizeof(size));
+
+    // Padding is always followed by a record at the beginning
+    if(size == ring_padding_)
+    {
+        tail += capacity_ - offset;
+        tail_.store(tail, std::memory_order_release);
+        offset = 0;
+        memcpy(&size, buf_.get(), sizeof(size));
+    }
+
+    n = size;
+    return buf_.get() + offset;
+}
+
+
+void SpscRing_::pop(size_t n) noexcept
+{
+    tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    popped.store(popped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+} // close namespace detail
+
+
+
+constexpr size_t AsyncLogger::header_size_;
+
+
+namespace {
+
+std::atomic<unsigned long long> next_logger_id_(0);
+
+
+// The queues used by the current thread
+struct ThreadRings_
+{
+    typedef std::pair<unsigned long long, std::shared_ptr<detail::SpscRing_>> Entry;
+    std::vector<Entry> rings;
+
+    ~ThreadRings_()
+    {
+        for(auto & r : rings)
+            r.second->orphaned.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadRings_ thread_rings_;
+
+
+// Write everything, retrying if interrupted
+void write_all_(int fd, const char * data, size_t size)
+{
+    while(size > 0)
+    {
+        const ssize_t n = ::write(fd, data, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return; // nowhere to report the error
+        }
+
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+
+// Smallest power of two that is at least n (and at least 64)
+size_t ring_capacity_(size_t n)
+{
+    size_t cap = 64;
+    while(cap < n)
+        cap *= 2;
+    return cap;
+}
+
+} // close anonymous namespace
+
+
+
+AsyncLogger::AsyncLogger(int fd, size_t queue_size, OverflowPolicy policy)
+    : id_(next_logger_id_.fetch_add(1)), fd_(fd),
+      queue_size_(ring_capacity_(queue_size)), policy_(policy),
+      rings_version_(0), retired_dropped_(0), written_(0),
+      flush_requested_(0), flush_done_(0), stop_(false)
+{
+    thread_ = std::thread(&AsyncLogger::run_, this);
+}
+
+
+AsyncLogger::~AsyncLogger()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_.store(true);
+    }
+    wake_cv_.notify_all();
+    thread_.join();
+
+    // Threads drop their references to the queues when they next need a new one
+    for(auto & r : rings_)
+        r->closed.store(true, std::memory_order_release);
+}
+
+
+detail::SpscRing_ & AsyncLogger::thread_ring_(void)
+{
+    for(auto & r : thread_rings_.rings)
+    {
+        if(r.first == id_)
+            return *r.second;
+    }
+
+    // Forget the queues of loggers that have been destroyed
+    auto & rings = thread_rings_.rings;
+    rings.erase(std::remove_if(rings.begin(), rings.end(),
+                               [](const ThreadRings_::Entry & r) {
+                                   return r.second->closed.load(std::memory_order_acquire);
+                               }),
+                rings.end());
+
+    auto ring = std::make_shared<detail::SpscRing_>(queue_size_);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(ring);
+        rings_version_.fetch_add(1, std::memory_order_release);
+    }
+
+    thread_rings_.rings.emplace_back(id_, ring);
+    return *ring;
+}
+
+
+char * AsyncLogger::reserve_(detail::SpscRing_ & ring, size_t n)
+{
+    if(n > ring.capacity()/2)
+    {
+        retired_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    char * p = ring.try_reserve(n);
+    if(p != nullptr)
+        return p;
+
+    if(policy_ == OverflowPolicy::Drop)
+    {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // Wait for the background thread to make room
+    wake_cv_.notify_one();
+    for(unsigned int i = 0; p == nullptr; i++)
+    {
+        if(i < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+
+        p = ring.try_reserve(n);
+    }
+
+    return p;
+}
+
+
+void AsyncLogger::flush(void)
+{
+    const unsigned long long ticket = flush_requested_.fetch_add(1) + 1;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_cv_.notify_all();
+    flushed_cv_.wait(lock, [&]{ return flush_done_ >= ticket; });
+}
+
+
+size_t AsyncLogger::queue_depth(void) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    unsigned long long depth = 0;
+    for(const auto & r : rings_)
+        depth += r->pushed.load(std::memory_order_relaxed) - r->popped.load(std::memory_order_relaxed);
+    return static_cast<size_t>(depth);
+}
+
+
+unsigned long long AsyncLogger::dropped(void) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    unsigned long long count = retired_dropped_.load(std::memory_order_relaxed);
+    for(const auto & r : rings_)
+        count += r->dropped.load(std::memory_order_relaxed);
+    return count;
+}
+
+
+unsigned long long AsyncLogger::written(void) const noexcept
+{
+    return written_.load(std::memory_order_relaxed);
+}
+
+
+void AsyncLogger::run_(void)
+{
+    std::vector<std::shared_ptr<detail::SpscRing_>> rings;
+    unsigned int version = 0;
+    MemoryBuffer out;
+
+    // Write output in large pieces
+    static const size_t write_size = 65536;
+
+    while(true)
+    {
+        // Read these before draining the queues, so that
+        // everything queued before them is written
+        const unsigned long long ticket = flush_requested_.load(std::memory_order_acquire);
+        const bool stop = stop_.load(std::memory_order_acquire);
+
+        // Pick up new queues, and remove the queues of threads that have exited
+        if(rings_version_.load(std::memory_order_acquire) != version)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(auto it = rings_.begin(); it != rings_.end(); )
+            {
+                if((*it)->orphaned.load(std::memory_order_acquire) && (*it)->empty())
+                {
+                    retired_dropped_.fetch_add((*it)->dropped.load(std::memory_order_relaxed));
+                    it = rings_.erase(it);
+                }
+                else
+                    ++it;
+            }
+
+            rings = rings_;
+            version = rings_version_.load(std::memory_order_acquire);
+        }
+
+        size_t nwritten = 0;
+
+        for(auto & ring : rings)
+        {
+            size_t n;
+            const char * rec;
+            while((rec = ring->front(n)) != nullptr)
+            {
+                std::uint32_t sizes[2];
+                const char * fmt;
+                memcpy(sizes, rec, sizeof(sizes));
+                memcpy(&fmt, rec + sizeof(sizes), sizeof(fmt));
+
+                const size_t mark = out.size();
+                try {
+                    const detail::CachedFormat_ cached(fmt);
+                    if(cached.get() != nullptr)
+                        detail::format_packed_(out, *cached.get(), rec + header_size_, sizes[1]);
+                    else
+                        detail::format_packed_(out, CompiledFormat(fmt), rec + header_size_, sizes[1]);
+                }
+                catch(std::exception & ex)
+                {
+                    out.resize(mark);
+                    out.append("[bpprint error: ");
+                    out.append(ex.what(), strlen(ex.what()));
+                    out.append("]\n");
+                }
+
+                ring->pop(n);
+                nwritten++;
+
+                if(out.size() >= write_size)
+                {
+                    write_all_(fd_, out.data(), out.size());
+                    out.clear();
+                }
+            }
+
+            // Orphaned queues are removed on the next pass
+            if(ring->orphaned.load(std::memory_order_relaxed))
+                rings_version_.fetch_add(1, std::memory_order_release);
+        }
+
+        write_all_(fd_, out.data(), out.size());
+        out.clear();
+        written_.fetch_add(nwritten, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(ticket > flush_done_)
+        {
+            flush_done_ = ticket;
+            flushed_cv_.notify_all();
+        }
+
+        if(stop)
+            break;
+
+        // Nothing to do? Then wait a bit
+        if(nwritten == 0)
+        {
+            wake_cv_.wait_for(lock, std::chrono::milliseconds(1), [&]{
+                return stop_.load() || flush_requested_.load() > flush_done_;
+            });
+        }
+    }
+}
+
+
+} // close namespace bpprint
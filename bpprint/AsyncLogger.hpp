@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bpprint/ArgPack.hpp"
+
+/*! \file
+ *
+ * Asynchronous formatting and output
+ *
+ * The calling thread only stores the format string and a binary copy of
+ * the arguments in a queue. Formatting and writing the output is done by
+ * a background thread.
+ */
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief A lock-free queue of variable-length records
+ *
+ * Only one thread may add records, and only one (other) thread may
+ * remove them. Records are stored contiguously, and their sizes must be
+ * a multiple of 8.
+ */
+class SpscRing_
+{
+    public:
+        /*! \brief Create an empty queue
+         *
+         * \param [in] capacity Size of the queue, in bytes. Must be a power of two
+         *                      (and at least 64)
+         */
+        explicit SpscRing_(size_t capacity);
+
+        SpscRing_(const SpscRing_ &) = delete;
+        SpscRing_ & operator=(const SpscRing_ &) = delete;
+
+
+        //! Size of the queue, in bytes
+        size_t capacity(void) const noexcept { return capacity_; }
+
+
+        /*! \brief Get space for a record of \p n bytes (producer only)
+         *
+         * The record becomes visible to the consumer with publish().
+         *
+         * \return Where to write the record, or nullptr if the queue is full
+         */
+        char * try_reserve(size_t n) noexcept;
+
+
+        /*! \brief Make the reserved record visible to the consumer (producer only) */
+        void publish(void) noexcept;
+
+
+        /*! \brief Get the oldest record (consumer only)
+         *
+         * \param [out] n The size of the record (as passed to try_reserve)
+         * \return The record, or nullptr if the queue is empty
+         */
+        const char * front(size_t & n) noexcept;
+
+
+        /*! \brief Remove the oldest record (consumer only)
+         *
+         * \param [in] n The size of the record, as returned by front()
+         */
+        void pop(size_t n) noexcept;
+
+
+        /*! \brief Is the queue empty? */
+        bool empty(void) const noexcept
+        {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+
+        // Counters, each written by only one thread
+        std::atomic<unsigned long long> pushed;  //!< Records added (producer)
+        std::atomic<unsigned long long> dropped; //!< Records dropped because the queue was full (producer)
+        std::atomic<unsigned long long> popped;  //!< Records removed (consumer)
+
+        //! The producing thread has exited
+        std::atomic<bool> orphaned;
+
+        //! The logger that owns the queue has been destroyed
+        std::atomic<bool> closed;
+
+
+    private:
+        std::unique_ptr<char[]> buf_;
+        size_t capacity_;
+
+        // Producer side
+        char pad0_[64];
+        std::atomic<size_t> head_;   //!< Total bytes published
+        size_t cached_tail_;         //!< Last value of tail_ seen by the producer
+        size_t pending_;             //!< Bytes reserved but not published
+
+        // Consumer side
+        char pad1_[64];
+        std::atomic<size_t> tail_;   //!< Total bytes consumed
+        size_t cached_head_;         //!< Last value of head_ seen by the consumer
+        char pad2_[64];
+};
+
+
+} // close namespace detail
+
+
+
+/*! \brief Formats and writes messages to a file descriptor in the background
+ *
+ * Calling log() copies the arguments (in binary form) into a queue
+ * belonging to the calling thread, without any locking or formatting.
+ * A background thread then formats the messages and writes them to
+ * the file descriptor.
+ *
+ * Messages from a single thread are written in order. Messages from
+ * different threads may be interleaved in any order.
+ *
+ * Since the format string is not copied, it must remain valid until the
+ * message is written (typically, it is a string literal). Errors in
+ * formatting (such as an argument that does not match its specification)
+ * are reported in the output in place of the message.
+ */
+class AsyncLogger
+{
+    public:
+        //! What to do when the queue of the calling thread is full
+        enum class OverflowPolicy
+        {
+            Drop,  //!< Discard the message
+            Block  //!< Wait until there is room
+        };
+
+
+        /*! \brief Start the background thread
+         *
+         * \param [in] fd The file descriptor to write to. It is not closed by the logger.
+         * \param [in] queue_size Size of the queue for each thread, in bytes
+         *                        (rounded up to a power of two)
+         * \param [in] policy What to do when a queue is full
+         */
+        explicit AsyncLogger(int fd, size_t queue_size = 65536,
+                             OverflowPolicy policy = OverflowPolicy::Drop);
+
+
+        /*! \brief Write all remaining messages and stop the background thread */
+        ~AsyncLogger();
+
+        AsyncLogger(const AsyncLogger &) = delete;
+        AsyncLogger & operator=(const AsyncLogger &) = delete;
+
+
+        /*! \brief Queue a message to be formatted and written
+         *
+         * Messages larger than half the queue size are always dropped.
+         *
+         * \param [in] fmt The format string. This must remain valid until the message is written.
+         * \param [in] args Arguments to the format string
+         * \return True if the message was queued, false if it was dropped
+         */
+        template<typename... Targs>
+        bool log(const char * fmt, const Targs &... args)
+        {
+            static_assert(detail::ValidPrintfArgs<Targs...>::value,
+                          "Invalid argument type passed to Format");
+            static_assert(detail::PackableArgs_<Targs...>::value,
+                          "User-defined types cannot be stored in binary form");
+
+            const size_t argsize = detail::packed_size_(args...);
+            const size_t n = (header_size_ + argsize + 7) & ~size_t(7);
+
+            detail::SpscRing_ & ring = thread_ring_();
+            char * p = reserve_(ring, n);
+            if(p == nullptr)
+                return false;
+
+            const std::uint32_t sizes[2] = { static_cast<std::uint32_t>(n),
+                                             static_cast<std::uint32_t>(argsize) };
+            memcpy(p, sizes, sizeof(sizes));
+            memcpy(p + sizeof(sizes), &fmt, sizeof(fmt));
+            detail::pack_args_(p + header_size_, args...);
+
+            ring.publish();
+            return true;
+        }
+
+
+        /*! \brief Wait until all messages queued so far have been written */
+        void flush(void);
+
+
+        /*! \brief Number of messages waiting to be written (in all queues) */
+        size_t queue_depth(void) const;
+
+
+        /*! \brief Number of messages that have been dropped */
+        unsigned long long dropped(void) const;
+
+
+        /*! \brief Number of messages that have been written */
+        unsigned long long written(void) const noexcept;
+
+
+    private:
+        //! Record header: size of the record, size of the arguments, and format string
+        static constexpr size_t header_size_ = 2*sizeof(std::uint32_t) + sizeof(const char *);
+
+        const unsigned long long id_;
+        const int fd_;
+        const size_t queue_size_;
+        const OverflowPolicy policy_;
+
+        //! All queues (protected by mutex_)
+        std::vector<std::shared_ptr<detail::SpscRing_>> rings_;
+        std::atomic<unsigned int> rings_version_;
+
+        //! Dropped messages from queues that no longer exist, or that were too large
+        std::atomic<unsigned long long> retired_dropped_;
+        std::atomic<unsigned long long> written_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable wake_cv_;
+        std::condition_variable flushed_cv_;
+        std::atomic<unsigned long long> flush_requested_;
+        unsigned long long flush_done_;
+        std::atomic<bool> stop_;
+
+        std::thread thread_;
+
+
+        //! Get (or create) the queue for the calling thread
+        detail::SpscRing_ & thread_ring_(void);
+
+        //! Get space in the queue, applying the overflow policy
+        char * reserve_(detail::SpscRing_ & ring, size_t n);
+
+        //! The background thread
+        void run_(void);
+};
+
+
+} // close namespace bpprint
@@ -0,0 +1,167 @@
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bpprint/Batch.hpp"
+
+
+namespace bpprint {
+namespace detail {
+
+
+void resolve_batch_spec_(BatchSpec_ & bs, const FormatSpec & fs,
+                         const char * pflength, const char * pftype)
+{
+    const char * length = fs.length;
+    char spec = fs.spec;
+
+    if(strlen(length) == 0 && spec == '?') // auto deduction
+    {
+        length = pflength;
+        spec = pftype[0];
+    }
+
+    bs.cs = fs;
+    bs.spec = spec;
+    bs.as_pointer = false;
+
+    // The complete format passed to printf
+    bs.pffmt = fs.format;
+    bs.pffmt += length;
+    bs.pffmt += spec;
+}
+
+
+
+namespace {
+
+// Output of a single chunk, waiting to be written
+struct ChunkSlot_
+{
+    MemoryBuffer buf;
+    bool ready = false;
+};
+
+} // close anonymous namespace
+
+
+void run_parallel_(size_t nchunks, size_t nthreads,
+                   const std::function<void(OutputBuffer &, size_t)> & format_chunk,
+                   const ChunkWriter_ & write)
+{
+    if(nthreads == 0)
+        nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+    nthreads = std::min(nthreads, nchunks);
+
+    if(nthreads <= 1)
+    {
+        MemoryBuffer buf;
+        for(size_t k = 0; k < nchunks; k++)
+        {
+            buf.clear();
+            format_chunk(buf, k);
+            write(buf.data(), buf.size());
+        }
+        return;
+    }
+
+    // Chunk k goes in slot k % window, which is free
+    // once chunk k - window has been written
+    const size_t window = 2*nthreads;
+    std::unique_ptr<ChunkSlot_[]> slots(new ChunkSlot_[window]);
+
+    std::mutex mtx;
+    std::condition_variable cv_ready;  // a chunk has been formatted
+    std::condition_variable cv_free;   // a chunk has been written
+    size_t next = 0;
+    size_t written = 0;
+    bool stop = false;
+    std::exception_ptr error;
+
+    auto fail = [&](std::exception_ptr ex)
+    {
+        std::lock_guard<std::mutex> l(mtx);
+        if(!error)
+            error = ex;
+        stop = true;
+        cv_ready.notify_all();
+        cv_free.notify_all();
+    };
+
+    auto worker = [&](void)
+    {
+        while(true)
+        {
+            size_t k;
+            {
+                std::unique_lock<std::mutex> l(mtx);
+                cv_free.wait(l, [&]{ return stop || next >= nchunks || next < written + window; });
+                if(stop || next >= nchunks)
+                    return;
+                k = next++;
+            }
+
+            ChunkSlot_ & slot = slots[k % window];
+
+            try {
+                slot.buf.clear();
+                format_chunk(slot.buf, k);
+            }
+            catch(...)
+            {
+                fail(std::current_exception());
+                return;
+            }
+
+            std::lock_guard<std::mutex> l(mtx);
+            slot.ready = true;
+            cv_ready.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads);
+
+    try {
+        for(size_t i = 0; i < nthreads; i++)
+            threads.emplace_back(worker);
+
+        // This thread writes the chunks in order
+        for(size_t k = 0; k < nchunks; k++)
+        {
+            ChunkSlot_ & slot = slots[k % window];
+
+            {
+                std::unique_lock<std::mutex> l(mtx);
+                cv_ready.wait(l, [&]{ return stop || slot.ready; });
+                if(stop)
+                    break;
+            }
+
+            write(slot.buf.data(), slot.buf.size());
+
+            std::lock_guard<std::mutex> l(mtx);
+            slot.ready = false;
+            written++;
+            cv_free.notify_all();
+        }
+    }
+    catch(...)
+    {
+        fail(std::current_exception());
+    }
+
+    for(auto & t : threads)
+        t.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+
+} // close namespace detail
+} // close namespace bpprint
@@ -0,0 +1,583 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iterator>
+#include <ostream>
+#include <tuple>
+
+#include "bpprint/StaticFormat.hpp"
+
+/*! \file
+ *
+ * Formatting of many records with the same format
+ *
+ * format_columns() takes a format and one array per argument (a column),
+ * and formats every row into a single buffer. format_rows() does the same
+ * for a range of tuples. The output is the same as calling format_to once
+ * per row, but the format is parsed once, the arguments are checked once
+ * (against the first row), and the output buffer is sized once.
+ *
+ * format_columns_parallel() and format_rows_parallel() split a batch into
+ * chunks of rows that are formatted by several threads. The chunks are
+ * output in order, so the output is identical to that of a single thread.
+ */
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief A format specification that has been checked against a column type
+ *
+ * This holds everything needed to convert a value without looking at
+ * the format specification again.
+ */
+struct BatchSpec_
+{
+    //! Flags, width, and precision
+    ConvSpec cs;
+
+    //! The type specifier (with %? resolved)
+    char spec;
+
+    //! True if a C string should be formatted as a pointer
+    bool as_pointer;
+
+    //! The complete printf format, for conversions done by printf
+    std::string pffmt;
+};
+
+
+/*! \brief Fill in a BatchSpec_ from a specification
+ *
+ * The specification must have already been checked against the type
+ * (with the given printf length and types).
+ *
+ * \param [out] bs The resolved specification
+ * \param [in] fs The specification from the format string
+ * \param [in] pflength The length specifier of the type (see PFTypeMap)
+ * \param [in] pftype The valid type specifiers of the type (see PFTypeMap)
+ */
+void resolve_batch_spec_(BatchSpec_ & bs, const FormatSpec & fs,
+                         const char * pflength, const char * pftype);
+
+
+/*! \brief Throw if a value could not be converted
+ *
+ * The specifications have been checked against the first row,
+ * so only a failure of snprintf is possible here.
+ */
+inline void check_batch_convert_(FormatErrc errc)
+{
+    if(errc != FormatErrc::Ok)
+    {
+        FormatResult res;
+        res.errc = errc;
+        throw_format_error_(res);
+    }
+}
+
+
+/*! \brief Converts values of a basic type
+ *
+ * \tparam T The type of the values (with an entry in PFTypeMap)
+ */
+template<typename T, bool User = HasFormatter_<T>::value>
+struct BatchValue_
+{
+    typedef typename PFTypeMap<T>::cast_type cast_type;
+
+    static void resolve(BatchSpec_ & bs, const FormatSpec & fs)
+    {
+        resolve_batch_spec_(bs, fs, PFTypeMap<T>::pflength, PFTypeMap<T>::pftype);
+    }
+
+    static void convert(OutputBuffer & out, const BatchSpec_ & bs, const T & value)
+    {
+        check_batch_convert_(static_convert_(out, bs.cs, bs.spec, bs.pffmt.c_str(),
+                                             static_cast<cast_type>(value)));
+    }
+};
+
+
+/*! \brief Converts values of a user-defined type
+ *
+ * \tparam T The type of the values (with a Formatter)
+ */
+template<typename T>
+struct BatchValue_<T, true>
+{
+    static void resolve(BatchSpec_ & bs, const FormatSpec & fs)
+    {
+        resolve_batch_spec_(bs, fs, "", Formatter<T>::pftype);
+    }
+
+    static void convert(OutputBuffer & out, const BatchSpec_ & bs, const T & value)
+    {
+        Formatter<T>::format(out, bs.cs, bs.spec, value);
+    }
+};
+
+
+/*! \brief Converts values of a single column
+ *
+ * \tparam T The (decayed) type of the column
+ */
+template<typename T>
+struct BatchArg_ : public BatchValue_<T> { };
+
+
+// Pointers are always formatted as void *
+template<typename T>
+struct BatchArg_<T *> : public BatchValue_<const void *> { };
+
+
+// C strings may be formatted as strings or pointers
+template<>
+struct BatchArg_<const char *>
+{
+    static void resolve(BatchSpec_ & bs, const FormatSpec & fs)
+    {
+        if(fs.spec == 's' || fs.spec == '?')
+            resolve_batch_spec_(bs, fs, "", "s");
+        else
+            BatchValue_<const void *>::resolve(bs, fs);
+        bs.as_pointer = (bs.spec != 's');
+    }
+
+    static void convert(OutputBuffer & out, const BatchSpec_ & bs, const char * value)
+    {
+        if(bs.as_pointer)
+            check_batch_convert_(static_convert_(out, bs.cs, bs.spec, bs.pffmt.c_str(),
+                                                 static_cast<const void *>(value)));
+        else
+            check_batch_convert_(static_convert_(out, bs.cs, bs.spec, bs.pffmt.c_str(), value));
+    }
+};
+
+template<>
+struct BatchArg_<char *> : public BatchArg_<const char *> { };
+
+
+// std::string is formatted through its C string, as by handle_fmt_
+template<>
+struct BatchArg_<std::string>
+{
+    static void resolve(BatchSpec_ & bs, const FormatSpec & fs)
+    {
+        resolve_batch_spec_(bs, fs, "", "s");
+    }
+
+    static void convert(OutputBuffer & out, const BatchSpec_ & bs, const std::string & value)
+    {
+        check_batch_convert_(static_convert_(out, bs.cs, bs.spec, bs.pffmt.c_str(), value.c_str()));
+    }
+};
+
+
+#if __cplusplus >= 201703L
+template<>
+struct BatchArg_<std::string_view>
+{
+    static void resolve(BatchSpec_ & bs, const FormatSpec & fs)
+    {
+        resolve_batch_spec_(bs, fs, "", "s");
+    }
+
+    static void convert(OutputBuffer & out, const BatchSpec_ & bs, std::string_view value)
+    {
+        check_batch_convert_(static_convert_(out, bs.cs, bs.spec, nullptr, StringRef(value)));
+    }
+};
+#endif
+
+
+/*! \brief Format rows [begin, end) of a set of columns
+ *
+ * The arguments must have already been checked, and \p specs resolved.
+ */
+template<size_t... I, typename... Tcols>
+void format_column_rows_(OutputBuffer & out, const CompiledFormat & cf,
+                         const BatchSpec_ * specs, Indices<I...>,
+                         size_t begin, size_t end, const Tcols *... cols)
+{
+    const std::vector<CompiledFormat::Segment> & segs = cf.segments();
+    const std::string & tail = segs[sizeof...(I)].literal;
+
+    for(size_t r = begin; r < end; r++)
+    {
+        // Expands to one conversion per column, in order
+        int expand[] = { 0, (out.append(segs[I].literal),
+                             BatchArg_<Tcols>::convert(out, specs[I], cols[r]), 0)... };
+        (void)expand;
+
+        out.append(tail);
+    }
+}
+
+
+/*! \brief Format a range of tuples
+ *
+ * The arguments must have already been checked, and \p specs resolved.
+ */
+template<size_t... I, typename Iter>
+void format_tuple_rows_(OutputBuffer & out, const CompiledFormat & cf,
+                        const BatchSpec_ * specs, Indices<I...>,
+                        Iter first, Iter last)
+{
+    typedef typename std::decay<decltype(*first)>::type row_type;
+
+    const std::vector<CompiledFormat::Segment> & segs = cf.segments();
+    const std::string & tail = segs[sizeof...(I)].literal;
+
+    for(; first != last; ++first)
+    {
+        const row_type & row = *first;
+
+        int expand[] = { 0, (out.append(segs[I].literal),
+                             BatchArg_<typename std::decay<typename std::tuple_element<I, row_type>::type>::type>
+                                 ::convert(out, specs[I], std::get<I>(row)), 0)... };
+        (void)expand;
+
+        out.append(tail);
+    }
+}
+
+
+/*! \brief Resolve the specifications of a compiled format for each column
+ *
+ * \tparam Row A tuple type with the (possibly not decayed) column types
+ */
+template<typename Row, size_t... I>
+void resolve_batch_specs_(BatchSpec_ * specs, const CompiledFormat & cf, Indices<I...>)
+{
+    int expand[] = { 0, (BatchArg_<typename std::decay<typename std::tuple_element<I, Row>::type>::type>
+                             ::resolve(specs[I], cf.segments()[I].spec), 0)... };
+    (void)expand;
+}
+
+
+/*! \brief Check the number of arguments of a compiled format
+ *
+ * Each column must be used by one specification, in order.
+ */
+inline void check_batch_nargs_(const CompiledFormat & cf, size_t ncols)
+{
+    FormatResult res;
+    if(cf.indexed())
+        set_error_(res, FormatErrc::Unsupported, FormatResult::npos, cf.segments()[0].offset);
+    if(!res.ok() || !check_nargs_(res, cf, ncols))
+        throw_format_error_(res);
+}
+
+
+//! Format the first row (checking all arguments) and size the output for the rest
+template<size_t... I, typename Row>
+void format_first_row_(OutputBuffer & out, const CompiledFormat & cf,
+                       Indices<I...>, const Row & row, size_t nrows)
+{
+    const size_t mark = out.size();
+    const FormatArg_ argarr[] = { make_arg_(std::get<I>(row))..., FormatArg_{ nullptr, nullptr } };
+    FormatResult res;
+    if(!format_args_(out, res, cf, argarr))
+        throw_format_error_(res);
+    out.reserve((out.size() - mark) * (nrows - 1));
+}
+
+
+
+/*! \brief Receives formatted output, in order */
+typedef std::function<void(const char *, size_t)> ChunkWriter_;
+
+
+/*! \brief Format chunks in parallel, writing them in order
+ *
+ * Chunks are handed out to the threads one at a time, as each thread
+ * becomes free. Each thread formats into its own buffer, and the calling
+ * thread writes the buffers in order. At most a few chunks per thread
+ * are held in memory at once.
+ *
+ * \throw The first exception thrown while formatting or writing a chunk.
+ *        Remaining chunks are not formatted.
+ *
+ * \param [in] nchunks The number of chunks
+ * \param [in] nthreads The number of threads (0 for the number of cores)
+ * \param [in] format_chunk Appends the formatted output of a chunk to a buffer
+ * \param [in] write Writes the output of a chunk
+ */
+void run_parallel_(size_t nchunks, size_t nthreads,
+                   const std::function<void(OutputBuffer &, size_t)> & format_chunk,
+                   const ChunkWriter_ & write);
+
+} // close namespace detail
+
+
+
+/*! \brief Format rows of data stored as columns
+ *
+ * Row `i` is formatted as if by `format_to(out, cf, cols[i]...)`, and
+ * all rows are appended to \p out.
+ *
+ * \throw format_error if the number of columns does not match the format, or
+ *        if a column type does not match its specification
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] nrows The number of rows
+ * \param [in] cols One array (of at least \p nrows elements) per argument
+ */
+template<typename... Tcols>
+void format_columns(OutputBuffer & out, const CompiledFormat & cf,
+                    size_t nrows, const Tcols *... cols)
+{
+    static_assert(detail::ValidPrintfArgs<Tcols...>::value,
+                  "Invalid argument type passed to Format");
+
+    detail::check_batch_nargs_(cf, sizeof...(Tcols));
+
+    if(nrows == 0)
+        return;
+
+    // The first row is formatted normally, which checks every argument
+    // against its specification. The rest can then skip the checks.
+    typedef typename detail::MakeIndices<sizeof...(Tcols)>::type indices;
+    detail::format_first_row_(out, cf, indices(), std::forward_as_tuple(cols[0]...), nrows);
+
+    std::array<detail::BatchSpec_, sizeof...(Tcols)> specs;
+    detail::resolve_batch_specs_<std::tuple<Tcols...>>(specs.data(), cf, indices());
+
+    detail::format_column_rows_(out, cf, specs.data(), indices(), 1, nrows, cols...);
+}
+
+
+/*! \brief Format rows of data stored as columns
+ *
+ * Overload that compiles the format string once for the whole batch.
+ */
+template<typename... Tcols>
+void format_columns(OutputBuffer & out, const std::string & fmt,
+                    size_t nrows, const Tcols *... cols)
+{
+    format_columns(out, CompiledFormat(fmt), nrows, cols...);
+}
+
+
+
+/*! \brief Format a range of rows, each stored as a tuple
+ *
+ * Each element of [first, last) must be a `std::tuple` (or `std::pair` or
+ * `std::array`) holding the arguments for one row, formatted as if by
+ * `format_to(out, cf, std::get<I>(row)...)`. The iterators must be
+ * forward iterators.
+ *
+ * \throw format_error if the number of elements in a row does not match the
+ *        format, or if an element type does not match its specification
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] first The first row
+ * \param [in] last Just past the last row
+ */
+template<typename Iter>
+void format_rows(OutputBuffer & out, const CompiledFormat & cf, Iter first, Iter last)
+{
+    typedef typename std::decay<decltype(*first)>::type row_type;
+    static const size_t ncols = std::tuple_size<row_type>::value;
+    typedef typename detail::MakeIndices<ncols>::type indices;
+
+    detail::check_batch_nargs_(cf, ncols);
+
+    if(first == last)
+        return;
+
+    detail::format_first_row_(out, cf, indices(), *first,
+                              static_cast<size_t>(std::distance(first, last)));
+
+    std::array<detail::BatchSpec_, ncols> specs;
+    detail::resolve_batch_specs_<row_type>(specs.data(), cf, indices());
+
+    detail::format_tuple_rows_(out, cf, specs.data(), indices(), ++first, last);
+}
+
+
+/*! \brief Format a range of rows, each stored as a tuple
+ *
+ * Overload that compiles the format string once for the whole batch.
+ */
+template<typename Iter>
+void format_rows(OutputBuffer & out, const std::string & fmt, Iter first, Iter last)
+{
+    format_rows(out, CompiledFormat(fmt), first, last);
+}
+
+
+
+
+/*! \brief Options for parallel formatting */
+struct ParallelOptions
+{
+    //! Number of threads to use (0 for the number of cores)
+    size_t nthreads = 0;
+
+    //! Number of rows formatted by a thread at a time
+    size_t chunk_rows = 8192;
+};
+
+
+namespace detail {
+
+//! Format columns in parallel. See format_columns_parallel
+template<typename... Tcols>
+void format_columns_parallel_(const ChunkWriter_ & write, const CompiledFormat & cf,
+                              const ParallelOptions & opts, size_t nrows, const Tcols *... cols)
+{
+    static_assert(ValidPrintfArgs<Tcols...>::value,
+                  "Invalid argument type passed to Format");
+
+    check_batch_nargs_(cf, sizeof...(Tcols));
+
+    if(nrows == 0)
+        return;
+
+    // Check every argument against its specification (using the first row)
+    typedef typename MakeIndices<sizeof...(Tcols)>::type indices;
+    {
+        const FormatArg_ argarr[] = { make_arg_(cols[0])..., FormatArg_{ nullptr, nullptr } };
+        MemoryBuffer scratch;
+        FormatResult res;
+        if(!format_args_(scratch, res, cf, argarr))
+            throw_format_error_(res);
+    }
+
+    std::array<BatchSpec_, sizeof...(Tcols)> specs;
+    resolve_batch_specs_<std::tuple<Tcols...>>(specs.data(), cf, indices());
+
+    const size_t chunk = std::max<size_t>(opts.chunk_rows, 1);
+
+    run_parallel_((nrows + chunk - 1) / chunk, opts.nthreads,
+                  [&](OutputBuffer & buf, size_t k)
+                  {
+                      const size_t begin = k * chunk;
+                      const size_t end = std::min(begin + chunk, nrows);
+                      format_column_rows_(buf, cf, specs.data(), indices(), begin, end, cols...);
+                  },
+                  write);
+}
+
+
+//! Format a range of tuples in parallel. See format_rows_parallel
+template<typename Iter>
+void format_rows_parallel_(const ChunkWriter_ & write, const CompiledFormat & cf,
+                           const ParallelOptions & opts, Iter first, Iter last)
+{
+    typedef typename std::decay<decltype(*first)>::type row_type;
+    static const size_t ncols = std::tuple_size<row_type>::value;
+    typedef typename MakeIndices<ncols>::type indices;
+
+    check_batch_nargs_(cf, ncols);
+
+    if(first == last)
+        return;
+
+    {
+        MemoryBuffer scratch;
+        format_first_row_(scratch, cf, indices(), *first, 1);
+    }
+
+    std::array<BatchSpec_, ncols> specs;
+    resolve_batch_specs_<row_type>(specs.data(), cf, indices());
+
+    const size_t nrows = static_cast<size_t>(last - first);
+    const size_t chunk = std::max<size_t>(opts.chunk_rows, 1);
+
+    run_parallel_((nrows + chunk - 1) / chunk, opts.nthreads,
+                  [&](OutputBuffer & buf, size_t k)
+                  {
+                      const size_t begin = k * chunk;
+                      const size_t end = std::min(begin + chunk, nrows);
+                      format_tuple_rows_(buf, cf, specs.data(), indices(), first + begin, first + end);
+                  },
+                  write);
+}
+
+} // close namespace detail
+
+
+
+/*! \brief Format rows of data stored as columns, using several threads
+ *
+ * The output is identical to that of format_columns().
+ *
+ * \throw format_error if the number of columns does not match the format, or
+ *        if a column type does not match its specification
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] opts Number of threads and size of the chunks
+ * \param [in] nrows The number of rows
+ * \param [in] cols One array (of at least \p nrows elements) per argument
+ */
+template<typename... Tcols>
+void format_columns_parallel(OutputBuffer & out, const CompiledFormat & cf,
+                             const ParallelOptions & opts, size_t nrows, const Tcols *... cols)
+{
+    detail::format_columns_parallel_([&out](const char * p, size_t n) { out.append(p, n); },
+                                     cf, opts, nrows, cols...);
+}
+
+
+/*! \brief Format rows of data stored as columns, using several threads
+ *
+ * Overload that writes each chunk to a stream as soon as it (and all
+ * chunks before it) are formatted, so the whole output is never held
+ * in memory.
+ */
+template<typename... Tcols>
+void format_columns_parallel(std::ostream & os, const CompiledFormat & cf,
+                             const ParallelOptions & opts, size_t nrows, const Tcols *... cols)
+{
+    detail::format_columns_parallel_([&os](const char * p, size_t n) { os.write(p, static_cast<std::streamsize>(n)); },
+                                     cf, opts, nrows, cols...);
+}
+
+
+
+/*! \brief Format a range of rows, each stored as a tuple, using several threads
+ *
+ * The output is identical to that of format_rows(). The iterators must be
+ * random access iterators.
+ *
+ * \throw format_error if the number of elements in a row does not match the
+ *        format, or if an element type does not match its specification
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] opts Number of threads and size of the chunks
+ * \param [in] first The first row
+ * \param [in] last Just past the last row
+ */
+template<typename Iter>
+void format_rows_parallel(OutputBuffer & out, const CompiledFormat & cf,
+                          const ParallelOptions & opts, Iter first, Iter last)
+{
+    detail::format_rows_parallel_([&out](const char * p, size_t n) { out.append(p, n); },
+                                  cf, opts, first, last);
+}
+
+
+/*! \brief Format a range of rows, each stored as a tuple, using several threads
+ *
+ * Overload that writes each chunk to a stream as soon as it (and all
+ * chunks before it) are formatted.
+ */
+template<typename Iter>
+void format_rows_parallel(std::ostream & os, const CompiledFormat & cf,
+                          const ParallelOptions & opts, Iter first, Iter last)
+{
+    detail::format_rows_parallel_([&os](const char * p, size_t n) { os.write(p, static_cast<std::streamsize>(n)); },
+                                  cf, opts, first, last);
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,210 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "bpprint/BinaryLog.hpp"
+
+
+namespace bpprint {
+
+
+namespace {
+
+const char log_magic_[8] = { 'B', 'P', 'P', 'L', 'O', 'G', '2', '\0' };
+
+
+/*! \brief Describes the platform, since arguments are stored in native form
+ *
+ * The sizes of the basic types, and a value that depends
+ * on the byte order.
+ */
+struct PlatformInfo_
+{
+    unsigned char sizes[8];
+    std::uint32_t byte_order;
+};
+
+
+PlatformInfo_ platform_info_(void) noexcept
+{
+    PlatformInfo_ pi;
+    pi.sizes[0] = sizeof(short);
+    pi.sizes[1] = sizeof(int);
+    pi.sizes[2] = sizeof(long);
+    pi.sizes[3] = sizeof(long long);
+    pi.sizes[4] = sizeof(double);
+    pi.sizes[5] = sizeof(long double);
+    pi.sizes[6] = sizeof(void *);
+    pi.sizes[7] = sizeof(size_t);
+    pi.byte_order = 0x01020304;
+    return pi;
+}
+
+} // close anonymous namespace
+
+
+
+BinaryLogWriter::BinaryLogWriter(std::ostream & os)
+    : os_(os)
+{
+    const PlatformInfo_ pi = platform_info_();
+    buf_.append(log_magic_, sizeof(log_magic_));
+    buf_.append(reinterpret_cast<const char *>(pi.sizes), sizeof(pi.sizes));
+    buf_.append(reinterpret_cast<const char *>(&pi.byte_order), sizeof(pi.byte_order));
+}
+
+
+BinaryLogWriter::~BinaryLogWriter()
+{
+    try {
+        flush();
+    }
+    catch(...)
+    {
+        // nowhere to report it
+    }
+}
+
+
+void BinaryLogWriter::flush(void)
+{
+    os_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    os_.flush();
+    buf_.clear();
+}
+
+
+size_t BinaryLogWriter::format_id_(const char * fmt)
+{
+    // The same address may hold a different format string later
+    auto it = ids_.find(fmt);
+    if(it != ids_.end() && strcmp(it->second.second.c_str(), fmt) == 0)
+        return it->second.first;
+
+    const size_t id = formats_.size();
+    const size_t len = strlen(fmt);
+    if(len > detail::max_binary_record_)
+        throw std::length_error("Format string is too large for a binary log");
+
+    const size_t size = 1 + detail::varint_size_(id) + detail::varint_size_(len) + len;
+
+    char * p = buf_.reserve(size);
+    *p++ = 'D';
+    p = detail::write_varint_(p, id);
+    p = detail::write_varint_(p, len);
+    memcpy(p, fmt, len);
+    buf_.commit(size);
+
+    formats_.emplace_back(fmt, len);
+    ids_[fmt] = std::make_pair(id, formats_.back());
+    return id;
+}
+
+
+
+BinaryLogReader::BinaryLogReader(std::istream & is)
+    : is_(is)
+{
+    char magic[sizeof(log_magic_)];
+    PlatformInfo_ pi;
+
+    is_.read(magic, sizeof(magic));
+    if(!is_ || memcmp(magic, log_magic_, sizeof(magic)) != 0)
+        throw std::runtime_error("Not a binary log");
+
+    read_(reinterpret_cast<char *>(pi.sizes), sizeof(pi.sizes));
+    read_(reinterpret_cast<char *>(&pi.byte_order), sizeof(pi.byte_order));
+
+    const PlatformInfo_ local = platform_info_();
+    if(memcmp(pi.sizes, local.sizes, sizeof(pi.sizes)) != 0 || pi.byte_order != local.byte_order)
+        throw std::runtime_error("Binary log was written on an incompatible platform");
+}
+
+
+void BinaryLogReader::read_(char * dest, size_t n)
+{
+    is_.read(dest, static_cast<std::streamsize>(n));
+    if(static_cast<size_t>(is_.gcount()) != n)
+        throw std::runtime_error("Binary log is truncated");
+}
+
+
+size_t BinaryLogReader::read_varint_(void)
+{
+    unsigned long long value = 0;
+    for(unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        const int c = is_.get();
+        if(c == std::char_traits<char>::eof())
+            throw std::runtime_error("Binary log is truncated");
+
+        value |= static_cast<unsigned long long>(c & 0x7F) << shift;
+        if((c & 0x80) == 0)
+            return static_cast<size_t>(value);
+    }
+
+    throw std::runtime_error("Corrupt binary log");
+}
+
+
+size_t BinaryLogReader::read_size_(void)
+{
+    const size_t size = read_varint_();
+    if(size > detail::max_binary_record_)
+        throw std::runtime_error("Corrupt binary log");
+    return size;
+}
+
+
+bool BinaryLogReader::next(OutputBuffer & out)
+{
+    while(true)
+    {
+        const int kind = is_.get();
+        if(kind == std::char_traits<char>::eof())
+            return false;
+
+        const size_t id = read_varint_();
+        const size_t size = read_size_();
+
+        if(kind == 'D')
+        {
+            if(id != formats_.size())
+                throw std::runtime_error("Corrupt binary log dictionary");
+
+            std::string fmt(size, '\0');
+            read_(&fmt[0], fmt.size());
+            formats_.push_back(std::move(fmt));
+            compiled_.emplace_back();
+            continue;
+        }
+
+        if(kind != 'M' || id >= formats_.size())
+            throw std::runtime_error("Corrupt binary log");
+
+        args_.resize(size);
+        read_(args_.data(), args_.size());
+
+        // The whole record has been read, so errors in formatting
+        // do not affect the rest of the log
+        const size_t mark = out.size();
+        try {
+            std::unique_ptr<CompiledFormat> & cf = compiled_[id];
+            if(!cf)
+                cf.reset(new CompiledFormat(formats_[id]));
+
+            detail::format_packed_(out, *cf, args_.data(), args_.size());
+        }
+        catch(std::exception & ex)
+        {
+            out.resize(mark);
+            out.append("[bpprint error: ");
+            out.append(ex.what(), strlen(ex.what()));
+            out.append("]\n");
+        }
+
+        return true;
+    }
+}
+
+
+} // close namespace bpprint
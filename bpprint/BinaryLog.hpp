@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "bpprint/ArgPack.hpp"
+
+/*! \file
+ *
+ * Binary logs
+ *
+ * Instead of formatting messages, a BinaryLogWriter stores the format
+ * string (once, in a dictionary) and a binary copy of the arguments (see
+ * ArgPack.hpp). The messages can be formatted later with a BinaryLogReader
+ * (or the bpprint_decode program), giving the same text as formatting
+ * them directly.
+ *
+ * The arguments are stored in the native representation, so binary logs
+ * can only be read on the same kind of platform that wrote them.
+ *
+ * A binary log is a header followed by any number of records.
+ * Each record starts with a single character, and integers in
+ * the records are stored as variable length integers:
+ *  - 'D' - Dictionary entry: id, length, and the format string
+ *  - 'M' - Message: id of the format string, size of the arguments,
+ *          and the arguments
+ */
+
+namespace bpprint {
+namespace detail {
+
+/*! \brief Largest format string, or arguments of a message, in a binary log
+ *
+ * Sizes read from a log are checked against this before anything is
+ * allocated, so that a damaged size is reported as corruption.
+ */
+const size_t max_binary_record_ = size_t(1) << 26;
+
+} // close namespace detail
+
+
+/*! \brief Writes messages to a binary log
+ *
+ * Output is buffered, and is written to the stream when the buffer is
+ * full, on flush(), and on destruction.
+ */
+class BinaryLogWriter
+{
+    public:
+        /*! \brief Start a binary log, writing the header
+         *
+         * \param [in] os The stream to write to. It must be opened in binary mode,
+         *                and must outlive this object.
+         */
+        explicit BinaryLogWriter(std::ostream & os);
+
+        /*! \brief Write any buffered output */
+        ~BinaryLogWriter();
+
+        BinaryLogWriter(const BinaryLogWriter &) = delete;
+        BinaryLogWriter & operator=(const BinaryLogWriter &) = delete;
+
+
+        /*! \brief Add a message to the log
+         *
+         * The format string is not checked against the arguments. Any
+         * errors are reported when the log is read.
+         *
+         * \throw std::length_error if the format string or the arguments are
+         *        larger than 64 MiB (in binary form)
+         *
+         * \param [in] fmt The format string
+         * \param [in] args Arguments to the format string
+         */
+        template<typename... Targs>
+        void write(const char * fmt, const Targs &... args)
+        {
+            static_assert(detail::ValidPrintfArgs<Targs...>::value,
+                          "Invalid argument type passed to Format");
+            static_assert(detail::PackableArgs_<Targs...>::value,
+                          "User-defined types cannot be stored in binary form");
+
+            const size_t id = format_id_(fmt);
+            const size_t argsize = detail::packed_size_(args...);
+            if(argsize > detail::max_binary_record_)
+                throw std::length_error("Message is too large for a binary log");
+            const size_t size = 1 + detail::varint_size_(id) + detail::varint_size_(argsize) + argsize;
+
+            char * p = buf_.reserve(size);
+            *p++ = 'M';
+            p = detail::write_varint_(p, id);
+            p = detail::write_varint_(p, argsize);
+            detail::pack_args_(p, args...);
+            buf_.commit(size);
+
+            if(buf_.size() >= flush_size_)
+                flush();
+        }
+
+
+        /*! \brief Write buffered output to the stream */
+        void flush(void);
+
+
+        /*! \brief Number of distinct format strings written so far */
+        size_t nformats(void) const noexcept { return formats_.size(); }
+
+
+    private:
+        static const size_t flush_size_ = 65536;
+
+        std::ostream & os_;
+        MemoryBuffer buf_;
+
+        //! Format string address -> (id, copy of the format string)
+        std::unordered_map<const char *, std::pair<size_t, std::string>> ids_;
+
+        //! All format strings written so far (indexed by id)
+        std::vector<std::string> formats_;
+
+        //! Get the id of a format, adding it to the dictionary if needed
+        size_t format_id_(const char * fmt);
+};
+
+
+
+/*! \brief Reads and formats messages from a binary log */
+class BinaryLogReader
+{
+    public:
+        /*! \brief Start reading a binary log, checking the header
+         *
+         * \throw std::runtime_error if the stream does not contain a binary log, or
+         *        if it was written on an incompatible platform
+         *
+         * \param [in] is The stream to read from. It must be opened in binary mode,
+         *                and must outlive this object.
+         */
+        explicit BinaryLogReader(std::istream & is);
+
+
+        /*! \brief Format the next message
+         *
+         * Errors in formatting (such as an argument that does not match its
+         * specification) are reported in the output in place of the message.
+         *
+         * \throw std::runtime_error if the log is corrupt or truncated
+         *
+         * \param [in] out The buffer to append the formatted message to
+         * \return True if a message was read, false if the end of the log was reached
+         */
+        bool next(OutputBuffer & out);
+
+
+    private:
+        std::istream & is_;
+
+        //! Format strings (indexed by id), and compiled versions of those that have been used
+        std::vector<std::string> formats_;
+        std::vector<std::unique_ptr<CompiledFormat>> compiled_;
+
+        //! Arguments of the current message
+        std::vector<char> args_;
+
+        //! Read exactly \p n bytes
+        void read_(char * dest, size_t n);
+
+        //! Read a variable length integer
+        size_t read_varint_(void);
+
+        //! Read the size of a record, checking that it is sensible
+        size_t read_size_(void);
+};
+
+
+} // close namespace bpprint
@@ -0,0 +1,65 @@
+#include "bpprint/Format.hpp"
+
+
+namespace bpprint {
+
+
+CompiledFormat::CompiledFormat(const std::string & fmt)
+    : fmt_(fmt), nargs_(0), indexed_(false)
+{
+    detail::FormatInfo fi;
+    Segment seg;
+    size_t next = 0;      // Next argument taken in order
+    bool positional = false;
+
+    const char * str = fmt_.data();
+    const size_t len = fmt_.size();
+
+    size_t pos = 0;
+    for(;;)
+    {
+        seg.has_spec = detail::get_next_format_(fi, str, len, pos);
+        seg.literal.append(str+pos, fi.prefix_end-pos);
+        pos = fi.next;
+
+        if(seg.has_spec)
+        {
+            if(fi.errc != FormatErrc::Ok)
+            {
+                FormatResult res;
+                detail::set_error_(res, fi.errc, positional ? FormatResult::npos : next, fi.prefix_end);
+                detail::throw_format_error_(res);
+            }
+
+            // The first specification decides whether positions are used
+            if(segments_.empty())
+                positional = fi.spec.argpos != 0;
+
+            if(!detail::spec_args_(fi.spec, positional, next, seg.args))
+            {
+                FormatResult res;
+                detail::set_error_(res, FormatErrc::BadSpec, FormatResult::npos, fi.prefix_end);
+                detail::throw_format_error_(res);
+            }
+
+            seg.spec = fi.spec;
+            seg.offset = fi.prefix_end;
+            segments_.push_back(seg);
+            seg.literal.clear();
+
+            indexed_ = indexed_ || detail::is_indexed_(fi.spec);
+            if(seg.args.end() > nargs_)
+                nargs_ = seg.args.end();
+        }
+        else if(pos >= len)
+            break; // What remains is only literal text
+    }
+
+    seg.offset = len;
+    seg.args.value = nargs_;
+    seg.args.width = seg.args.precision = FormatResult::npos;
+    segments_.push_back(seg);
+}
+
+
+} // close namespace bpprint
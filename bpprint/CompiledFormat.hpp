@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bpprint/Printf_wrap.hpp"
+
+namespace bpprint {
+
+
+/*! \brief A format string that has been parsed ahead of time
+ *
+ * The format string is decomposed once (on construction) into
+ * a flat list of literal text and decoded format specifications.
+ * Formatting with a CompiledFormat (via format_stream or format_string)
+ * then skips parsing entirely, while still checking the arguments
+ * against the specifications at run time.
+ *
+ * This is useful for format strings that are used many times.
+ */
+class CompiledFormat
+{
+    public:
+        /*! \brief A piece of a compiled format string
+         *
+         * A literal piece of text, followed by (optionally)
+         * a format specification.
+         */
+        struct Segment
+        {
+            //! Literal text to output (with %% already replaced with %)
+            std::string literal;
+
+            //! True if this segment ends with a format specification
+            bool has_spec;
+
+            //! The decoded specification (valid only if has_spec is true)
+            detail::FormatSpec spec;
+
+            //! Offset of the specification (the '%') in the format string
+            size_t offset;
+
+            //! The arguments used by the specification
+            detail::SpecArgs_ args;
+        };
+
+
+        /*! \brief Parse a format string
+         *
+         * \throw format_error if the format string is badly formed
+         *
+         * \param [in] fmt The format string
+         */
+        explicit CompiledFormat(const std::string & fmt);
+
+
+        /*! \brief Get the original format string */
+        const std::string & str(void) const noexcept { return fmt_; }
+
+
+        /*! \brief Get the number of arguments expected by the format string */
+        size_t nargs(void) const noexcept { return nargs_; }
+
+
+        /*! \brief Get the pieces of the format string
+         *
+         * There are segments containing a specification, followed by
+         * a final segment containing only literal text. Unless indexed()
+         * is true, there are nargs() segments with a specification, each
+         * using the next argument in turn.
+         */
+        const std::vector<Segment> & segments(void) const noexcept { return segments_; }
+
+
+        /*! \brief Does the format string use arguments out of order?
+         *
+         * This is true if the format string uses positional arguments
+         * (such as "%2$s") or takes a width or precision from an argument ('*').
+         * With positional arguments, nargs() is the highest position used.
+         */
+        bool indexed(void) const noexcept { return indexed_; }
+
+
+    private:
+        std::string fmt_;
+        std::vector<Segment> segments_;
+        size_t nargs_;
+        bool indexed_;
+};
+
+
+} // close namespace bpprint
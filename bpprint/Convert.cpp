@@ -0,0 +1,484 @@
+#include <cfenv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "bpprint/Convert.hpp"
+
+
+namespace bpprint {
+namespace detail {
+
+
+namespace {
+
+// Pairs of decimal digits, "00" through "99"
+const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+// Powers of 10 that fit in 64 bits
+const unsigned long long pow10[20] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull
+};
+
+
+/*! \brief Write \p n in decimal, ending just before \p end
+ *
+ * Digits are written two at a time, from the end.
+ *
+ * \return Pointer to the first digit written
+ */
+char * write_decimal_(char * end, unsigned long long n)
+{
+    while(n >= 100)
+    {
+        const unsigned int r = static_cast<unsigned int>(n % 100) * 2;
+        n /= 100;
+        *--end = digit_pairs[r+1];
+        *--end = digit_pairs[r];
+    }
+
+    if(n >= 10)
+    {
+        const unsigned int r = static_cast<unsigned int>(n) * 2;
+        *--end = digit_pairs[r+1];
+        *--end = digit_pairs[r];
+    }
+    else
+        *--end = static_cast<char>('0' + n);
+
+    return end;
+}
+
+
+/*! \brief Write \p n in a power-of-two base, ending just before \p end
+ *
+ * \return Pointer to the first digit written
+ */
+char * write_pow2_(char * end, unsigned long long n,
+                   unsigned int shift, const char * digits)
+{
+    const unsigned long long mask = (1ull << shift) - 1;
+    do {
+        *--end = digits[n & mask];
+        n >>= shift;
+    } while(n != 0);
+
+    return end;
+}
+
+
+/*! \brief Output a converted value, with padding
+ *
+ * The output consists of a prefix (sign, 0x), some number of zeros,
+ * and the body (the digits). Padding to the field width is done
+ * with spaces, or with zeros between the prefix and body if
+ * \p zero_pad is true.
+ */
+void write_padded_(OutputBuffer & out, const ConvSpec & cs, bool zero_pad,
+                   const char * prefix, size_t nprefix, size_t nzeros,
+                   const char * body, size_t nbody)
+{
+    const size_t total = nprefix + nzeros + nbody;
+    const size_t width = cs.width > 0 ? static_cast<size_t>(cs.width) : 0;
+    const size_t pad = width > total ? width - total : 0;
+
+    if(cs.flags & FLAG_MINUS)
+    {
+        out.append(prefix, nprefix);
+        out.append(nzeros, '0');
+        out.append(body, nbody);
+        out.append(pad, ' ');
+    }
+    else if(zero_pad)
+    {
+        out.append(prefix, nprefix);
+        out.append(nzeros + pad, '0');
+        out.append(body, nbody);
+    }
+    else
+    {
+        out.append(pad, ' ');
+        out.append(prefix, nprefix);
+        out.append(nzeros, '0');
+        out.append(body, nbody);
+    }
+}
+
+
+/*! \brief Get the sign character for a signed conversion
+ *
+ * \return The sign character, or '\0' if there is none
+ */
+char sign_char_(const ConvSpec & cs, bool negative)
+{
+    if(negative)
+        return '-';
+    if(cs.flags & FLAG_PLUS)
+        return '+';
+    if(cs.flags & FLAG_SPACE)
+        return ' ';
+    return '\0';
+}
+
+
+//! A minimal unsigned 128-bit integer
+struct UInt128
+{
+    std::uint64_t hi;
+    std::uint64_t lo;
+};
+
+
+//! Full 64x64 -> 128 bit multiplication
+UInt128 mul64_(std::uint64_t a, std::uint64_t b)
+{
+    const std::uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+    const std::uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+
+    const std::uint64_t ll = a_lo * b_lo;
+    const std::uint64_t lh = a_lo * b_hi;
+    const std::uint64_t hl = a_hi * b_lo;
+    const std::uint64_t hh = a_hi * b_hi;
+
+    const std::uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+
+    UInt128 r;
+    r.lo = (mid << 32) | (ll & 0xFFFFFFFFu);
+    r.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return r;
+}
+
+
+/*! \brief Compute round(x / 2^s), rounding halfway cases to even
+ *
+ * \return False if the result does not fit in 64 bits
+ */
+bool shift_round_(UInt128 x, unsigned int s, std::uint64_t & result)
+{
+    if(s == 0)
+    {
+        result = x.lo;
+        return x.hi == 0;
+    }
+
+    // Nothing that we multiply comes close to 2^127, so the
+    // result rounds to zero
+    if(s >= 128)
+    {
+        result = 0;
+        return true;
+    }
+
+    // q = x >> s, r = x mod 2^s, half = 2^(s-1)
+    UInt128 q, r, half;
+    if(s >= 64)
+    {
+        q.hi = 0;
+        q.lo = (s == 64) ? x.hi : x.hi >> (s - 64);
+        r.hi = (s == 64) ? 0 : x.hi & ((1ull << (s - 64)) - 1);
+        r.lo = x.lo;
+        half.hi = (s == 64) ? 0 : 1ull << (s - 65);
+        half.lo = (s == 64) ? (1ull << 63) : 0;
+    }
+    else
+    {
+        q.hi = x.hi >> s;
+        q.lo = (x.lo >> s) | (x.hi << (64 - s));
+        r.hi = 0;
+        r.lo = x.lo & ((1ull << s) - 1);
+        half.hi = 0;
+        half.lo = 1ull << (s - 1);
+    }
+
+    const bool above = r.hi > half.hi || (r.hi == half.hi && r.lo > half.lo);
+    const bool equal = r.hi == half.hi && r.lo == half.lo;
+
+    if(above || (equal && (q.lo & 1)))
+    {
+        q.lo++;
+        if(q.lo == 0)
+            q.hi++;
+    }
+
+    result = q.lo;
+    return q.hi == 0;
+}
+
+
+//! Number of bits needed for \p n (at least one)
+unsigned int count_bits_(unsigned long long n) noexcept
+{
+#if defined(__GNUC__)
+    return 64 - static_cast<unsigned int>(__builtin_clzll(n | 1));
+#else
+    unsigned int count = 1;
+    while(n > 1)
+    {
+        n >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+} // close anonymous namespace
+
+
+
+unsigned int count_digits_(unsigned long long n) noexcept
+{
+#if defined(__GNUC__)
+    // Approximate log10 from log2 (1233/4096 ~ log10(2)), then correct
+    // with a single comparison. Using n|1 makes zero have one digit
+    const unsigned int bits = 64 - static_cast<unsigned int>(__builtin_clzll(n | 1));
+    const unsigned int t = (bits * 1233) >> 12;
+    return t + ((n | 1) >= pow10[t] ? 1 : 0);
+#else
+    unsigned int count = 1;
+    while(n >= 10)
+    {
+        n /= 10;
+        count++;
+    }
+    return count;
+#endif
+}
+
+
+void convert_integer_(OutputBuffer & out, const ConvSpec & cs, char spec,
+                      unsigned long long absval, bool negative)
+{
+    // Enough for 64-bit octal
+    char buf[24];
+    char * const end = buf + sizeof(buf);
+    char * begin = end;
+
+    // A precision of zero with a value of zero has no digits
+    if(out.count_only())
+    {
+        // Only the number of digits is needed
+        if(absval != 0 || cs.precision != 0)
+        {
+            const unsigned int bits = count_bits_(absval);
+            switch(spec)
+            {
+                case 'o': begin -= (bits + 2) / 3; break;
+                case 'x':
+                case 'X': begin -= (bits + 3) / 4; break;
+                default:  begin -= count_digits_(absval);
+            }
+        }
+    }
+    else if(absval != 0 || cs.precision != 0)
+    {
+        switch(spec)
+        {
+            case 'o':
+                begin = write_pow2_(end, absval, 3, "01234567");
+                break;
+            case 'x':
+                begin = write_pow2_(end, absval, 4, "0123456789abcdef");
+                break;
+            case 'X':
+                begin = write_pow2_(end, absval, 4, "0123456789ABCDEF");
+                break;
+            default:
+                begin = write_decimal_(end, absval);
+        }
+    }
+
+    const size_t ndigits = static_cast<size_t>(end - begin);
+    const size_t prec = cs.precision > 0 ? static_cast<size_t>(cs.precision) : 0;
+    size_t nzeros = prec > ndigits ? prec - ndigits : 0;
+
+    char prefix[2];
+    size_t nprefix = 0;
+
+    if(spec == 'd' || spec == 'i')
+    {
+        const char sign = sign_char_(cs, negative);
+        if(sign != '\0')
+            prefix[nprefix++] = sign;
+    }
+    else if(cs.flags & FLAG_HASH)
+    {
+        // Alternate form. For octal, the first digit must be zero.
+        // For hex, non-zero values are prefixed with 0x
+        if(spec == 'o' && nzeros == 0 && (ndigits == 0 || absval != 0))
+            nzeros = 1;
+        else if((spec == 'x' || spec == 'X') && absval != 0)
+        {
+            prefix[nprefix++] = '0';
+            prefix[nprefix++] = spec;
+        }
+    }
+
+    // The zero flag is ignored if a precision is given
+    const bool zero_pad = (cs.flags & FLAG_ZERO) && cs.precision < 0;
+    write_padded_(out, cs, zero_pad, prefix, nprefix, nzeros, begin, ndigits);
+}
+
+
+bool convert_fixed_(OutputBuffer & out, const ConvSpec & cs, double value)
+{
+    const int prec = cs.precision < 0 ? 6 : cs.precision;
+
+    // Handled by snprintf
+    if(!std::isfinite(value) || prec > 19)
+        return false;
+
+    // printf honors the current rounding mode. We only do round-to-nearest
+    if(std::fegetround() != FE_TONEAREST)
+        return false;
+
+    const bool negative = std::signbit(value);
+    const double a = std::fabs(value);
+
+    // Decompose exactly into a = m * 2^e, with m < 2^53
+    int exp = 0;
+    const double frac = std::frexp(a, &exp);
+    const std::uint64_t m = static_cast<std::uint64_t>(std::ldexp(frac, 53));
+    const int e = exp - 53;
+
+    std::uint64_t intpart, fracpart;
+
+    if(m == 0)
+    {
+        intpart = 0;
+        fracpart = 0;
+    }
+    else if(e >= 0)
+    {
+        // An integer. Must fit in 64 bits
+        if(e > 10)
+            return false;
+
+        intpart = m << e;
+        fracpart = 0;
+    }
+    else
+    {
+        // n = round(a * 10^prec) = round(m * 5^prec * 2^prec / 2^k)
+        const unsigned int k = static_cast<unsigned int>(-e);
+        const unsigned int p = static_cast<unsigned int>(prec);
+
+        // 5^p = 10^p / 2^p. 5^19 < 2^45, so this is less than 2^98
+        UInt128 x = mul64_(m, pow10[p] >> p);
+
+        std::uint64_t n;
+        if(p >= k)
+        {
+            const unsigned int s = p - k;
+            if(s > 0)
+            {
+                if(x.hi != 0 || (x.lo >> (64 - s)) != 0)
+                    return false;
+                x.lo <<= s;
+            }
+
+            if(x.hi != 0)
+                return false;
+            n = x.lo;
+        }
+        else if(!shift_round_(x, k - p, n))
+            return false;
+
+        intpart = n / pow10[p];
+        fracpart = n % pow10[p];
+    }
+
+    // Integer part, then fractional part. At most 20 + 1 + 19 characters
+    char buf[48];
+    char * const end = buf + sizeof(buf);
+    char * begin = end;
+
+    if(prec > 0)
+    {
+        char * fracbegin = write_decimal_(end, fracpart);
+        const size_t nfrac = static_cast<size_t>(end - fracbegin);
+        begin = fracbegin - (static_cast<size_t>(prec) - nfrac);
+        memset(begin, '0', static_cast<size_t>(prec) - nfrac);
+    }
+
+    if(prec > 0 || (cs.flags & FLAG_HASH))
+        *--begin = '.';
+
+    begin = write_decimal_(begin, intpart);
+
+    char prefix[1];
+    size_t nprefix = 0;
+    const char sign = sign_char_(cs, negative);
+    if(sign != '\0')
+        prefix[nprefix++] = sign;
+
+    const bool zero_pad = (cs.flags & FLAG_ZERO) != 0;
+    write_padded_(out, cs, zero_pad, prefix, nprefix, 0,
+                  begin, static_cast<size_t>(end - begin));
+    return true;
+}
+
+
+void convert_string_(OutputBuffer & out, const ConvSpec & cs, const char * s)
+{
+    size_t len;
+    if(cs.precision < 0)
+        len = strlen(s);
+    else
+    {
+        // Don't read past the precision
+        const size_t prec = static_cast<size_t>(cs.precision);
+        const void * nul = memchr(s, '\0', prec);
+        len = nul ? static_cast<size_t>(static_cast<const char *>(nul) - s) : prec;
+    }
+
+    write_padded_(out, cs, false, "", 0, 0, s, len);
+}
+
+
+void convert_string_(OutputBuffer & out, const ConvSpec & cs, const char * s, size_t n)
+{
+    if(cs.precision >= 0 && static_cast<size_t>(cs.precision) < n)
+        n = static_cast<size_t>(cs.precision);
+
+    write_padded_(out, cs, false, "", 0, 0, s, n);
+}
+
+
+void convert_char_(OutputBuffer & out, const ConvSpec & cs, char c)
+{
+    write_padded_(out, cs, false, "", 0, 0, &c, 1);
+}
+
+
+} // close namespace detail
+} // close namespace bpprint
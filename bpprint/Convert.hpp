@@ -0,0 +1,191 @@
+#pragma once
+
+#include <type_traits>
+
+#include "bpprint/Printf_wrap.hpp"
+
+/*! \file
+ *
+ * Native conversions of integers, floating point values, and strings
+ *
+ * These produce the same output as snprintf for the same specification,
+ * but without having printf parse a format string. Conversions that are
+ * not handled natively (such as %e or %a) are left for snprintf.
+ */
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief Number of decimal digits in \p n
+ *
+ * Zero is counted as having one digit.
+ */
+unsigned int count_digits_(unsigned long long n) noexcept;
+
+
+/*! \brief Convert an integer (%d, %i, %u, %o, %x, %X)
+ *
+ * \param [in] out The converted integer is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] spec The type specifier
+ * \param [in] absval The absolute value of the integer
+ * \param [in] negative True if the integer is negative
+ */
+void convert_integer_(OutputBuffer & out, const ConvSpec & cs, char spec,
+                      unsigned long long absval, bool negative);
+
+
+/*! \brief Convert a floating point value in fixed notation (%f, %F)
+ *
+ * The conversion is exact (and correctly rounded), but is only done for
+ * values and precisions where this can be done using 128-bit integer
+ * arithmetic (roughly, where value*10^precision < 2^64). Other values,
+ * as well as infinity and NaN, are not converted.
+ *
+ * \param [in] out The converted value is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] value The value to convert
+ * \return True if the value was converted, false if snprintf should
+ *         be used instead
+ */
+bool convert_fixed_(OutputBuffer & out, const ConvSpec & cs, double value);
+
+
+/*! \brief Convert a string (%s)
+ *
+ * \param [in] out The converted string is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] s The (non-null) string to convert
+ */
+void convert_string_(OutputBuffer & out, const ConvSpec & cs, const char * s);
+
+
+/*! \brief Convert a string of known length (%s)
+ *
+ * The string does not need to be null terminated, and all \p n characters
+ * are used (subject to the precision).
+ *
+ * \param [in] out The converted string is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] s The string to convert
+ * \param [in] n The length of the string
+ */
+void convert_string_(OutputBuffer & out, const ConvSpec & cs, const char * s, size_t n);
+
+
+/*! \brief Convert a character (%c)
+ *
+ * \param [in] out The converted character is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] c The character to convert
+ */
+void convert_char_(OutputBuffer & out, const ConvSpec & cs, char c);
+
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for signed integers
+ *
+ * \tparam T The type to convert (the cast_type from PFTypeMap)
+ *
+ * \param [in] out The converted value is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] spec The (resolved) type specifier
+ * \param [in] subst The value to convert
+ * \return True if the value was converted, false if snprintf should
+ *         be used instead
+ */
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
+convert_native_(OutputBuffer & out, const ConvSpec & cs, char spec, T subst)
+{
+    if(spec == 'c')
+        convert_char_(out, cs, static_cast<char>(subst));
+    else
+    {
+        const bool negative = subst < 0;
+        const unsigned long long u = static_cast<unsigned long long>(subst);
+        convert_integer_(out, cs, spec, negative ? 0ull - u : u, negative);
+    }
+    return true;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for unsigned integers
+ */
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, bool>::type
+convert_native_(OutputBuffer & out, const ConvSpec & cs, char spec, T subst)
+{
+    if(spec == 'c')
+        convert_char_(out, cs, static_cast<char>(subst));
+    else
+        convert_integer_(out, cs, spec, subst, false);
+    return true;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for double. Only fixed notation is converted natively.
+ */
+inline bool convert_native_(OutputBuffer & out, const ConvSpec & cs, char spec, double subst)
+{
+    if(spec == 'f' || spec == 'F')
+        return convert_fixed_(out, cs, subst);
+    return false;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for long double. This is always left to snprintf.
+ */
+inline bool convert_native_(OutputBuffer &, const ConvSpec &, char, long double)
+{
+    return false;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for strings. Null pointers are left to snprintf.
+ */
+inline bool convert_native_(OutputBuffer & out, const ConvSpec & cs, char spec, const char * subst)
+{
+    if(spec != 's' || subst == nullptr)
+        return false;
+
+    convert_string_(out, cs, subst);
+    return true;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for StringRef, which can only be used with %s
+ * and is always converted natively.
+ */
+inline bool convert_native_(OutputBuffer & out, const ConvSpec & cs, char, StringRef subst)
+{
+    convert_string_(out, cs, subst.data(), subst.size());
+    return true;
+}
+
+
+/*! \brief Convert a value natively, if possible
+ *
+ * Overload for pointers. This is always left to snprintf.
+ */
+inline bool convert_native_(OutputBuffer &, const ConvSpec &, char, const void *)
+{
+    return false;
+}
+
+
+} // close namespace detail
+} // close namespace bpprint
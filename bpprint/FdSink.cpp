@@ -0,0 +1,126 @@
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <sys/uio.h>
+
+#include "bpprint/FdSink.hpp"
+
+
+namespace bpprint {
+
+
+namespace {
+
+#ifdef IOV_MAX
+const size_t max_iov_ = IOV_MAX;
+#else
+const size_t max_iov_ = 1024;
+#endif
+
+
+// Write all the data described by an array of iovec, retrying after
+// partial writes. The iovec are modified.
+void write_all_(int fd, struct iovec * iov, size_t niov)
+{
+    while(niov > 0)
+    {
+        const int cnt = static_cast<int>(niov < max_iov_ ? niov : max_iov_);
+        ssize_t n = ::writev(fd, iov, cnt);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            std::string errstr = "Error writing to file descriptor: ";
+            errstr += strerror(errno);
+            throw std::runtime_error(errstr);
+        }
+
+        // Skip what was written
+        size_t written = static_cast<size_t>(n);
+        while(niov > 0 && written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+
+        if(niov > 0)
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+} // close anonymous namespace
+
+
+
+FdSink::~FdSink()
+{
+    try {
+        flush();
+    }
+    catch(...)
+    {
+        // nowhere to report it
+    }
+}
+
+
+const CompiledFormat & FdSink::batch_format_(const char * fmt)
+{
+    std::unique_ptr<CompiledFormat> & cf = formats_[fmt];
+
+    // The same address may hold a different format string later
+    if(cf && strcmp(cf->str().c_str(), fmt) != 0)
+        retired_.push_back(std::move(cf));
+
+    if(!cf)
+        cf.reset(new CompiledFormat(fmt));
+
+    return *cf;
+}
+
+
+void FdSink::flush(void)
+{
+    const size_t npieces = buf_.npieces();
+    const detail::FdBuffer_::Piece * pieces = buf_.pieces();
+
+    if(npieces == 0)
+        return;
+
+    // Formatted characters are located now, since the
+    // buffer may have moved while the output was collected
+    struct iovec iov[max_pieces_ + 64];
+    std::vector<struct iovec> heap_iov;
+    struct iovec * piov = iov;
+
+    if(npieces > sizeof(iov)/sizeof(iov[0]))
+    {
+        heap_iov.resize(npieces);
+        piov = heap_iov.data();
+    }
+
+    for(size_t i = 0; i < npieces; i++)
+    {
+        const char * base = pieces[i].literal ? pieces[i].literal : buf_.data() + pieces[i].offset;
+        piov[i].iov_base = const_cast<char *>(base);
+        piov[i].iov_len = pieces[i].len;
+    }
+
+    buf_.reset();
+    write_all_(fd_, piov, npieces);
+
+    // Nothing refers to the compiled formats now. Limit how many are kept,
+    // in case formats are stored at many different addresses.
+    retired_.clear();
+    if(formats_.size() > max_formats_)
+        formats_.clear();
+}
+
+
+} // close namespace bpprint
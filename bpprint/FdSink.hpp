@@ -0,0 +1,350 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bpprint/Format.hpp"
+
+/*! \file
+ *
+ * Output directly to file descriptors
+ *
+ * An FdSink writes formatted output to a file descriptor with writev().
+ * Literal text of the format string is not copied. Instead, it is written
+ * from where it is stored in the format string, while the formatted
+ * arguments are collected in a small buffer in between.
+ */
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief An output buffer that keeps literal text by reference
+ *
+ * The output is kept as a list of pieces, each of which is either
+ * literal text (stored elsewhere) or a range of formatted characters
+ * stored in the buffer itself.
+ *
+ * Only the literal text of the outermost formatting call is kept by
+ * reference. Calls nested inside the formatter of an argument may use
+ * format strings that do not outlive the call (such as a local
+ * std::string, or an entry of the format cache), so their literal text
+ * is copied.
+ */
+class FdBuffer_ : public BasicMemoryBuffer<512>
+{
+    public:
+        //! A piece of the output
+        struct Piece
+        {
+            //! Literal text, or nullptr for characters stored in the buffer
+            const char * literal;
+
+            //! Start of the characters in the buffer (if literal is nullptr)
+            size_t offset;
+
+            //! Number of characters
+            size_t len;
+        };
+
+
+        /*! \brief Where a message starts, so that it can be discarded */
+        struct Mark
+        {
+            size_t npieces;
+            size_t size;
+            size_t total;
+        };
+
+
+        FdBuffer_(void) noexcept
+            : pieces_(inline_pieces_), npieces_(0), piece_cap_(ninline_),
+              stored_(0), total_(0), depth_(0)
+        {
+            literal_refs_ = true;
+        }
+
+
+        //! Number of characters in all pieces
+        size_t total(void) const noexcept { return total_ + (size_ - stored_); }
+
+
+        //! Number of pieces (including those not finished yet)
+        size_t npieces(void) const noexcept { return npieces_ + (size_ > stored_ ? 1 : 0); }
+
+
+        //! The current end of the output
+        Mark mark(void)
+        {
+            finish_();
+            return Mark{ npieces_, size_, total_ };
+        }
+
+
+        //! Discard everything after a mark
+        void rollback(const Mark & m) noexcept
+        {
+            npieces_ = m.npieces;
+            size_ = m.size;
+            stored_ = m.size;
+            total_ = m.total;
+        }
+
+
+        //! Get the pieces of the output, finishing the last one
+        const Piece * pieces(void)
+        {
+            finish_();
+            return pieces_;
+        }
+
+
+        //! Remove all output
+        void reset(void) noexcept
+        {
+            npieces_ = 0;
+            clear();
+            stored_ = 0;
+            total_ = 0;
+        }
+
+
+    protected:
+        void literal_ref_(const char * s, size_t n) override
+        {
+            if(n == 0)
+                return;
+
+            if(depth_ > 1)
+            {
+                append(s, n);
+                return;
+            }
+
+            finish_();
+            push_(Piece{ s, 0, n });
+            total_ += n;
+        }
+
+        void begin_call_(void) override { depth_++; }
+        void end_call_(void) override { depth_--; }
+
+
+    private:
+        static const size_t ninline_ = 32;
+
+        //! The pieces (either inline_pieces_ or heap_pieces_)
+        Piece * pieces_;
+        size_t npieces_;
+        size_t piece_cap_;
+        Piece inline_pieces_[ninline_];
+        std::unique_ptr<Piece[]> heap_pieces_;
+
+        //! Characters of the buffer before this are in pieces_
+        size_t stored_;
+
+        //! Number of characters in pieces_
+        size_t total_;
+
+        //! Number of formatting calls in progress
+        unsigned int depth_;
+
+        //! Add characters written to the buffer since the last piece
+        void finish_(void)
+        {
+            if(size_ > stored_)
+            {
+                push_(Piece{ nullptr, stored_, size_ - stored_ });
+                total_ += size_ - stored_;
+                stored_ = size_;
+            }
+        }
+
+        //! Add a piece, growing the storage if needed
+        void push_(const Piece & p)
+        {
+            if(npieces_ == piece_cap_)
+            {
+                std::unique_ptr<Piece[]> newpieces(new Piece[2*piece_cap_]);
+                std::copy(pieces_, pieces_ + npieces_, newpieces.get());
+                heap_pieces_ = std::move(newpieces);
+                pieces_ = heap_pieces_.get();
+                piece_cap_ *= 2;
+            }
+
+            pieces_[npieces_++] = p;
+        }
+};
+
+} // close namespace detail
+
+
+
+/*! \brief Writes formatted output to a file descriptor
+ *
+ * Each message is written with a single writev() call, made up of the
+ * literal text of the format string (which is not copied) and the
+ * formatted arguments.
+ *
+ * Optionally, messages can be batched, so that several are written with
+ * a single writev(). In that case, std::string and CompiledFormat format
+ * strings must remain valid until the messages are written (by flush(), or
+ * when the batch is full). C string formats are compiled and kept by the
+ * sink.
+ *
+ * The file descriptor is not closed.
+ */
+class FdSink
+{
+    public:
+        /*! \brief Write to a file descriptor
+         *
+         * \param [in] fd The file descriptor to write to
+         * \param [in] batch_size Output is written once at least this many characters
+         *                        are waiting. If zero, each message is written immediately.
+         */
+        explicit FdSink(int fd, size_t batch_size = 0) noexcept
+            : fd_(fd), batch_size_(batch_size)
+        { }
+
+
+        /*! \brief Write any remaining output
+         *
+         * Errors are ignored.
+         */
+        ~FdSink();
+
+        FdSink(const FdSink &) = delete;
+        FdSink & operator=(const FdSink &) = delete;
+
+
+        /*! \brief Format a message and write it (or add it to the batch)
+         *
+         * \throw std::runtime_error if the correct number of arguments is not given,
+         *        if the format string is badly formed, or if writing fails. If
+         *        formatting fails, nothing from this message is written.
+         *
+         * \param [in] fmt The format string (std::string, CompiledFormat, or BPPRINT_FMT)
+         * \param [in] args Arguments to the format string
+         */
+        template<typename Fmt, typename... Targs>
+        void format(const Fmt & fmt, const Targs &... args)
+        {
+            const detail::FdBuffer_::Mark m = buf_.mark();
+            try {
+                format_to(buf_, fmt, args...);
+            }
+            catch(...)
+            {
+                buf_.rollback(m);
+                throw;
+            }
+
+            end_message_();
+        }
+
+
+        /*! \brief Format a message and write it (or add it to the batch)
+         *
+         * Overload for C strings (such as string literals). When batching,
+         * the format string is compiled and kept by the sink, so it does not
+         * need to remain valid.
+         */
+        template<typename... Targs>
+        void format(const char * fmt, const Targs &... args)
+        {
+            const detail::FdBuffer_::Mark m = buf_.mark();
+            try {
+                // The compiled formats in the format cache may be evicted
+                // before a batch is written, so batches use their own
+                if(batch_size_ == 0)
+                    format_to(buf_, fmt, args...);
+                else
+                    format_to(buf_, batch_format_(fmt), args...);
+            }
+            catch(...)
+            {
+                buf_.rollback(m);
+                throw;
+            }
+
+            end_message_();
+        }
+
+
+        /*! \brief Write all output that is waiting
+         *
+         * \throw std::runtime_error if writing fails
+         */
+        void flush(void);
+
+
+        /*! \brief Number of characters waiting to be written */
+        size_t pending(void) const noexcept { return buf_.total(); }
+
+
+    private:
+        int fd_;
+        size_t batch_size_;
+        detail::FdBuffer_ buf_;
+
+        //! Write the output if the batch is full
+        void end_message_(void)
+        {
+            if(buf_.total() >= batch_size_ || buf_.npieces() >= max_pieces_)
+                flush();
+        }
+
+        //! Write output once there are this many pieces
+        static const size_t max_pieces_ = 512;
+
+        //! Maximum number of compiled formats kept between batches
+        static const size_t max_formats_ = 256;
+
+        //! Compiled formats of C strings used in batches, by address
+        std::unordered_map<const char *, std::unique_ptr<CompiledFormat>> formats_;
+
+        //! Formats replaced in formats_ but still used by the current batch
+        std::vector<std::unique_ptr<CompiledFormat>> retired_;
+
+        //! Get the compiled version of a C string format for a batch
+        const CompiledFormat & batch_format_(const char * fmt);
+};
+
+
+
+/*! \brief Format and write to a file descriptor
+ *
+ * The output is written with a single writev() call, without
+ * copying the literal text of the format string.
+ *
+ * \throw std::runtime_error if the correct number of arguments is not given,
+ *        if the format string is badly formed, or if writing fails
+ *
+ * \param [in] fd The file descriptor to write to
+ * \param [in] fmt The format string (C string, std::string, CompiledFormat, or BPPRINT_FMT)
+ * \param [in] args Arguments to the format string
+ */
+template<typename Fmt, typename... Targs>
+void format_fd(int fd, const Fmt & fmt, const Targs &... args)
+{
+    FdSink sink(fd);
+    sink.format(fmt, args...);
+}
+
+
+/*! \brief Format and write to a file descriptor
+ *
+ * Overload for C strings (such as string literals)
+ */
+template<typename... Targs>
+void format_fd(int fd, const char * fmt, const Targs &... args)
+{
+    FdSink sink(fd);
+    sink.format(fmt, args...);
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "bpprint/Format.hpp"
+
+/*! \file
+ *
+ * Formatting into fixed-capacity strings
+ *
+ * bpprint::format_fixed<N>() formats into a FixedString<N>, which
+ * stores up to N characters inline. Nothing is allocated, even if the
+ * output is truncated (other than by the format cache, the first time a
+ * C string format is used), and the result can be copied like a plain
+ * struct, for example into a fixed-size protocol field.
+ *
+ * What happens if the output is longer than N characters is chosen
+ * with FixedOverflow.
+ */
+
+namespace bpprint {
+
+
+/*! \brief What format_fixed() does if the output does not fit */
+enum class FixedOverflow
+{
+    Truncate, //!< Keep the first N characters (FixedString::truncated() is set)
+    Throw,    //!< Throw a format_error (FormatErrc::Truncated)
+    Report    //!< Never throw. Truncate, and report all errors through FixedString::result()
+};
+
+
+namespace detail { struct FixedFormat_; }
+
+
+/*! \brief A string with inline storage for up to N characters
+ *
+ * The string is always null terminated. It is trivially copyable, so
+ * it can be copied with memcpy or stored in shared memory.
+ *
+ * \tparam N The maximum number of characters
+ */
+template<size_t N>
+class FixedString
+{
+    public:
+        static_assert(N > 0, "FixedString must have room for at least one character");
+
+
+        //! An empty string
+        FixedString(void) noexcept
+            : size_(0), length_(0), result_()
+        {
+            data_[0] = '\0';
+        }
+
+
+        //! The characters (null terminated)
+        const char * data(void) const noexcept { return data_; }
+
+        //! The characters (null terminated)
+        const char * c_str(void) const noexcept { return data_; }
+
+        //! The number of characters stored
+        size_t size(void) const noexcept { return size_; }
+
+        //! Is the string empty?
+        bool empty(void) const noexcept { return size_ == 0; }
+
+        //! The maximum number of characters
+        static constexpr size_t capacity(void) noexcept { return N; }
+
+        const char * begin(void) const noexcept { return data_; }
+        const char * end(void) const noexcept { return data_ + size_; }
+
+
+        /*! \brief The length of the full output
+         *
+         * This is greater than size() if the output was truncated.
+         */
+        size_t length(void) const noexcept { return length_; }
+
+        //! Was the output truncated?
+        bool truncated(void) const noexcept { return length_ > size_; }
+
+
+        /*! \brief The outcome of formatting
+         *
+         * With FixedOverflow::Report, this holds any error (including
+         * FormatErrc::Truncated). Otherwise, errors are thrown, and this
+         * only reports truncation.
+         */
+        const FormatResult & result(void) const noexcept { return result_; }
+
+
+        //! Copy to a std::string
+        std::string str(void) const { return std::string(data_, size_); }
+
+        //! The characters, without copying them
+        StringRef ref(void) const noexcept { return StringRef(data_, size_); }
+
+
+        bool operator==(const FixedString & rhs) const noexcept
+        {
+            return size_ == rhs.size_ && memcmp(data_, rhs.data_, size_) == 0;
+        }
+
+        bool operator!=(const FixedString & rhs) const noexcept { return !(*this == rhs); }
+
+
+    private:
+        friend struct detail::FixedFormat_;
+
+        //! One more than N, for the null terminator (also used while formatting)
+        char data_[N+1];
+        size_t size_;
+        size_t length_;
+        FormatResult result_;
+};
+
+
+namespace detail {
+
+//! Formatting into a FixedString, with each overflow policy
+struct FixedFormat_
+{
+    //! Record the length of the output, after formatting into \p buf
+    template<size_t N>
+    static void finish(FixedString<N> & s, const FixedBuffer & buf) noexcept
+    {
+        s.length_ = buf.size();
+        s.size_ = s.length_ < N ? s.length_ : N;
+        s.data_[s.size_] = '\0';
+
+        if(s.result_.ok() && s.length_ > N)
+            set_error_(s.result_, FormatErrc::Truncated, FormatResult::npos, FormatResult::npos);
+    }
+
+
+    template<size_t N, typename Fmt, typename... Targs>
+    static FixedString<N> format(std::integral_constant<FixedOverflow, FixedOverflow::Truncate>,
+                                 const Fmt & fmt, Targs &&... args)
+    {
+        FixedString<N> s;
+        FixedBuffer buf(s.data_, N, true);
+        format_to(buf, fmt, std::forward<Targs>(args)...);
+        finish(s, buf);
+        return s;
+    }
+
+
+    template<size_t N, typename Fmt, typename... Targs>
+    static FixedString<N> format(std::integral_constant<FixedOverflow, FixedOverflow::Throw>,
+                                 const Fmt & fmt, Targs &&... args)
+    {
+        FixedString<N> s;
+        FixedBuffer buf(s.data_, N, true);
+        format_to(buf, fmt, std::forward<Targs>(args)...);
+        finish(s, buf);
+        if(s.truncated())
+            throw_format_error_(s.result_);
+        return s;
+    }
+
+
+    template<size_t N, typename Fmt, typename... Targs>
+    static FixedString<N> format(std::integral_constant<FixedOverflow, FixedOverflow::Report>,
+                                 const Fmt & fmt, Targs &&... args) noexcept
+    {
+        FixedString<N> s;
+        FixedBuffer buf(s.data_, N, true);
+        s.result_ = try_format_to(buf, fmt, std::forward<Targs>(args)...);
+        finish(s, buf);
+        return s;
+    }
+};
+
+} // close namespace detail
+
+
+
+/*! \brief Apply formatting, storing the output inline in a FixedString
+ *
+ * No memory is allocated for the output or the result, even if the
+ * output is truncated. The terminator slot of the FixedString is used
+ * while conversions are cut off at the end of the storage.
+ *
+ * \throw format_error if the correct number of arguments is not given, if
+ *        the format string is badly formed, or (with FixedOverflow::Throw)
+ *        if the output does not fit. Nothing is thrown with FixedOverflow::Report.
+ *
+ * \tparam N The maximum number of characters
+ * \tparam Policy What to do if the output is longer than \p N characters
+ *
+ * \param [in] fmt The format string (std::string, C string, CompiledFormat, or BPPRINT_FMT)
+ * \param [in] args Arguments to the format string
+ */
+template<size_t N, FixedOverflow Policy = FixedOverflow::Truncate, typename Fmt, typename... Targs>
+FixedString<N> format_fixed(const Fmt & fmt, Targs &&... args) noexcept(Policy == FixedOverflow::Report)
+{
+    return detail::FixedFormat_::format<N>(std::integral_constant<FixedOverflow, Policy>(),
+                                           fmt, std::forward<Targs>(args)...);
+}
+
+
+} // close namespace bpprint
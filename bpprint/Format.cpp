@@ -1,3 +1,5 @@
+#include <climits>
+#include <cstdio>
 #include <cstring>
 
 #include "bpprint/Format.hpp"
@@ -7,151 +9,469 @@ namespace bpprint {
 namespace detail {
 
 
-bool get_next_format_(FormatInfo & fi, const std::string & str)
+namespace {
+
+// Append a decimal digit to n. Returns false (leaving n unchanged) if the result would not fit in an int
+bool push_digit_(int & n, char c)
 {
-    ///////////////////////////////////////////////
-    // PrintF format
-    //%[flags][width][.precision][length]spec
-    //    flags: -+#0  or space
-    //    width: number
-    //precision: number
-    //   length: characters
-    //     spec: letter
-    ///////////////////////////////////////////////
+    const int d = c - '0';
+    if(n > (INT_MAX - d) / 10)
+        return false;
 
+    n = n*10 + d;
+    return true;
+}
 
-    // WARNING - str may be a reference to fi.suffix
-    // Also remember - prefix will contain what to print out
-    // if this function returns false
 
-    const size_t len = str.length();
+// Parse a number. Returns the index just past it (or begin, if there is no number).
+// If the number does not fit in an int, n is set to -1.
+size_t parse_number_(const char * str, size_t len, size_t begin, int & n)
+{
+    size_t i = begin;
+    bool fits = true;
+    n = 0;
+    while(i < len && isdigit(str[i]))
+    {
+        fits = fits && push_digit_(n, str[i]);
+        i++;
+    }
 
-    // doesn't actually release the memory (I don't think)
-    fi.prefix.clear();
-    fi.format.clear();
+    if(!fits)
+        n = -1;
+    return i;
+}
 
-    // If there is no string...
-    if(len == 0)
-        return false;
 
+// Parse an argument position ("n$") at begin, returning the index just past it.
+// If there is no position, pos is set to 0 and begin is returned.
+size_t parse_argpos_(const char * str, size_t len, size_t begin, int & pos)
+{
+    const size_t end = parse_number_(str, len, begin, pos);
+    if(end > begin && end < len && str[end] == '$')
+        return end+1;
 
-    // Find a % not followed by another %, copying
-    // into prefix as we go.
-    // We need to replace %% with %
-    size_t idx;
-    for(idx = 0; idx < len; ++idx)
-    {
-        if(str[idx] == '%')
-        {
-            // we know len > 0 (already checked), so subtracting 1 is safe
-            if(str[idx] == '%' && idx < (len-1) && str[idx+1] == '%')
-            {
-                fi.prefix += '%';
-                idx++; // skip the second %
-            }
-            else
-                break; // We found a format spec!
-        }
-        else
-            fi.prefix += str[idx]; // copy to the prefix member
-    }
+    pos = 0;
+    return begin;
+}
 
-    // Did we copy the whole string into the prefix? (ie, didn't find a spec)
-    // If so, we are done.
-    if(idx >= len)
-        return false;
 
+// Parse a width or precision given by an argument ('*' or "*m$") at begin.
+// Sets arg to -1 if there is none.
+size_t parse_star_(const char * str, size_t len, size_t begin, int & arg, bool & valid)
+{
+    arg = -1;
+    if(begin >= len || str[begin] != '*')
+        return begin;
 
-    // So we found a format spec. Decompose it
-    // into its various parts
-    size_t fmt_begin = idx;
-    size_t flag_begin = fmt_begin+1;
+    const size_t end = parse_argpos_(str, len, begin+1, arg);
+    valid = valid && (end == begin+1 || arg > 0);
+    return end;
+}
+
+} // close anonymous namespace
+
+
+FormatErrc parse_format_spec_(FormatSpec & fs, const char * str,
+                              size_t len, size_t begin, size_t & end)
+{
+    ///////////////////////////////////////////////
+    // PrintF format
+    //%[pos$][flags][width][.precision][length]spec
+    //      pos: number (argument position, from 1)
+    //    flags: -+#0  or space
+    //    width: number, or * (optionally *pos$)
+    //precision: number, or * (optionally *pos$)
+    //   length: characters
+    //     spec: letter
+    ///////////////////////////////////////////////
+
+    size_t fmt_begin = begin;
+    bool valid = true;
+
+    // argument position
+    int argpos;
+    size_t flag_begin = parse_argpos_(str, len, fmt_begin+1, argpos);
+    fs.argpos = static_cast<unsigned int>(argpos);
+    valid = valid && (flag_begin == fmt_begin+1 || argpos > 0);
 
     // first, the flag characters
     const char * validflags = "+- #0";
     size_t width_begin = flag_begin;
-    while(width_begin < len && strchr(validflags, str[width_begin]) != nullptr)
+    fs.flags = 0;
+    while(width_begin < len && str[width_begin] != '\0' && strchr(validflags, str[width_begin]) != nullptr)
+    {
+        switch(str[width_begin])
+        {
+            case '-': fs.flags |= FLAG_MINUS; break;
+            case '+': fs.flags |= FLAG_PLUS;  break;
+            case ' ': fs.flags |= FLAG_SPACE; break;
+            case '#': fs.flags |= FLAG_HASH;  break;
+            case '0': fs.flags |= FLAG_ZERO;  break;
+        }
         width_begin++;
+    }
 
     // now the width
-    size_t prec_begin = width_begin;
-    while(prec_begin < len && isdigit(str[prec_begin]))
+    size_t prec_begin = parse_star_(str, len, width_begin, fs.width_arg, valid);
+    fs.width = -1;
+    while(fs.width_arg < 0 && prec_begin < len && isdigit(str[prec_begin]))
+    {
+        if(fs.width < 0)
+            fs.width = 0;
+        valid = push_digit_(fs.width, str[prec_begin]) && valid;
         prec_begin++;
+    }
 
     // precision, including period
     size_t length_begin = prec_begin;
+    fs.precision = -1;
+    fs.prec_arg = -1;
     if(length_begin < len && str[length_begin] == '.')
     {
         length_begin++;
+        fs.precision = 0;
 
-        while(length_begin < len && isdigit(str[length_begin]))
+        length_begin = parse_star_(str, len, length_begin, fs.prec_arg, valid);
+        while(fs.prec_arg < 0 && length_begin < len && isdigit(str[length_begin]))
+        {
+            valid = push_digit_(fs.precision, str[length_begin]) && valid;
             length_begin++;
+        }
     }
 
     // length
     size_t spec_begin = length_begin;
     const char * validlengthchars = "hljztL";
-    while(spec_begin < len && strchr(validlengthchars, str[spec_begin]) != nullptr)
+    while(spec_begin < len && str[spec_begin] != '\0' && strchr(validlengthchars, str[spec_begin]) != nullptr)
         spec_begin++;
 
     // specifier
-    size_t end = spec_begin;
+    end = spec_begin;
     const char * validspec = "diuoxXfFeEgGaAcsp?";  // n not supported, %% handled elsewhere
-    if(end < len && strchr(validspec, str[end]) != nullptr)
+    if(end < len && str[end] != '\0' && strchr(validspec, str[end]) != nullptr)
         end++;
 
     // check some things
     // Specifier must be one character
-    if(end-spec_begin != 1)
-        throw std::runtime_error("Zero characters for type specifier");
+    if(end-spec_begin != 1 || !valid)
+        return FormatErrc::BadSpec;
 
     // Length must be 0, 1, or 2 characters
     size_t length_len = spec_begin-length_begin;
     if(length_len > 2)
-        throw std::runtime_error("Format length specification must be 0, 1, or 2 characters");
+        return FormatErrc::BadLength;
 
-    // now we have the format
-    fi.format = str.substr(fmt_begin, length_begin-fmt_begin);
+    // now we have the format (without the position)
+    fs.format.assign(1, '%');
+    fs.format.append(str+flag_begin, length_begin-flag_begin);
 
     // length
-    memset(fi.length, 0, 3*sizeof(char));
-    memcpy(fi.length, str.c_str()+length_begin, length_len);
+    memset(fs.length, 0, 3*sizeof(char));
+    memcpy(fs.length, str+length_begin, length_len);
 
 
     // length can only be certain combinations
-    const char * validlengths[8] = { "hh", "h", "l", "ll", "j", "z", "t", "L" };
-    bool found = false;
-    for(int i = 0; i < 8; i++)
+    if(length_len > 0)
     {
-        if(strcmp(validlengths[i], fi.length))
-            found = true;
+        const char * validlengths[8] = { "hh", "h", "l", "ll", "j", "z", "t", "L" };
+        bool found = false;
+        for(int i = 0; i < 8 && !found; i++)
+            found = (strcmp(validlengths[i], fs.length) == 0);
+        if(!found)
+            return FormatErrc::BadLength;
     }
-    if(!found)
-        throw std::runtime_error("Invalid length specifier");
 
     // spec
-    fi.spec = str[spec_begin];
+    fs.spec = str[spec_begin];
+
+    return FormatErrc::Ok;
+}
+
+
+
+bool get_next_format_(FormatInfo & fi, const char * str,
+                      size_t len, size_t pos)
+{
+#ifdef BPPRINT_STATS
+    const ParseStats_ stats;
+#endif
+
+    // Find a % not followed by another %
+    const size_t idx = pos + find_percent_(str + pos, len - pos);
+
+    fi.prefix_end = idx;
+    fi.errc = FormatErrc::Ok;
+
+    // Did we scan the whole string? (ie, didn't find a spec)
+    // If so, we are done.
+    if(idx >= len)
+    {
+        fi.next = len;
+        return false;
+    }
 
-    // suffix last, since it may be aliased
-    fi.suffix = str.substr(end);
+    // An escaped %%. The literal text includes the first %,
+    // and we skip the second one
+    if(idx+1 < len && str[idx+1] == '%')
+    {
+        fi.prefix_end = idx+1;
+        fi.next = idx+2;
+        return false;
+    }
 
+    // So we found a format spec. Decompose it
+    // into its various parts
+    fi.errc = parse_format_spec_(fi.spec, str, len, idx, fi.next);
     return true;
 }
 
 
+bool next_spec_(OutputBuffer & out, FormatInfo & fi,
+                const char * str, size_t len, size_t pos)
+{
+    for(;;)
+    {
+        const bool found = get_next_format_(fi, str, len, pos);
+        out.append_literal(str+pos, fi.prefix_end-pos);
+
+        if(found)
+            return true;
+        if(fi.next >= len)
+            return false;
+
+        pos = fi.next;
+    }
+}
+
+
+
+constexpr ArgType_ CharArrayArgType_::type;
+
+
+bool check_nargs_(FormatResult & res, const CompiledFormat & cf, size_t nargs) noexcept
+{
+    if(nargs > cf.nargs())
+        return set_error_(res, FormatErrc::TooManyArgs, cf.nargs(), cf.str().size());
+
+    if(nargs < cf.nargs())
+    {
+        // The first specification using an argument that was not given
+        size_t seg = 0;
+        while(cf.segments()[seg].args.end() <= nargs)
+            seg++;
+        return set_error_(res, FormatErrc::NotEnoughArgs, nargs, cf.segments()[seg].offset);
+    }
+
+    return true;
+}
+
+
+
+bool spec_args_(const FormatSpec & fs, bool positional, size_t & next, SpecArgs_ & sa) noexcept
+{
+    const size_t npos = FormatResult::npos;
+
+    if(positional)
+    {
+        if(fs.argpos == 0 || fs.width_arg == 0 || fs.prec_arg == 0)
+            return false;
+
+        sa.width = fs.width_arg > 0 ? static_cast<size_t>(fs.width_arg - 1) : npos;
+        sa.precision = fs.prec_arg > 0 ? static_cast<size_t>(fs.prec_arg - 1) : npos;
+        sa.value = fs.argpos - 1;
+        return true;
+    }
+
+    if(fs.argpos != 0 || fs.width_arg > 0 || fs.prec_arg > 0)
+        return false;
+
+    // In order: the width, the precision, then the value
+    sa.width = fs.width_arg == 0 ? next++ : npos;
+    sa.precision = fs.prec_arg == 0 ? next++ : npos;
+    sa.value = next++;
+    return true;
+}
+
+
+namespace {
+
+/*! \brief Format a single argument taken from an array
+ *
+ * The indices in \p sa must be valid. If there is an error, \p bad
+ * is set to the index of the argument responsible.
+ */
+FormatErrc format_arg_(OutputBuffer & out, const FormatSpec & fs, const SpecArgs_ & sa,
+                       const FormatArg_ * args, size_t & bad)
+{
+    if(sa.width == FormatResult::npos && sa.precision == FormatResult::npos)
+    {
+        bad = sa.value;
+        return args[sa.value].type->format(out, fs, args[sa.value].value);
+    }
+
+    // Replace the width and precision with those given by the arguments,
+    // and rebuild the format passed to printf
+    FormatSpec rs(fs);
+    int n;
+
+    if(sa.width != FormatResult::npos)
+    {
+        bad = sa.width;
+        if(!args[sa.width].type->to_int(args[sa.width].value, n))
+            return FormatErrc::BadType;
+
+        // A negative width is a '-' flag
+        if(n < 0)
+            rs.flags |= FLAG_MINUS;
+        rs.width = n < 0 ? -n : n;
+    }
+
+    if(sa.precision != FormatResult::npos)
+    {
+        bad = sa.precision;
+        if(!args[sa.precision].type->to_int(args[sa.precision].value, n))
+            return FormatErrc::BadType;
+
+        // A negative precision is as if it were not given
+        rs.precision = n < 0 ? -1 : n;
+    }
+
+    char buf[48];
+    char * p = buf;
+    *p++ = '%';
+    static const struct { char c; unsigned int bit; } flagchars[] = {
+        { '-', FLAG_MINUS }, { '+', FLAG_PLUS }, { ' ', FLAG_SPACE }, { '#', FLAG_HASH }, { '0', FLAG_ZERO }
+    };
+    for(const auto & f : flagchars)
+    {
+        if(rs.flags & f.bit)
+            *p++ = f.c;
+    }
+    if(rs.width >= 0)
+        p += snprintf(p, 12, "%d", rs.width);
+    if(rs.precision >= 0)
+        p += snprintf(p, 13, ".%d", rs.precision);
+    rs.format.assign(buf, static_cast<size_t>(p - buf));
+
+    bad = sa.value;
+    return args[sa.value].type->format(out, rs, args[sa.value].value);
+}
+
+} // close anonymous namespace
+
+
+bool format_args_(OutputBuffer & out, FormatResult & res, const char * str, size_t len,
+                  const FormatArg_ * args, size_t nargs)
+{
+    FormatInfo fi;
+    size_t next = 0;   // Next argument taken in order
+    size_t used = 0;   // One more than the highest argument used
+
+    if(next_spec_(out, fi, str, len, 0))
+    {
+        // Positions can only be used if all arguments are
+        const bool positional = fi.spec.argpos != 0;
+
+        do
+        {
+            if(fi.errc != FormatErrc::Ok)
+                return set_error_(res, fi.errc, positional ? FormatResult::npos : next, fi.prefix_end);
+
+            SpecArgs_ sa;
+            if(!spec_args_(fi.spec, positional, next, sa))
+                return set_error_(res, FormatErrc::BadSpec, FormatResult::npos, fi.prefix_end);
+
+            if(sa.end() > used)
+                used = sa.end();
+            if(used > nargs)
+                return set_error_(res, FormatErrc::NotEnoughArgs, nargs, fi.prefix_end);
+
+            size_t bad = sa.value;
+            const FormatErrc errc = format_arg_(out, fi.spec, sa, args, bad);
+            if(errc != FormatErrc::Ok)
+                return set_error_(res, errc, bad, fi.prefix_end, args[bad].type->name);
+
+        } while(next_spec_(out, fi, str, len, fi.next));
+    }
+
+    if(used < nargs)
+        return set_error_(res, FormatErrc::TooManyArgs, used, len);
+
+    return true;
+}
+
+
+bool format_args_(OutputBuffer & out, FormatResult & res, const CompiledFormat & cf,
+                  const FormatArg_ * args)
+{
+    const std::vector<CompiledFormat::Segment> & segs = cf.segments();
+    const size_t nspecs = segs.size() - 1;
+
+    for(size_t i = 0; i < nspecs; i++)
+    {
+        const CompiledFormat::Segment & seg = segs[i];
+        out.append_literal(seg.literal);
+
+        size_t bad = seg.args.value;
+        const FormatErrc errc = format_arg_(out, seg.spec, seg.args, args, bad);
+        if(errc != FormatErrc::Ok)
+            return set_error_(res, errc, bad, seg.offset, args[bad].type->name);
+    }
+
+    out.append_literal(segs[nspecs].literal);
+    return true;
+}
+
+
+bool vformat_(OutputBuffer & out, FormatResult & res, const FormatRef_ & fmt, bool nothrow,
+              const FormatArg_ * args, size_t nargs)
+{
+#ifdef BPPRINT_STATS
+    const CallStats_ stats(out, fmt.cf != nullptr ? fmt.cf->str().data() : fmt.str,
+                           fmt.cf != nullptr ? fmt.cf->str().size() : (fmt.cstr ? strlen(fmt.str) : fmt.len));
+#endif
+
+    const CallDepth_ depth(out);
+
+    if(fmt.cf != nullptr)
+        return check_nargs_(res, *fmt.cf, nargs) && format_args_(out, res, *fmt.cf, args);
+
+    if(!fmt.cstr)
+        return format_args_(out, res, fmt.str, fmt.len, args, nargs);
+
+#ifndef BPPRINT_NO_FORMAT_CACHE
+    const CachedFormat_ cached(fmt.str, nothrow);
+    if(cached.get() != nullptr)
+        return check_nargs_(res, *cached.get(), nargs) && format_args_(out, res, *cached.get(), args);
+#else
+    (void)nothrow;
+#endif
+
+    return format_args_(out, res, fmt.str, strlen(fmt.str), args, nargs);
+}
+
+
+void vformat_to_(OutputBuffer & out, const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs)
+{
+    FormatResult res;
+    if(!vformat_(out, res, fmt, false, args, nargs))
+        throw_format_error_(res);
+}
+
+
+std::string vformat_string_(const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs)
+{
+    MemoryBuffer buf;
+    vformat_to_(buf, fmt, args, nargs);
+    return buf.str();
+}
+
 
-// This is an overload for terminating the variadic template
-void format_(std::ostream & os, FormatInfo & fi, const std::string & str)
+void vformat_stream_(std::ostream & os, const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs)
 {
-    // If get_next_format_ returns true, we have a format spec, but
-    // we aren't given something to put there
-    //
-    // If get_next_format_ returns false, fi.prefix contains the
-    // string with appropriate substitutions for %%, etc
-    if(get_next_format_(fi, str))
-        throw std::runtime_error("Not enough arguments given to format string");
-    else
-        os << fi.prefix;
+    MemoryBuffer buf;
+    vformat_to_(buf, fmt, args, nargs);
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
 }
 
 
@@ -1,9 +1,15 @@
 #pragma once
 
-#include <sstream>
-#include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <utility>
 
 #include "bpprint/Printf_wrap.hpp"
+#include "bpprint/CompiledFormat.hpp"
+#include "bpprint/FormatCache.hpp"
+#include "bpprint/FormatStats.hpp"
 
 namespace bpprint {
 namespace detail {
@@ -11,109 +17,484 @@ namespace detail {
 
 /*! \brief Information about a single format specification
  *
- * This stores a piece of a format string (such as "%d" or "%12.8e"),
- * as well as what came before it and what comes after it in the
- * format string
+ * This describes a piece of a format string: the literal text
+ * before a format specification (such as "%d" or "%12.8e"), the
+ * specification itself, and where the remainder of the format
+ * string begins. Everything is stored as offsets into the original
+ * format string, so no copies of it are made.
  */
 struct FormatInfo
 {
-    //! The string before the format specification
-    std::string prefix;
+    //! Index just past the end of the literal text
+    size_t prefix_end;
 
-    //! The string after the format specification
-    std::string suffix;
+    //! Index where scanning of the format string should resume
+    size_t next;
 
-    //! The format specification itself, except for
-    //    the length and type specifier characters
-    std::string format;
+    //! The decoded format specification
+    FormatSpec spec;
 
-    //! The length specifier
-    char length[3];
-
-    //! The type specifier character
-    char spec;
+    //! Whether the specification is well formed (FormatErrc::Ok if so)
+    FormatErrc errc;
 };
 
 
+/*! \brief Decode a single format specification
+ *
+ * \p begin must point to the '%' character starting the
+ * specification.
+ *
+ * \param [out] fs The decoded specification
+ * \param [in] str The string containing the specification
+ * \param [in] len The length of \p str
+ * \param [in] begin Index of the '%' character in \p str
+ * \param [out] end Index of the character just past the end of the specification
+ * \return FormatErrc::Ok, or FormatErrc::BadSpec or FormatErrc::BadLength if
+ *         the specification is badly formatted
+ */
+FormatErrc parse_format_spec_(FormatSpec & fs, const char * str,
+                              size_t len, size_t begin, size_t & end);
+
+
+/*! \brief Find the first '%' character
+ *
+ * The search is vectorized (with SSE2 or AVX2, chosen at run time)
+ * where available.
+ *
+ * \param [in] str The string to search
+ * \param [in] len The length of \p str
+ * \return Index of the first '%' in \p str, or \p len if there is none
+ */
+size_t find_percent_(const char * str, size_t len) noexcept;
+
+
 /*! \brief Get the next format specification
  *
- * If the function returns true, the members of \p fi are filled in.
+ * Scanning begins at index \p pos of \p str. The literal text
+ * to be output is always `[pos, fi.prefix_end)`, and scanning
+ * should resume at `fi.next`.
  *
- * If the function returns false, the prefix member contains the entire
- * string but with some processing (such as replacing %% with %).
+ * If the function returns true, a format specification was found
+ * and fi.spec is filled in. If it is badly formed, fi.errc is
+ * set to the problem.
  *
- * \throw std::runtime_error if the format string is badly formatted
+ * If the function returns false, no specification was found. Either
+ * the end of the string was reached (`fi.next == len`), or an escaped
+ * percent (%%) was found. In the latter case, the literal text ends
+ * with a single %, and the second one is skipped.
  *
  * \param [out] fi Information about the specification
  * \param [in] str The string to search
+ * \param [in] len The length of \p str
+ * \param [in] pos Where to start searching
  * \return True if a format specification was found, otherwise false
  */
-bool get_next_format_(FormatInfo & fi, const std::string & str);
+bool get_next_format_(FormatInfo & fi, const char * str,
+                      size_t len, size_t pos);
 
 
-/*! \brief Format a string into an ostream
+/*! \brief Output literal text up to the next format specification
  *
- * Used to terminate the variadic template
+ * This repeatedly calls get_next_format_, writing literal text to
+ * \p out, until a specification or the end of the string is found.
  *
- * \throw std::runtime_error if the string contains a format
- *        specification (meaning it is expecting an argument)
- *
- * \param [in] os The ostream used to build the string
- * \param [in] fi Format info to use as a workspace
- * \param [in] str String (possibly with format string specification)
+ * \param [in] out The buffer to output to
+ * \param [out] fi Information about the specification
+ * \param [in] str The string to search
+ * \param [in] len The length of \p str
+ * \param [in] pos Where to start searching
+ * \return True if a format specification was found, otherwise false
  */
-void format_(std::ostream & os, FormatInfo & fi, const std::string & str);
+bool next_spec_(OutputBuffer & out, FormatInfo & fi,
+                const char * str, size_t len, size_t pos);
 
 
-/*! \brief Format a string into an ostream
+/*! \brief Find the arguments used by a specification
  *
- * This will only format the first specification found in
- * \p str, using \p arg as the substitution
+ * Arguments are either all given by position, or all taken in order
+ * (in which case the width and precision come before the value).
  *
- * \throw std::runtime_error if the correct number of arguments is not given or
- *        if the format string is badly formed
+ * \param [in] fs The specification
+ * \param [in] positional Whether the format string uses positions
+ * \param [inout] next Index of the next argument in order, which is advanced
+ * \param [out] sa The arguments used
+ * \return False if \p fs does not match \p positional
+ */
+bool spec_args_(const FormatSpec & fs, bool positional, size_t & next, SpecArgs_ & sa) noexcept;
+
+
+/*! \brief Operations on an argument whose type has been erased */
+struct ArgType_
+{
+    //! Check and format the argument (see handle_arg_)
+    FormatErrc (*format)(OutputBuffer & out, const FormatSpec & fs, const void * value);
+
+    //! Get the argument as a width or precision, returning false if it is not a suitable integer
+    bool (*to_int)(const void * value, int & n);
+
+    //! Name of the type
+    const char * name;
+};
+
+
+/*! \brief An argument whose type has been erased
  *
- * \param [in] os The ostream to output to
- * \param [in] fi The format information struct to use
- * \param [in] str String (possibly with format string specification)
- * \param [in] arg Substitution for the first format specification found
- * \param [in] args Additional arguments for later format specifications
+ * The arguments of a call are gathered into an array of these, so
+ * that a single (non-template) engine can format them. Only the
+ * ArgType_ of each argument type is instantiated, rather than the
+ * whole formatting engine for each sequence of argument types.
  */
-template<typename T, typename... Targs>
-void format_(std::ostream & os, FormatInfo & fi,
-             const std::string & str, T arg, Targs... args)
+struct FormatArg_
 {
-    // just in case
-    typedef typename std::remove_cv<T>::type nocv_T;
-    typedef typename std::decay<nocv_T>::type decay_T;
-    typedef typename std::remove_reference<decay_T>::type actual_T;
+    const void * value;
+    const ArgType_ * type;
+};
 
-    static_assert(ValidPrintfArg<actual_T>::value == true,
-                  "Invalid argument type passed to Format");
 
-    // Obtain the next format in the string.
-    // If there aren't any, that is a problem - we were passed
-    // more arguments!
+//! Conversion of an integer argument to int (for '*')
+template<typename T>
+bool arg_to_int_(const void * value, int & n, std::true_type)
+{
+    const T v = *static_cast<const T *>(value);
+    const bool fits = std::is_signed<T>::value ?
+                      (static_cast<long long>(v) >= -std::numeric_limits<int>::max() &&
+                       static_cast<long long>(v) <= std::numeric_limits<int>::max()) :
+                      static_cast<unsigned long long>(v) <= static_cast<unsigned long long>(
+                                                                std::numeric_limits<int>::max());
+    n = fits ? static_cast<int>(v) : 0;
+    return fits;
+}
+
+template<typename T>
+bool arg_to_int_(const void *, int &, std::false_type)
+{
+    return false;
+}
+
 
-    if(get_next_format_(fi, str))
+/*! \brief The ArgType_ for a type
+ *
+ * \tparam T The type of the argument (not decayed, so that arrays
+ *           are referred to in place)
+ */
+template<typename T>
+struct ArgTypeOf_
+{
+    typedef typename std::decay<T>::type actual_T;
+
+    static FormatErrc format(OutputBuffer & out, const FormatSpec & fs, const void * value)
     {
-        // after this, fi.format has been overwritten
-        handle_fmt_(fi.format, fi.length, fi.spec, arg);
+        return handle_arg_(out, fs, *static_cast<const T *>(value));
+    }
 
-        os << fi.prefix << fi.format;
-        format_(os, fi, fi.suffix, args...);
+    static bool to_int(const void * value, int & n)
+    {
+        return arg_to_int_<actual_T>(value, n,
+                                     std::integral_constant<bool, std::is_integral<actual_T>::value &&
+                                                                  !std::is_same<actual_T, bool>::value>());
     }
-    else
-        throw std::runtime_error("Too many arguments to format string");
+
+    static constexpr ArgType_ type = { &format, &to_int, TypeName_<actual_T>::get() };
+};
+
+template<typename T>
+constexpr ArgType_ ArgTypeOf_<T>::type;
+
+
+/*! \brief The ArgType_ for character arrays (such as string literals)
+ *
+ * The address of an array is the address of its first character, so
+ * arrays of every length share the ArgType_ of const char *.
+ */
+struct CharArrayArgType_
+{
+    static FormatErrc format(OutputBuffer & out, const FormatSpec & fs, const void * value)
+    {
+        return handle_arg_(out, fs, static_cast<const char *>(value));
+    }
+
+    static bool to_int(const void *, int &)
+    {
+        return false;
+    }
+
+    static constexpr ArgType_ type = { &format, &to_int, TypeName_<const char *>::get() };
+};
+
+template<size_t N> struct ArgTypeOf_<char[N]> : public CharArrayArgType_ { };
+
+
+//! Erase the type of an argument
+template<typename T>
+FormatArg_ make_arg_(const T & value) noexcept
+{
+    static_assert(ValidPrintfArg<typename std::decay<T>::type>::value == true,
+                  "Invalid argument type passed to Format");
+
+    return FormatArg_{ &value, &ArgTypeOf_<T>::type };
 }
 
+
+/*! \brief A format string of any kind (other than BPPRINT_FMT)
+ *
+ * This is how the inline front ends pass the format string to the
+ * formatting engine (vformat_).
+ */
+struct FormatRef_
+{
+    FormatRef_(const std::string & fmt) noexcept
+        : str(fmt.data()), len(fmt.size()), cf(nullptr), cstr(false) { }
+
+    FormatRef_(const char * fmt) noexcept
+        : str(fmt), len(0), cf(nullptr), cstr(true) { }
+
+    FormatRef_(const CompiledFormat & fmt) noexcept
+        : str(nullptr), len(0), cf(&fmt), cstr(false) { }
+
+    const char * str;          //!< The format string (unless compiled)
+    size_t len;                //!< Length of \p str (unless it is a C string)
+    const CompiledFormat * cf; //!< The compiled format, or nullptr
+    bool cstr;                 //!< Is \p str a null-terminated C string (which may be cached)?
+};
+
+
+/*! \brief Format a string, taking arguments from an array
+ *
+ * Arguments are taken in order, or all given by position.
+ *
+ * \param [in] out The buffer to output to
+ * \param [out] res Filled in if there is an error
+ * \param [in] str The format string
+ * \param [in] len The length of \p str
+ * \param [in] args The arguments
+ * \param [in] nargs The number of elements in \p args
+ * \return False (with \p res filled in) if the correct number of arguments
+ *         is not given, if an argument does not match its specification,
+ *         or if the format string is badly formed
+ */
+bool format_args_(OutputBuffer & out, FormatResult & res, const char * str, size_t len,
+                  const FormatArg_ * args, size_t nargs);
+
+
+/*! \brief Apply a compiled format, taking arguments from an array
+ *
+ * The number of arguments must have been checked already.
+ *
+ * \return False (with \p res filled in) if an argument does not match
+ *         its specification
+ */
+bool format_args_(OutputBuffer & out, FormatResult & res, const CompiledFormat & cf,
+                  const FormatArg_ * args);
+
+
+/*! \brief Check the number of arguments given for a compiled format
+ *
+ * \return False (with \p res filled in) if the number is wrong
+ */
+bool check_nargs_(FormatResult & res, const CompiledFormat & cf, size_t nargs) noexcept;
+
+
+/*! \brief The formatting engine
+ *
+ * All of the front ends (format_to, format_string, ...) gather their
+ * arguments into an array and call this. C strings are compiled
+ * through the format cache, if possible.
+ *
+ * \throw format_error if a C string format is badly formed (unless \p nothrow is set)
+ *
+ * \param [in] out The buffer to output to
+ * \param [out] res Filled in if there is an error
+ * \param [in] fmt The format string
+ * \param [in] nothrow If true, all errors are reported through \p res
+ * \param [in] args The arguments
+ * \param [in] nargs The number of elements in \p args
+ * \return False (with \p res filled in) if there is an error
+ */
+bool vformat_(OutputBuffer & out, FormatResult & res, const FormatRef_ & fmt, bool nothrow,
+              const FormatArg_ * args, size_t nargs);
+
+
+/*! \brief Run the formatting engine, throwing format_error if there is an error */
+void vformat_to_(OutputBuffer & out, const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs);
+
+
+/*! \brief Run the formatting engine, returning the output as a string */
+std::string vformat_string_(const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs);
+
+
+/*! \brief Run the formatting engine, writing the output to a stream */
+void vformat_stream_(std::ostream & os, const FormatRef_ & fmt, const FormatArg_ * args, size_t nargs);
+
 } // close namespace detail
 
 
 
+/* \brief Apply formatting to a string, outputting it to a buffer
+ *
+ * The output is appended to \p out.
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] fmt The format string
+ * \param [in] args Arguments to the format string
+ */
+template<typename... Targs>
+void format_to(OutputBuffer & out, const std::string & fmt, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_to_(out, fmt, argarr, sizeof...(args));
+}
+
+
+
+/* \brief Apply a compiled format, outputting it to a buffer
+ *
+ * The output is appended to \p out.
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if an argument does not match its specification
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] cf The compiled format string
+ * \param [in] args Arguments to the format string
+ */
+template<typename... Targs>
+void format_to(OutputBuffer & out, const CompiledFormat & cf, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_to_(out, cf, argarr, sizeof...(args));
+}
+
+
+
+/* \brief Apply formatting to a string, outputting it to a buffer
+ *
+ * Overload for C strings (such as string literals). The compiled
+ * format is taken from the format cache (see FormatCache.hpp), so
+ * the format string is only parsed on first use.
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] fmt The (null terminated) format string
+ * \param [in] args Arguments to the format string
+ */
+template<typename... Targs>
+void format_to(OutputBuffer & out, const char * fmt, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_to_(out, fmt, argarr, sizeof...(args));
+}
+
+
+
+/* \brief Apply formatting to a string, reporting errors without throwing
+ *
+ * This is the same as format_to(), except that errors are returned rather
+ * than thrown. Output written before an error was found is left in \p out.
+ *
+ * Since this is noexcept, a failure to allocate memory for the output
+ * (or an exception thrown by a Formatter) terminates the program.
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] fmt The format string
+ * \param [in] args Arguments to the format string
+ * \return The outcome. If not FormatResult::ok(), this gives the kind and location of the error.
+ */
+template<typename... Targs>
+FormatResult try_format_to(OutputBuffer & out, const std::string & fmt, Targs &&... args) noexcept
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    FormatResult res;
+    detail::vformat_(out, res, fmt, true, argarr, sizeof...(args));
+    return res;
+}
+
+
+/* \brief Apply a compiled format, reporting errors without throwing
+ *
+ * Overload for compiled format strings (see the std::string overload)
+ */
+template<typename... Targs>
+FormatResult try_format_to(OutputBuffer & out, const CompiledFormat & cf, Targs &&... args) noexcept
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    FormatResult res;
+    detail::vformat_(out, res, cf, true, argarr, sizeof...(args));
+    return res;
+}
+
+
+/* \brief Apply formatting to a C string, reporting errors without throwing
+ *
+ * Overload for C strings (see the std::string overload)
+ */
+template<typename... Targs>
+FormatResult try_format_to(OutputBuffer & out, const char * fmt, Targs &&... args) noexcept
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    FormatResult res;
+    detail::vformat_(out, res, fmt, true, argarr, sizeof...(args));
+    return res;
+}
+
+
+
+/* \brief Apply formatting to a string, outputting it to fixed storage
+ *
+ * At most \p n characters are written to \p dest, and the output is
+ * not null terminated. No memory is allocated for the output.
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ *
+ * \param [in] dest Where to write the output
+ * \param [in] n Maximum number of characters to write
+ * \param [in] fmt The format string (std::string, C string, or CompiledFormat)
+ * \param [in] args Arguments to the format string
+ * \return The length of the full output. If this is greater than \p n,
+ *         the output was truncated.
+ */
+template<typename Fmt, typename... Targs>
+size_t format_to_n(char * dest, size_t n, const Fmt & fmt, Targs &&... args)
+{
+    FixedBuffer buf(dest, n);
+    format_to(buf, fmt, std::forward<Targs>(args)...);
+    return buf.size();
+}
+
+
+
+/* \brief Compute the length of the output of formatting
+ *
+ * This is the exact number of characters format_to() would write, so
+ * storage can be sized once before formatting into it. No memory is
+ * allocated, and where possible the length of a conversion is computed
+ * without producing it (for example, integers and strings).
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ *
+ * \param [in] fmt The format string (std::string, C string, CompiledFormat, or BPPRINT_FMT)
+ * \param [in] args Arguments to the format string
+ * \return The length of the output
+ */
+template<typename Fmt, typename... Targs>
+size_t formatted_size(const Fmt & fmt, Targs &&... args)
+{
+    CountingBuffer buf;
+    format_to(buf, fmt, std::forward<Targs>(args)...);
+    return buf.size();
+}
+
+
+
 /* \brief Apply formatting to a string, outputting it to an ostream
  *
- * \throw std::runtime_error if the correct number of arguments is not given or
+ * \throw format_error if the correct number of arguments is not given or
  *        if the format string is badly formed
  *
  * \param [in] os The ostream to output to
@@ -121,35 +502,114 @@ void format_(std::ostream & os, FormatInfo & fi,
  * \param [in] args Arguments to the format string
  */
 template<typename... Targs>
-void format_stream(std::ostream & os, const std::string & fmt, Targs... args)
+void format_stream(std::ostream & os, const std::string & fmt, Targs &&... args)
 {
-    detail::FormatInfo fi;
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_stream_(os, fmt, argarr, sizeof...(args));
+}
+
 
-    // Reserve space in the strings
-    // These are just guesses, and should hold most substitutions
-    fi.prefix.reserve(64);
-    fi.suffix.reserve(64);
-    fi.format.reserve(16);
 
-    detail::format_(os, fi, fmt, args...);
+/* \brief Apply formatting to a string
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ */
+template<typename... Targs>
+std::string format_string(const std::string & str, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    return detail::vformat_string_(str, argarr, sizeof...(args));
 }
 
 
 
-/* \brief Apply formatting to a string
+/* \brief Apply formatting to a C string, outputting it to an ostream
  *
- * \throw std::runtime_error if the correct number of arguments is not given or
+ * \throw format_error if the correct number of arguments is not given or
  *        if the format string is badly formed
  */
 template<typename... Targs>
-std::string format_string(const std::string & str, Targs... args)
+void format_stream(std::ostream & os, const char * fmt, Targs &&... args)
 {
-    std::stringstream ss;
-    format_stream(ss, str, args...);
-    return ss.str();
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_stream_(os, fmt, argarr, sizeof...(args));
 }
 
 
 
-} // close namespace bpprint
+/* \brief Apply formatting to a C string
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ */
+template<typename... Targs>
+std::string format_string(const char * fmt, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    return detail::vformat_string_(fmt, argarr, sizeof...(args));
+}
+
+
+
+/* \brief Apply a compiled format, outputting it to an ostream
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if an argument does not match its specification
+ *
+ * \param [in] os The ostream to output to
+ * \param [in] cf The compiled format string
+ * \param [in] args Arguments to the format string
+ */
+template<typename... Targs>
+void format_stream(std::ostream & os, const CompiledFormat & cf, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    detail::vformat_stream_(os, cf, argarr, sizeof...(args));
+}
+
+
+
+/* \brief Apply a compiled format
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if an argument does not match its specification
+ */
+template<typename... Targs>
+std::string format_string(const CompiledFormat & cf, Targs &&... args)
+{
+    const detail::FormatArg_ argarr[] = { detail::make_arg_(args)..., detail::FormatArg_{ nullptr, nullptr } };
+    return detail::vformat_string_(cf, argarr, sizeof...(args));
+}
+
 
+
+/*! \brief Apply formatting, with memory for the result taken from an allocator
+ *
+ * Neither the result nor any intermediate storage for the output uses
+ * the global heap (other than through \p alloc). For example, with an
+ * ArenaAllocator, the result is placed in an Arena.
+ *
+ * \throw format_error if the correct number of arguments is not given or
+ *        if the format string is badly formed
+ *
+ * \param [in] alloc The allocator to use for the result
+ * \param [in] fmt The format string (std::string, C string, CompiledFormat, or BPPRINT_FMT)
+ * \param [in] args Arguments to the format string
+ */
+template<typename Alloc, typename Fmt, typename... Targs>
+std::basic_string<char, std::char_traits<char>,
+                  typename std::allocator_traits<Alloc>::template rebind_alloc<char>>
+format_string(std::allocator_arg_t, const Alloc & alloc, const Fmt & fmt, Targs &&... args)
+{
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<char> CharAlloc;
+
+    // Small results stay inline, so only the returned string is allocated
+    BasicAllocatorBuffer<CharAlloc, 256> buf(alloc);
+    format_to(buf, fmt, std::forward<Targs>(args)...);
+    return std::basic_string<char, std::char_traits<char>, CharAlloc>(buf.data(), buf.size(), alloc);
+}
+
+
+
+} // close namespace bpprint
@@ -0,0 +1,234 @@
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bpprint/FormatCache.hpp"
+
+#ifndef BPPRINT_FORMAT_CACHE_SIZE
+    #define BPPRINT_FORMAT_CACHE_SIZE 128
+#endif
+
+namespace bpprint {
+namespace detail {
+
+
+struct FormatCacheEntry_
+{
+    const char * key;                  //!< Address of the format string (never dereferenced)
+    std::unique_ptr<CompiledFormat> cf;
+    bool referenced;                   //!< Used since the clock hand last passed?
+    unsigned int pins;                 //!< Number of CachedFormat_ using this entry
+};
+
+
+namespace {
+
+std::atomic<bool> cache_enabled_(true);
+
+
+/*! \brief A bounded cache of compiled formats, using clock eviction */
+class FormatCache_
+{
+    public:
+        FormatCache_(void)
+            : entries_(BPPRINT_FORMAT_CACHE_SIZE), used_(0), hand_(0),
+              hits_(0), misses_(0), evictions_(0)
+        {
+            index_.reserve(BPPRINT_FORMAT_CACHE_SIZE);
+        }
+
+
+        FormatCacheEntry_ * lookup(const char * fmt)
+        {
+            auto it = index_.find(fmt);
+            if(it != index_.end())
+            {
+                FormatCacheEntry_ * e = it->second;
+
+                // Same address, but is it still the same string?
+                if(strcmp(fmt, e->cf->str().c_str()) == 0)
+                {
+                    hits_++;
+                    e->referenced = true;
+                    return e;
+                }
+
+                // Recompile in place, unless it is in use
+                misses_++;
+                if(e->pins > 0)
+                    return nullptr;
+
+                e->cf.reset(new CompiledFormat(fmt));
+                e->referenced = true;
+                return e;
+            }
+
+            misses_++;
+
+            FormatCacheEntry_ * e = free_entry_();
+            if(e == nullptr)
+                return nullptr;
+
+            // compile first, in case it throws
+            std::unique_ptr<CompiledFormat> cf(new CompiledFormat(fmt));
+
+            if(e->cf)
+            {
+                index_.erase(e->key);
+                evictions_++;
+            }
+            else
+                used_++;
+
+            e->key = fmt;
+            e->cf = std::move(cf);
+            e->referenced = true;
+            index_.emplace(fmt, e);
+            return e;
+        }
+
+
+        FormatCacheStats stats(void) const noexcept
+        {
+            FormatCacheStats s;
+            s.hits = hits_;
+            s.misses = misses_;
+            s.evictions = evictions_;
+            s.size = used_;
+            s.capacity = entries_.size();
+            return s;
+        }
+
+
+        void clear(void)
+        {
+            // Entries in use are kept
+            for(auto & e : entries_)
+            {
+                if(e.cf && e.pins == 0)
+                {
+                    index_.erase(e.key);
+                    e.cf.reset();
+                    e.referenced = false;
+                    used_--;
+                }
+            }
+
+            hits_ = misses_ = evictions_ = 0;
+        }
+
+
+    private:
+        std::vector<FormatCacheEntry_> entries_;
+        std::unordered_map<const char *, FormatCacheEntry_ *> index_;
+        size_t used_;
+        size_t hand_;
+
+        unsigned long long hits_;
+        unsigned long long misses_;
+        unsigned long long evictions_;
+
+
+        /*! \brief Find an entry to (re)use
+         *
+         * Returns null if all entries are in use
+         */
+        FormatCacheEntry_ * free_entry_(void)
+        {
+            const size_t n = entries_.size();
+
+            // Each entry may need to be passed twice
+            // (once to clear the referenced flag)
+            for(size_t i = 0; i < 2*n; i++)
+            {
+                FormatCacheEntry_ & e = entries_[hand_];
+                hand_ = (hand_ + 1) % n;
+
+                if(e.pins > 0)
+                    continue;
+                if(!e.cf || !e.referenced)
+                    return &e;
+
+                e.referenced = false;
+            }
+
+            return nullptr;
+        }
+};
+
+
+FormatCache_ & thread_cache_(void)
+{
+    static thread_local FormatCache_ cache;
+    return cache;
+}
+
+} // close anonymous namespace
+
+
+
+CachedFormat_::CachedFormat_(const char * fmt, bool nothrow)
+    : entry_(nullptr), cf_(nullptr)
+{
+    if(!cache_enabled_.load(std::memory_order_relaxed))
+        return;
+
+    if(nothrow)
+    {
+        // The caller will report the error when formatting without the cache
+        try {
+            entry_ = thread_cache_().lookup(fmt);
+        }
+        catch(...)
+        {
+            entry_ = nullptr;
+        }
+    }
+    else
+        entry_ = thread_cache_().lookup(fmt);
+    if(entry_ != nullptr)
+    {
+        entry_->pins++;
+        cf_ = entry_->cf.get();
+    }
+}
+
+
+CachedFormat_::~CachedFormat_()
+{
+    if(entry_ != nullptr)
+        entry_->pins--;
+}
+
+
+} // close namespace detail
+
+
+
+void set_format_cache_enabled(bool enabled) noexcept
+{
+    detail::cache_enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+
+bool format_cache_enabled(void) noexcept
+{
+    return detail::cache_enabled_.load(std::memory_order_relaxed);
+}
+
+
+FormatCacheStats format_cache_stats(void) noexcept
+{
+    return detail::thread_cache_().stats();
+}
+
+
+void clear_format_cache(void)
+{
+    detail::thread_cache_().clear();
+}
+
+
+} // close namespace bpprint
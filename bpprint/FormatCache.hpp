@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+
+#include "bpprint/CompiledFormat.hpp"
+
+/*! \file
+ *
+ * A cache of compiled format strings
+ *
+ * Format strings passed as a `const char *` (typically string literals)
+ * are compiled on first use and stored in a small, per-thread cache,
+ * keyed by the address of the format string. Later calls with the
+ * same format string skip parsing.
+ *
+ * Since the same address may later hold a different string (for example,
+ * a reused buffer), the contents are always compared with the cached
+ * copy before it is used.
+ *
+ * The cache can be disabled at run time with set_format_cache_enabled(),
+ * or at compile time by defining BPPRINT_NO_FORMAT_CACHE (see the
+ * BPPRINT_FORMAT_CACHE CMake option).
+ */
+
+namespace bpprint {
+
+
+/*! \brief Statistics about the format cache of the calling thread */
+struct FormatCacheStats
+{
+    unsigned long long hits;      //!< Lookups that found a compiled format
+    unsigned long long misses;    //!< Lookups that had to compile the format
+    unsigned long long evictions; //!< Entries removed to make room for new ones
+    size_t size;                  //!< Number of formats currently cached
+    size_t capacity;              //!< Maximum number of formats cached
+};
+
+
+/*! \brief Enable or disable the format cache
+ *
+ * This affects all threads. Formats that are already cached
+ * are kept, but are not used while the cache is disabled.
+ */
+void set_format_cache_enabled(bool enabled) noexcept;
+
+
+/*! \brief Is the format cache enabled? */
+bool format_cache_enabled(void) noexcept;
+
+
+/*! \brief Get statistics about the format cache of the calling thread */
+FormatCacheStats format_cache_stats(void) noexcept;
+
+
+/*! \brief Remove all entries from the format cache of the calling thread
+ *
+ * The statistics are also reset.
+ */
+void clear_format_cache(void);
+
+
+
+namespace detail {
+
+
+struct FormatCacheEntry_;
+
+
+/*! \brief Looks up a format string in the cache of the calling thread
+ *
+ * The entry is compiled and added to the cache if needed. It
+ * is not evicted as long as this object exists.
+ */
+class CachedFormat_
+{
+    public:
+        /*! \brief Look up (or compile and add) a format string
+         *
+         * \throw format_error if the format string is badly formed (unless \p nothrow is set)
+         *
+         * \param [in] fmt The (null terminated) format string
+         * \param [in] nothrow If true, errors are not thrown. Instead,
+         *                     no compiled format is returned.
+         */
+        explicit CachedFormat_(const char * fmt, bool nothrow = false);
+
+        ~CachedFormat_();
+
+        CachedFormat_(const CachedFormat_ &) = delete;
+        CachedFormat_ & operator=(const CachedFormat_ &) = delete;
+
+
+        /*! \brief The compiled format
+         *
+         * This is null if the cache is disabled (or if every entry is in use).
+         */
+        const CompiledFormat * get(void) const noexcept { return cf_; }
+
+
+    private:
+        FormatCacheEntry_ * entry_;
+        const CompiledFormat * cf_;
+};
+
+
+} // close namespace detail
+} // close namespace bpprint
@@ -0,0 +1,98 @@
+#include <string>
+
+#include "bpprint/FormatError.hpp"
+#include "bpprint/FormatStats.hpp"
+
+
+namespace bpprint {
+
+
+constexpr size_t FormatResult::npos;
+
+
+const char * format_errc_str(FormatErrc errc) noexcept
+{
+    switch(errc)
+    {
+        case FormatErrc::Ok:               return "No error";
+        case FormatErrc::BadSpec:          return "Badly formed format specification";
+        case FormatErrc::BadLength:        return "Bad length specifier";
+        case FormatErrc::BadType:          return "Bad type specifier";
+        case FormatErrc::TooManyArgs:      return "Too many arguments to format string";
+        case FormatErrc::NotEnoughArgs:    return "Not enough arguments given to format string";
+        case FormatErrc::ConversionFailed: return "Conversion failed";
+        case FormatErrc::Unsupported:      return "Positional arguments and '*' are not supported here";
+        case FormatErrc::Truncated:        return "Output does not fit in fixed storage";
+    }
+
+    return "Unknown error";
+}
+
+
+namespace {
+
+// The message is only built once an error is thrown
+std::string error_message_(const FormatResult & result)
+{
+    std::string msg = format_errc_str(result.errc);
+
+    if(result.type_name != nullptr)
+    {
+        msg += " for type ";
+        msg += result.type_name;
+    }
+
+    if(result.arg_index != FormatResult::npos)
+    {
+        msg += " (argument ";
+        msg += std::to_string(result.arg_index);
+        if(result.offset != FormatResult::npos)
+        {
+            msg += ", offset ";
+            msg += std::to_string(result.offset);
+        }
+        msg += ")";
+    }
+    else if(result.offset != FormatResult::npos)
+    {
+        msg += " (offset ";
+        msg += std::to_string(result.offset);
+        msg += ")";
+    }
+
+    return msg;
+}
+
+} // close anonymous namespace
+
+
+format_error::format_error(const FormatResult & result)
+    : std::runtime_error(error_message_(result)), result_(result)
+{ }
+
+
+namespace detail {
+
+void throw_format_error_(const FormatResult & result)
+{
+#ifdef BPPRINT_STATS
+    count_exception_();
+#endif
+    throw format_error(result);
+}
+
+
+bool set_error_(FormatResult & res, FormatErrc errc, size_t arg_index,
+                size_t offset, const char * type_name) noexcept
+{
+    res.errc = errc;
+    res.arg_index = arg_index;
+    res.offset = offset;
+    res.type_name = type_name;
+    return false;
+}
+
+} // close namespace detail
+
+
+} // close namespace bpprint
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+/*! \file
+ *
+ * Errors found while formatting
+ *
+ * The formatting engines report problems as a FormatResult (the kind of
+ * error, and where it happened) rather than building a message. Functions
+ * such as format_to() throw a format_error containing the result, while
+ * try_format_to() returns it without throwing.
+ */
+
+namespace bpprint {
+
+
+/*! \brief The kinds of formatting errors */
+enum class FormatErrc : unsigned char
+{
+    Ok = 0,           //!< No error
+    BadSpec,          //!< A specification is badly formed
+    BadLength,        //!< A length specifier is invalid, or does not match the argument type
+    BadType,          //!< A type specifier does not match the argument type
+    TooManyArgs,      //!< More arguments were given than the format string uses
+    NotEnoughArgs,    //!< Fewer arguments were given than the format string uses
+    ConversionFailed, //!< snprintf reported an error
+    Unsupported,      //!< Positional arguments or '*' used where they are not supported
+    Truncated         //!< The output does not fit in fixed storage
+};
+
+
+/*! \brief Get a description of an error kind
+ *
+ * \return A string with static storage
+ */
+const char * format_errc_str(FormatErrc errc) noexcept;
+
+
+/*! \brief The outcome of formatting
+ *
+ * For errors, this identifies the argument and the position in the
+ * format string where the problem was found (either may be npos if
+ * not known).
+ */
+struct FormatResult
+{
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    //! The kind of error
+    FormatErrc errc = FormatErrc::Ok;
+
+    //! Index (from zero) of the argument
+    size_t arg_index = npos;
+
+    //! Offset of the specification (the '%') in the format string
+    size_t offset = npos;
+
+    //! Name of the argument type (with static storage), or nullptr
+    const char * type_name = nullptr;
+
+    //! Did formatting succeed?
+    bool ok(void) const noexcept { return errc == FormatErrc::Ok; }
+};
+
+
+/*! \brief Exception thrown for errors in format strings or arguments
+ *
+ * This derives from std::runtime_error, with a message describing the
+ * error, and also gives the details of the error separately.
+ */
+class format_error : public std::runtime_error
+{
+    public:
+        explicit format_error(const FormatResult & result);
+
+        //! The kind of error
+        FormatErrc kind(void) const noexcept { return result_.errc; }
+
+        //! Index (from zero) of the argument, or FormatResult::npos
+        size_t arg_index(void) const noexcept { return result_.arg_index; }
+
+        //! Offset of the specification in the format string, or FormatResult::npos
+        size_t offset(void) const noexcept { return result_.offset; }
+
+        //! Name of the argument type, or nullptr
+        const char * type_name(void) const noexcept { return result_.type_name; }
+
+        //! All details of the error
+        const FormatResult & result(void) const noexcept { return result_; }
+
+    private:
+        FormatResult result_;
+};
+
+
+namespace detail {
+
+/*! \brief Throw a format_error
+ *
+ * This is kept out of line, so that the code building the
+ * exception is not part of the (inlined) formatting functions.
+ */
+[[noreturn]] void throw_format_error_(const FormatResult & result);
+
+
+/*! \brief Fill in an error, returning false
+ *
+ * \param [out] res The result to fill in
+ * \param [in] errc The kind of error
+ * \param [in] arg_index Index of the argument
+ * \param [in] offset Offset of the specification in the format string
+ * \param [in] type_name Name of the argument type
+ */
+bool set_error_(FormatResult & res, FormatErrc errc, size_t arg_index,
+                size_t offset, const char * type_name = nullptr) noexcept;
+
+} // close namespace detail
+
+
+} // close namespace bpprint
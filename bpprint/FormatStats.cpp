@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cstdio>
+
+#ifdef BPPRINT_STATS
+    #include <atomic>
+    #include <chrono>
+    #include <mutex>
+    #include <unordered_map>
+#endif
+
+#include "bpprint/FormatStats.hpp"
+
+namespace bpprint {
+namespace detail {
+
+
+namespace {
+
+//! An empty snapshot
+FormatStats empty_stats_(void)
+{
+    FormatStats s;
+    s.calls = s.bytes = s.parse_ns = s.total_ns = s.heap_fallbacks = s.exceptions = 0;
+    return s;
+}
+
+
+#ifdef BPPRINT_STATS
+
+unsigned long long now_ns_(void) noexcept
+{
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+//! Counters for a single format string
+struct SiteCounters_
+{
+    unsigned long long calls;
+    unsigned long long bytes;
+    unsigned long long parse_ns;
+    unsigned long long total_ns;
+};
+
+typedef std::unordered_map<std::string, SiteCounters_> SiteMap_;
+
+
+//! Add counters (for a format string) to a snapshot
+void add_site_(SiteMap_ & sites, const std::string & fmt, const SiteCounters_ & c)
+{
+    SiteCounters_ & s = sites.emplace(fmt, SiteCounters_{ 0, 0, 0, 0 }).first->second;
+    s.calls += c.calls;
+    s.bytes += c.bytes;
+    s.parse_ns += c.parse_ns;
+    s.total_ns += c.total_ns;
+}
+
+
+/*! \brief The counters of a single thread
+ *
+ * The totals are atomic, so they can be read by other threads. The
+ * counters for each format string are protected by a mutex, which
+ * is only contended while a snapshot is taken.
+ */
+class ThreadStats_
+{
+    public:
+        ThreadStats_(void);
+        ~ThreadStats_();
+
+        std::atomic<unsigned long long> calls;
+        std::atomic<unsigned long long> bytes;
+        std::atomic<unsigned long long> parse_ns;
+        std::atomic<unsigned long long> total_ns;
+        std::atomic<unsigned long long> heap_fallbacks;
+        std::atomic<unsigned long long> exceptions;
+
+        std::mutex mutex;
+        SiteMap_ sites;
+
+
+        //! Record a call
+        void record(const char * fmt, size_t len, unsigned long long nbytes,
+                    unsigned long long nparse, unsigned long long ntotal)
+        {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(nbytes, std::memory_order_relaxed);
+            total_ns.fetch_add(ntotal, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // The key is reused, so that looking up a format string does not allocate
+            key_.assign(fmt, len);
+            auto it = sites.find(key_);
+            if(it == sites.end())
+                it = sites.emplace(key_, SiteCounters_{ 0, 0, 0, 0 }).first;
+
+            it->second.calls++;
+            it->second.bytes += nbytes;
+            it->second.parse_ns += nparse;
+            it->second.total_ns += ntotal;
+        }
+
+
+        //! Add the counters to a snapshot
+        void add_to(FormatStats & s, SiteMap_ & ssites)
+        {
+            s.calls += calls.load(std::memory_order_relaxed);
+            s.bytes += bytes.load(std::memory_order_relaxed);
+            s.parse_ns += parse_ns.load(std::memory_order_relaxed);
+            s.total_ns += total_ns.load(std::memory_order_relaxed);
+            s.heap_fallbacks += heap_fallbacks.load(std::memory_order_relaxed);
+            s.exceptions += exceptions.load(std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for(const auto & site : sites)
+                add_site_(ssites, site.first, site.second);
+        }
+
+
+        //! Reset the counters to zero
+        void reset(void)
+        {
+            calls.store(0, std::memory_order_relaxed);
+            bytes.store(0, std::memory_order_relaxed);
+            parse_ns.store(0, std::memory_order_relaxed);
+            total_ns.store(0, std::memory_order_relaxed);
+            heap_fallbacks.store(0, std::memory_order_relaxed);
+            exceptions.store(0, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sites.clear();
+        }
+
+    private:
+        std::string key_;
+};
+
+
+/*! \brief All threads with counters
+ *
+ * The counters of threads that have exited are added to the
+ * retired totals.
+ */
+struct Registry_
+{
+    std::mutex mutex;
+    std::vector<ThreadStats_ *> threads;
+    FormatStats retired = empty_stats_();
+    SiteMap_ retired_sites;
+};
+
+
+Registry_ & registry_(void)
+{
+    static Registry_ registry;
+    return registry;
+}
+
+
+ThreadStats_::ThreadStats_(void)
+    : calls(0), bytes(0), parse_ns(0), total_ns(0), heap_fallbacks(0), exceptions(0)
+{
+    Registry_ & r = registry_();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threads.push_back(this);
+}
+
+
+ThreadStats_::~ThreadStats_()
+{
+    Registry_ & r = registry_();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    add_to(r.retired, r.retired_sites);
+    r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+
+ThreadStats_ & thread_stats_(void)
+{
+    static thread_local ThreadStats_ stats;
+    return stats;
+}
+
+
+//! Convert a snapshot of the counters for each format string, most calls first
+void finish_snapshot_(FormatStats & s, const SiteMap_ & sites)
+{
+    s.sites.reserve(sites.size());
+    for(const auto & site : sites)
+    {
+        const SiteCounters_ & c = site.second;
+        s.sites.push_back(FormatSiteStats{ site.first, c.calls, c.bytes, c.parse_ns, c.total_ns });
+    }
+
+    std::sort(s.sites.begin(), s.sites.end(),
+              [](const FormatSiteStats & a, const FormatSiteStats & b) { return a.calls > b.calls; });
+}
+
+#endif
+
+} // close anonymous namespace
+
+
+
+#ifdef BPPRINT_STATS
+
+CallStats_::CallStats_(const OutputBuffer & out, const char * fmt, size_t len) noexcept
+    : out_(out), fmt_(fmt), len_(len), start_size_(out.size()),
+      start_ns_(now_ns_()), start_parse_ns_(thread_stats_().parse_ns.load(std::memory_order_relaxed))
+{ }
+
+
+CallStats_::~CallStats_()
+{
+    ThreadStats_ & ts = thread_stats_();
+    const size_t end_size = out_.size();
+
+    // Buffers that write their contents elsewhere may have been emptied
+    ts.record(fmt_, len_, end_size > start_size_ ? end_size - start_size_ : 0,
+              ts.parse_ns.load(std::memory_order_relaxed) - start_parse_ns_,
+              now_ns_() - start_ns_);
+}
+
+
+ParseStats_::ParseStats_(void) noexcept
+    : start_ns_(now_ns_())
+{ }
+
+
+ParseStats_::~ParseStats_()
+{
+    thread_stats_().parse_ns.fetch_add(now_ns_() - start_ns_, std::memory_order_relaxed);
+}
+
+
+void count_heap_fallback_(void) noexcept
+{
+    thread_stats_().heap_fallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void count_exception_(void) noexcept
+{
+    thread_stats_().exceptions.fetch_add(1, std::memory_order_relaxed);
+}
+
+#endif
+
+
+} // close namespace detail
+
+
+
+FormatStats format_stats(void)
+{
+    FormatStats s = detail::empty_stats_();
+
+#ifdef BPPRINT_STATS
+    detail::Registry_ & r = detail::registry_();
+    detail::SiteMap_ sites;
+
+    std::lock_guard<std::mutex> lock(r.mutex);
+    s = r.retired;
+    sites = r.retired_sites;
+    for(detail::ThreadStats_ * ts : r.threads)
+        ts->add_to(s, sites);
+
+    detail::finish_snapshot_(s, sites);
+#endif
+
+    return s;
+}
+
+
+FormatStats thread_format_stats(void)
+{
+    FormatStats s = detail::empty_stats_();
+
+#ifdef BPPRINT_STATS
+    detail::SiteMap_ sites;
+    detail::thread_stats_().add_to(s, sites);
+    detail::finish_snapshot_(s, sites);
+#endif
+
+    return s;
+}
+
+
+void reset_format_stats(void)
+{
+#ifdef BPPRINT_STATS
+    detail::Registry_ & r = detail::registry_();
+
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.retired = detail::empty_stats_();
+    r.retired_sites.clear();
+    for(detail::ThreadStats_ * ts : r.threads)
+        ts->reset();
+#endif
+}
+
+
+void write_format_stats(std::ostream & os, const FormatStats & stats, size_t max_sites)
+{
+    char line[256];
+
+    snprintf(line, sizeof(line), "bpprint: %llu calls, %llu bytes, %llu heap fallbacks, %llu exceptions\n",
+             stats.calls, stats.bytes, stats.heap_fallbacks, stats.exceptions);
+    os << line;
+
+    snprintf(line, sizeof(line), "bpprint: %.3f ms total, %.3f ms parsing, %.3f ms converting\n",
+             static_cast<double>(stats.total_ns) / 1e6, static_cast<double>(stats.parse_ns) / 1e6,
+             static_cast<double>(stats.convert_ns()) / 1e6);
+    os << line;
+
+    if(stats.sites.empty())
+        return;
+
+    snprintf(line, sizeof(line), "%12s %14s %10s %10s  %s\n", "calls", "bytes", "ns/call", "parse ns", "format");
+    os << line;
+
+    const size_t n = std::min(max_sites, stats.sites.size());
+    for(size_t i = 0; i < n; i++)
+    {
+        const FormatSiteStats & site = stats.sites[i];
+
+        // Control characters (usually newlines) are escaped, and long formats shortened
+        std::string fmt;
+        for(char c : site.format)
+        {
+            if(c == '\n')
+                fmt += "\\n";
+            else if(c == '\t')
+                fmt += "\\t";
+            else
+                fmt += (static_cast<unsigned char>(c) < 0x20) ? '?' : c;
+        }
+        if(fmt.size() > 60)
+            fmt = fmt.substr(0, 57) + "...";
+
+        snprintf(line, sizeof(line), "%12llu %14llu %10.1f %10.1f  \"%s\"\n",
+                 site.calls, site.bytes,
+                 static_cast<double>(site.total_ns) / static_cast<double>(site.calls),
+                 static_cast<double>(site.parse_ns) / static_cast<double>(site.calls),
+                 fmt.c_str());
+        os << line;
+    }
+
+    if(n < stats.sites.size())
+        os << "    (" << stats.sites.size() - n << " more)\n";
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bpprint/OutputBuffer.hpp"
+
+/*! \file
+ *
+ * Statistics about formatting
+ *
+ * If bpprint is built with BPPRINT_STATS defined (see the BPPRINT_STATS
+ * CMake option), each call of the formatting functions is counted, in
+ * counters kept by each thread: the number of calls and characters
+ * written, and the time taken, split into decoding the format string
+ * and converting the arguments. These are also kept for each format
+ * string. Conversions too long for the stack buffer used with snprintf
+ * (which then go through the output buffer, possibly growing it), and
+ * format_error exceptions, are counted as well.
+ *
+ * Calls of format_to(), try_format_to(), format_string() and
+ * format_stream() are counted with any kind of format string (and so
+ * are the functions using them, such as format_to_n() and format_fd()).
+ * Batches and the loggers are not counted.
+ *
+ * Without BPPRINT_STATS, nothing is instrumented, so there is no
+ * overhead, and the functions here report empty statistics.
+ */
+
+namespace bpprint {
+
+
+/*! \brief Statistics for a single format string */
+struct FormatSiteStats
+{
+    std::string format;          //!< The format string
+    unsigned long long calls;    //!< Number of calls
+    unsigned long long bytes;    //!< Characters written
+    unsigned long long parse_ns; //!< Time spent decoding the format string (nanoseconds)
+    unsigned long long total_ns; //!< Total time spent in the calls (nanoseconds)
+};
+
+
+/*! \brief A snapshot of the statistics */
+struct FormatStats
+{
+    unsigned long long calls;          //!< Number of calls
+    unsigned long long bytes;          //!< Characters written
+    unsigned long long parse_ns;       //!< Time spent decoding format strings, including compiling them (nanoseconds)
+    unsigned long long total_ns;       //!< Total time spent in the calls (nanoseconds)
+    unsigned long long heap_fallbacks; //!< Conversions too long for the stack buffer
+    unsigned long long exceptions;     //!< format_error exceptions thrown
+
+    //! Statistics for each format string, with the most calls first
+    std::vector<FormatSiteStats> sites;
+
+    //! Time spent converting arguments and writing literal text (nanoseconds)
+    unsigned long long convert_ns(void) const noexcept
+    {
+        return total_ns > parse_ns ? total_ns - parse_ns : 0;
+    }
+};
+
+
+/*! \brief Was bpprint built with statistics? */
+constexpr bool format_stats_enabled(void) noexcept
+{
+#ifdef BPPRINT_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/*! \brief Get the statistics of all threads
+ *
+ * This includes threads that have exited. Calls in progress on other
+ * threads may or may not be included.
+ */
+FormatStats format_stats(void);
+
+
+/*! \brief Get the statistics of the calling thread */
+FormatStats thread_format_stats(void);
+
+
+/*! \brief Reset the statistics of all threads */
+void reset_format_stats(void);
+
+
+/*! \brief Write a summary of statistics, as text
+ *
+ * \param [in] os Where to write the summary
+ * \param [in] stats The statistics (from format_stats() or thread_format_stats())
+ * \param [in] max_sites The maximum number of format strings to list
+ */
+void write_format_stats(std::ostream & os, const FormatStats & stats, size_t max_sites = 20);
+
+
+
+#ifdef BPPRINT_STATS
+namespace detail {
+
+
+/*! \brief Counts a single call, for the lifetime of the object
+ *
+ * The time and the characters written to the output are recorded
+ * when the object is destroyed (including by an exception).
+ */
+class CallStats_
+{
+    public:
+        /*! \brief Start counting a call
+         *
+         * \param [in] out The output buffer of the call
+         * \param [in] fmt The format string (which must outlive this object)
+         * \param [in] len The length of \p fmt
+         */
+        CallStats_(const OutputBuffer & out, const char * fmt, size_t len) noexcept;
+
+        ~CallStats_();
+
+        CallStats_(const CallStats_ &) = delete;
+        CallStats_ & operator=(const CallStats_ &) = delete;
+
+    private:
+        const OutputBuffer & out_;
+        const char * fmt_;
+        size_t len_;
+        size_t start_size_;
+        unsigned long long start_ns_;
+        unsigned long long start_parse_ns_;
+};
+
+
+/*! \brief Counts the time spent decoding a format string, for the lifetime of the object */
+class ParseStats_
+{
+    public:
+        ParseStats_(void) noexcept;
+        ~ParseStats_();
+
+        ParseStats_(const ParseStats_ &) = delete;
+        ParseStats_ & operator=(const ParseStats_ &) = delete;
+
+    private:
+        unsigned long long start_ns_;
+};
+
+
+//! Count a conversion too long for the stack buffer
+void count_heap_fallback_(void) noexcept;
+
+
+//! Count a format_error exception
+void count_exception_(void) noexcept;
+
+
+} // close namespace detail
+#endif
+
+
+} // close namespace bpprint
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <ostream>
+#include <tuple>
+
+#include "bpprint/StaticFormat.hpp"
+
+/*! \file
+ *
+ * Deferred formatting
+ *
+ * bpprint::lazy() captures a format string and its arguments without
+ * formatting them. Formatting happens only if the result is actually
+ * used (streamed, or converted to a string). This is useful for
+ * messages that are usually discarded, such as debug output.
+ */
+
+namespace bpprint {
+
+
+/*! \brief A format string and arguments that have not been formatted yet
+ *
+ * The arguments are captured by reference, so the object must be used
+ * before they go out of scope. Usually, it is created and used in the
+ * same expression (for example, passed directly to a logging function).
+ *
+ * Objects are created with bpprint::lazy().
+ *
+ * \tparam FmtRef How the format string is stored (a pointer or a reference)
+ * \tparam Targs Types of the arguments
+ */
+template<typename FmtRef, typename... Targs>
+class LazyFormat
+{
+    public:
+        static_assert(detail::ValidPrintfArgs<Targs...>::value,
+                      "Invalid argument type passed to Format");
+
+
+        LazyFormat(const FmtRef & fmt, const Targs &... args) noexcept
+            : fmt_(fmt), args_(args...)
+        { }
+
+
+        /*! \brief Format, appending the output to a buffer
+         *
+         * \throw std::runtime_error if the correct number of arguments is not given or
+         *        if the format string is badly formed
+         */
+        void format_to(OutputBuffer & out) const
+        {
+            format_to_(out, typename detail::MakeIndices<sizeof...(Targs)>::type());
+        }
+
+
+        /*! \brief Format into a string
+         *
+         * \throw std::runtime_error if the correct number of arguments is not given or
+         *        if the format string is badly formed
+         */
+        std::string str(void) const
+        {
+            MemoryBuffer buf;
+            format_to(buf);
+            return buf.str();
+        }
+
+
+        /*! \brief Format into a string */
+        operator std::string(void) const { return str(); }
+
+
+    private:
+        FmtRef fmt_;
+        std::tuple<const Targs &...> args_;
+
+        template<size_t... I>
+        void format_to_(OutputBuffer & out, detail::Indices<I...>) const
+        {
+            ::bpprint::format_to(out, fmt_, std::get<I>(args_)...);
+        }
+};
+
+
+/*! \brief Format and output a deferred format to a stream */
+template<typename FmtRef, typename... Targs>
+std::ostream & operator<<(std::ostream & os, const LazyFormat<FmtRef, Targs...> & lf)
+{
+    MemoryBuffer buf;
+    lf.format_to(buf);
+    return os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+
+
+/*! \brief Capture a C string format and its arguments for later formatting
+ *
+ * The arguments are checked against ValidPrintfArg, but are otherwise
+ * not examined until the result is used.
+ *
+ * \param [in] fmt The format string (usually a string literal)
+ * \param [in] args Arguments to the format string (captured by reference)
+ */
+template<typename... Targs>
+LazyFormat<const char *, Targs...> lazy(const char * fmt, const Targs &... args) noexcept
+{
+    return LazyFormat<const char *, Targs...>(fmt, args...);
+}
+
+
+namespace detail {
+
+//! Compile-time format strings are empty objects, and are stored by value
+template<typename Fmt>
+using LazyFmtRef_ = typename std::conditional<std::is_base_of<StaticFormatBase, Fmt>::value,
+                                              Fmt, const Fmt &>::type;
+
+} // close namespace detail
+
+
+/*! \brief Capture a format and its arguments for later formatting
+ *
+ * Overload for std::string and CompiledFormat format strings (which are
+ * captured by reference), and BPPRINT_FMT format strings.
+ *
+ * \param [in] fmt The format string
+ * \param [in] args Arguments to the format string (captured by reference)
+ */
+template<typename Fmt, typename... Targs>
+LazyFormat<detail::LazyFmtRef_<Fmt>, Targs...> lazy(const Fmt & fmt, const Targs &... args) noexcept
+{
+    return LazyFormat<detail::LazyFmtRef_<Fmt>, Targs...>(fmt, args...);
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace bpprint {
+
+namespace detail { class CallDepth_; }
+
+
+/*! \brief A contiguous buffer that formatted output is written to
+ *
+ * This is the base class for the various buffers. It keeps track of
+ * the number of characters written, and derived classes decide
+ * how (or if) the storage grows when it becomes full.
+ *
+ * If the storage cannot grow, output beyond the capacity is
+ * discarded, but is still counted by size().
+ */
+class OutputBuffer
+{
+    public:
+        OutputBuffer(const OutputBuffer &) = delete;
+        OutputBuffer & operator=(const OutputBuffer &) = delete;
+
+
+        /*! \brief Append characters to the buffer
+         *
+         * \param [in] s The characters to append
+         * \param [in] n The number of characters to append
+         */
+        void append(const char * s, size_t n)
+        {
+            if(size_ + n > capacity_)
+                grow_(size_ + n);
+
+            if(size_ < capacity_)
+                memcpy(data_ + size_, s, (n < capacity_ - size_) ? n : capacity_ - size_);
+
+            size_ += n;
+        }
+
+
+        /*! \brief Append a string to the buffer */
+        void append(const std::string & s)
+        {
+            append(s.data(), s.size());
+        }
+
+
+        /*! \brief Append literal text from a format string
+         *
+         * This is the same as append(), except for buffers that keep
+         * literal text by reference rather than copying it (see FdSink).
+         */
+        void append_literal(const char * s, size_t n)
+        {
+            if(literal_refs_)
+                literal_ref_(s, n);
+            else
+                append(s, n);
+        }
+
+
+        /*! \brief Append literal text from a format string */
+        void append_literal(const std::string & s)
+        {
+            append_literal(s.data(), s.size());
+        }
+
+
+        /*! \brief Append \p n copies of the character \p c */
+        void append(size_t n, char c)
+        {
+            if(size_ + n > capacity_)
+                grow_(size_ + n);
+
+            if(size_ < capacity_)
+                memset(data_ + size_, c, (n < capacity_ - size_) ? n : capacity_ - size_);
+
+            size_ += n;
+        }
+
+
+        /*! \brief Append a single character to the buffer */
+        void push_back(char c)
+        {
+            if(size_ + 1 > capacity_)
+                grow_(size_ + 1);
+
+            if(size_ < capacity_)
+                data_[size_] = c;
+
+            size_++;
+        }
+
+
+        /*! \brief Make room for at least \p n more characters
+         *
+         * The characters can then be written directly to the returned
+         * pointer, and added to the output with commit().
+         *
+         * \return Where the next characters are to be written, or nullptr if
+         *         the buffer could not grow enough
+         */
+        char * reserve(size_t n)
+        {
+            if(size_ + n > capacity_)
+                grow_(size_ + n);
+
+            return (size_ + n <= capacity_) ? data_ + size_ : nullptr;
+        }
+
+
+        /*! \brief Add \p n characters written directly to the buffer
+         *
+         * The characters must have been written to the space
+         * after the current output (see reserve() and available()).
+         */
+        void commit(size_t n) noexcept { size_ += n; }
+
+
+        /*! \brief Number of characters that can be written without growing */
+        size_t available(void) const noexcept
+        {
+            return (size_ < capacity_) ? capacity_ - size_ : 0;
+        }
+
+
+        /*! \brief Number of characters written
+         *
+         * This may be larger than capacity() if the buffer
+         * could not grow.
+         */
+        size_t size(void) const noexcept { return size_; }
+
+
+        /*! \brief Number of characters that can be stored */
+        size_t capacity(void) const noexcept { return capacity_; }
+
+
+        /*! \brief Is output only counted, and never stored?
+         *
+         * Conversions may then compute the length of their output
+         * without producing it (see CountingBuffer).
+         */
+        bool count_only(void) const noexcept { return count_only_; }
+
+
+        /*! \brief Is there room for one more character after the capacity?
+         *
+         * Buffers that cannot grow may have storage for a null terminator
+         * past their capacity. Conversions may write there temporarily
+         * (see FixedBuffer).
+         */
+        bool spare_byte(void) const noexcept { return spare_byte_; }
+
+
+        /*! \brief Was any output discarded? */
+        bool truncated(void) const noexcept { return size_ > capacity_; }
+
+
+        /*! \brief Pointer to the stored characters
+         *
+         * The data is not null-terminated.
+         */
+        const char * data(void) const noexcept { return data_; }
+
+
+        /*! \brief Copy the stored characters into a string */
+        std::string str(void) const
+        {
+            return std::string(data_, truncated() ? capacity_ : size_);
+        }
+
+
+        /*! \brief Discard all but the first \p n characters
+         *
+         * \p n must not be larger than size()
+         */
+        void resize(size_t n) noexcept { size_ = n; }
+
+
+        /*! \brief Remove all characters (but keep the storage) */
+        void clear(void) noexcept { size_ = 0; }
+
+
+    protected:
+        friend class detail::CallDepth_;
+
+        OutputBuffer(char * data, size_t capacity) noexcept
+            : data_(data), size_(0), capacity_(capacity), literal_refs_(false), count_only_(false),
+              spare_byte_(false)
+        { }
+
+        ~OutputBuffer() = default;
+
+
+        /*! \brief Try to increase the capacity to at least \p needed
+         *
+         * Derived classes that cannot grow do nothing.
+         */
+        virtual void grow_(size_t needed) = 0;
+
+
+        /*! \brief Keep a reference to literal text instead of copying it
+         *
+         * Only called if literal_refs_ is set.
+         */
+        virtual void literal_ref_(const char *, size_t) { }
+
+
+        /*! \brief A formatting call writing to this buffer starts
+         *
+         * Only called if literal_refs_ is set. Calls nest when the
+         * formatter of an argument formats to the same buffer.
+         */
+        virtual void begin_call_(void) { }
+
+
+        /*! \brief A formatting call writing to this buffer ends
+         *
+         * Only called if literal_refs_ is set.
+         */
+        virtual void end_call_(void) { }
+
+        char * data_;
+        size_t size_;
+        size_t capacity_;
+
+        //! If true, literal text is passed to literal_ref_ rather than appended
+        bool literal_refs_;
+
+        //! If true, there is no storage, and the buffer never grows
+        bool count_only_;
+
+        //! If true, data_[capacity_] may be written temporarily
+        bool spare_byte_;
+};
+
+
+namespace detail {
+
+/*! \brief Marks a formatting call writing to a buffer, for the lifetime of the object
+ *
+ * Buffers that keep literal text by reference use this to tell the
+ * outermost call (whose format string outlives the output) from calls
+ * nested inside the formatters of its arguments.
+ */
+class CallDepth_
+{
+    public:
+        explicit CallDepth_(OutputBuffer & out)
+            : out_(out.literal_refs_ ? &out : nullptr)
+        {
+            if(out_ != nullptr)
+                out_->begin_call_();
+        }
+
+        ~CallDepth_()
+        {
+            if(out_ != nullptr)
+                out_->end_call_();
+        }
+
+        CallDepth_(const CallDepth_ &) = delete;
+        CallDepth_ & operator=(const CallDepth_ &) = delete;
+
+    private:
+        OutputBuffer * out_;
+};
+
+} // close namespace detail
+
+
+
+/*! \brief A growable output buffer with inline storage
+ *
+ * The first \p N characters are stored within the object itself
+ * (typically on the stack). Beyond that, storage is allocated on
+ * the heap.
+ *
+ * \tparam N Number of characters stored inline
+ */
+template<size_t N>
+class BasicMemoryBuffer : public OutputBuffer
+{
+    public:
+        BasicMemoryBuffer(void) noexcept : OutputBuffer(inline_, N) { }
+
+        ~BasicMemoryBuffer()
+        {
+            if(data_ != inline_)
+                delete [] data_;
+        }
+
+
+    protected:
+        void grow_(size_t needed) override
+        {
+            size_t newcap = capacity_ + capacity_/2;
+            if(newcap < needed)
+                newcap = needed;
+
+            char * newdata = new char[newcap];
+            memcpy(newdata, data_, size_);
+
+            if(data_ != inline_)
+                delete [] data_;
+
+            data_ = newdata;
+            capacity_ = newcap;
+        }
+
+
+    private:
+        char inline_[N];
+};
+
+
+//! Memory buffer with the default amount of inline storage
+typedef BasicMemoryBuffer<500> MemoryBuffer;
+
+
+
+/*! \brief A growable output buffer whose storage comes from an allocator
+ *
+ * Like BasicMemoryBuffer, but storage beyond the first \p N characters is
+ * obtained from \p Alloc (rebound to char) rather than the global heap.
+ * This allows output to be placed in an Arena or a pool.
+ *
+ * \tparam Alloc A standard allocator type
+ * \tparam N Number of characters stored inline
+ */
+template<typename Alloc, size_t N = 500>
+class BasicAllocatorBuffer : public OutputBuffer
+{
+    public:
+        typedef typename std::allocator_traits<Alloc>::template rebind_alloc<char> allocator_type;
+
+        explicit BasicAllocatorBuffer(const Alloc & alloc = Alloc())
+            : OutputBuffer(inline_, N), alloc_(alloc)
+        { }
+
+        ~BasicAllocatorBuffer()
+        {
+            if(data_ != inline_)
+                traits_::deallocate(alloc_, data_, capacity_);
+        }
+
+        BasicAllocatorBuffer(const BasicAllocatorBuffer &) = delete;
+        BasicAllocatorBuffer & operator=(const BasicAllocatorBuffer &) = delete;
+
+
+        //! The allocator used for storage
+        const allocator_type & get_allocator(void) const noexcept { return alloc_; }
+
+
+    protected:
+        void grow_(size_t needed) override
+        {
+            size_t newcap = capacity_ + capacity_/2;
+            if(newcap < needed)
+                newcap = needed;
+
+            char * newdata = traits_::allocate(alloc_, newcap);
+            memcpy(newdata, data_, size_);
+
+            if(data_ != inline_)
+                traits_::deallocate(alloc_, data_, capacity_);
+
+            data_ = newdata;
+            capacity_ = newcap;
+        }
+
+
+    private:
+        typedef std::allocator_traits<allocator_type> traits_;
+
+        allocator_type alloc_;
+        char inline_[N];
+};
+
+
+//! Allocator buffer with the default amount of inline storage
+template<typename Alloc>
+using AllocatorBuffer = BasicAllocatorBuffer<Alloc>;
+
+
+
+/*! \brief An output buffer wrapping fixed, caller-provided storage
+ *
+ * Output beyond the capacity is discarded, and memory is never allocated.
+ * A conversion done by snprintf that is cut off by the end of the storage
+ * needs room for one more character, which may be a spare byte past the
+ * capacity (for example, for a null terminator). Otherwise, the end of
+ * any earlier output is borrowed and restored. A conversion at the very
+ * start of storage without a spare byte is padded separately from
+ * snprintf, and fails with FormatErrc::ConversionFailed if it is cut off
+ * after more than 4095 characters without its padding.
+ */
+class FixedBuffer final : public OutputBuffer
+{
+    public:
+        /*! \brief Wrap existing storage
+         *
+         * \param [in] data Where to store the output
+         * \param [in] capacity The number of characters that can be stored in \p data
+         * \param [in] spare_byte If true, \p data has room for one more character
+         *                        after \p capacity, which may be overwritten
+         */
+        FixedBuffer(char * data, size_t capacity, bool spare_byte = false) noexcept
+            : OutputBuffer(data, capacity)
+        {
+            spare_byte_ = spare_byte;
+        }
+
+
+    protected:
+        void grow_(size_t) override { }
+};
+
+
+
+/*! \brief An output buffer that only counts the characters written
+ *
+ * Nothing is stored, and conversions skip producing their output where
+ * they can compute its length directly (such as the digits of an integer).
+ */
+class CountingBuffer final : public OutputBuffer
+{
+    public:
+        CountingBuffer(void) noexcept
+            : OutputBuffer(nullptr, 0)
+        {
+            count_only_ = true;
+        }
+
+
+    protected:
+        void grow_(size_t) override { }
+};
+
+
+} // close namespace bpprint
@@ -1,109 +1,182 @@
 #include <string>
 #include <cstring>
-#include <stdexcept>
-#include <typeinfo>
 #include <memory>
+#include <algorithm>
 
-#include "bpprint/Printf_wrap.hpp"
+#include "bpprint/Convert.hpp"
+#include "bpprint/FormatStats.hpp"
 
 
 namespace bpprint {
 namespace detail {
 
-// Mapping of basic types to their printf specifiers
-template<typename T> struct PFTypeMap { };
-
-#define DECLARE_PFTYPE(t, cast, length, pft) template<> struct PFTypeMap<t> { \
-         static constexpr const char * pflength = length; \
-         static constexpr const char * pftype = pft; \
-         typedef cast cast_type; \
-       };
-
-
-DECLARE_PFTYPE(bool,               int,                 "",    "d")
-DECLARE_PFTYPE(char,               char,                "",    "c")
-
-DECLARE_PFTYPE(signed char,        signed char,         "hh",  "d")
-DECLARE_PFTYPE(signed short,       signed short,        "h",   "d")
-DECLARE_PFTYPE(signed int,         signed int,          "",    "d")
-DECLARE_PFTYPE(signed long,        signed long,         "l",   "d")
-DECLARE_PFTYPE(signed long long,   signed long long,    "ll",  "d")
-DECLARE_PFTYPE(unsigned char,      unsigned char,       "hh",  "uoxX")
-DECLARE_PFTYPE(unsigned short,     unsigned short,      "h",   "uoxX")
-DECLARE_PFTYPE(unsigned int,       unsigned int,        "",    "uoxX")
-DECLARE_PFTYPE(unsigned long,      unsigned long,       "l",   "uoxX")
-DECLARE_PFTYPE(unsigned long long, unsigned long long,  "ll",  "uoxX")
-
-DECLARE_PFTYPE(float,            double, "",  "fFeEaAgG")
-DECLARE_PFTYPE(double,           double, "",  "fFeEaAgG")
-DECLARE_PFTYPE(long double, long double, "L", "fFeEaAgG")
-
-DECLARE_PFTYPE(const char *, const char *, "", "s")
-DECLARE_PFTYPE(char *,       char *,       "", "s")
-DECLARE_PFTYPE(std::string,  std::string,  "", "s")
-
-DECLARE_PFTYPE(const void *, const void *, "", "p")
-DECLARE_PFTYPE(void *,       void *,       "", "p")
-
-
-
-
-/*! \brief Handles substitution of a single specifier
- *
- * This takes a string containing a single format specifier
- * and substitutes in the value. By this point, the type
- * should already have been checked against the type specifier
- * of the format.
- *
- * \throw std::runtime_error If there is a problem with the substitution
- *
- * \tparam T The type of data to substitute with
- *
- * \param [inout] fmt String with a single format specifier. Will
- *                    be replaced with the formatted string
- * \param [in] subst What to put in place of the specifier
- */
+// Write a conversion that does not fit in fixed storage, and that
+// starts at the beginning of it (so there is no byte before the output
+// that snprintf can borrow). The conversion is done without its width
+// into a stack buffer, and padded here.
 template<typename T>
-void handle_fmt_single_(std::string & fmt, T subst)
+FormatErrc handle_fmt_start_truncated_(OutputBuffer & out, const char * fmt, T subst)
 {
-    static const int bufsize = 256;
+    static const size_t bufsize = 4096;
+
+    // fmt is "%[flags][width][.precision][length]spec"
+    bool minus = false, zero = false;
+    char flags[6];
+    size_t nflags = 0;
+    const char * p = fmt + 1;
+    for(; *p != '\0' && strchr("-+ #0", *p) != nullptr; p++)
+    {
+        minus = minus || (*p == '-');
+        zero = zero || (*p == '0');
+        if(memchr(flags, *p, nflags) == nullptr)
+            flags[nflags++] = *p;
+    }
+
+    size_t width = 0;
+    for(; *p >= '0' && *p <= '9'; p++)
+        width = width*10 + static_cast<size_t>(*p - '0');
+
+    // The same format without the width
+    char ufmt[64];
+    const size_t nrest = strlen(p);
+    if(nflags + nrest + 2 > sizeof(ufmt))
+        return FormatErrc::ConversionFailed;
+    ufmt[0] = '%';
+    memcpy(ufmt + 1, flags, nflags);
+    memcpy(ufmt + 1 + nflags, p, nrest + 1);
+
+    char buf[bufsize];
+    const int n = snprintf(buf, bufsize, ufmt, subst);
+    if(n < 0)
+        return FormatErrc::ConversionFailed;
+
+    const size_t ulen = static_cast<size_t>(n);
+    const size_t npad = (width > ulen) ? width - ulen : 0;
+
+    // Where the padding goes, and what it is made of. Zeros follow any sign
+    // or base, and are not used for integers with a precision, or for
+    // infinity and NaN.
+    const char spec = p[nrest - 1];
+    const bool is_int = (strchr("diouxX", spec) != nullptr);
+    const bool has_prec = (strchr(p, '.') != nullptr);
+    size_t at = 0;
+    char pad = ' ';
+
+    if(minus)
+        at = ulen;
+    else if(zero && strchr("diouxXaAeEfFgG", spec) != nullptr && !(is_int && has_prec))
+    {
+        if(ulen > 0 && strchr("+- ", buf[0]) != nullptr)
+            at = 1;
+        if(ulen > at + 1 && buf[at] == '0' && (buf[at+1] == 'x' || buf[at+1] == 'X'))
+            at += 2;
+        if(ulen == at || strchr("iInN", buf[at]) == nullptr)
+            pad = '0';
+        else
+            at = 0;
+    }
+
+    // Only what fits in the output is needed from the stack buffer
+    const size_t avail = out.available();
+    const size_t needed = (at + npad >= avail) ? std::min(at, avail)
+                                              : std::min(ulen, avail - npad);
+    if(needed >= bufsize)
+        return FormatErrc::ConversionFailed;
+
+    out.append(buf, at);
+    out.append(npad, pad);
+    out.append(buf + at, ulen - at);
+    return FormatErrc::Ok;
+}
+
+
+template<typename T>
+FormatErrc handle_fmt_single_(OutputBuffer & out, const char * fmt, T subst)
+{
+    static const size_t bufsize = 256;
+
+    // Only the length is needed
+    if(out.count_only())
+    {
+        const int n = snprintf(nullptr, 0, fmt, subst);
+        if(n < 0)
+            return FormatErrc::ConversionFailed;
+        out.commit(static_cast<size_t>(n));
+        return FormatErrc::Ok;
+    }
 
     // should be fine for most substitutions
     char buf[bufsize];
 
-    // Try to write to the buffer
-    const int n = snprintf(buf, bufsize, fmt.c_str(), subst);
+    // Write directly to the output buffer if there is room,
+    // otherwise to the stack buffer
+    const size_t avail = out.available();
+    char * dest = (avail >= bufsize) ? out.reserve(0) : buf;
+    const size_t destsize = (avail >= bufsize) ? avail : bufsize;
+
+    const int n = snprintf(dest, destsize, fmt, subst);
+    if(n < 0)
+        return FormatErrc::ConversionFailed;
 
-    // If the return value is >= bufsize, then the buffer wasn't
-    // big enough. Then we use heap allocation
-    if(n >= bufsize)
+    const size_t len = static_cast<size_t>(n);
+
+    if(len < destsize)
     {
-        const int neededsize = n+1; // includes null termination
+        if(dest == buf)
+            out.append(buf, len);
+        else
+            out.commit(len);
+        return FormatErrc::Ok;
+    }
 
-        std::unique_ptr<char> hbuf(new char[static_cast<size_t>(neededsize)]);
-        char * hbufp = hbuf.get();
+    // Not enough room. Make room in the output buffer (which
+    // includes the null termination) and format directly into it
+#ifdef BPPRINT_STATS
+    count_heap_fallback_();
+#endif
+    char * p = out.reserve(len+1);
 
-        const int n2 = snprintf(hbufp, static_cast<size_t>(neededsize),
-                                fmt.c_str(), subst);
+    if(p != nullptr)
+    {
+        snprintf(p, len+1, fmt, subst);
+        out.commit(len);
+        return FormatErrc::Ok;
+    }
 
-        // these two conditions signal success
-        if(n2 >= 0 && n2 < neededsize)
-            fmt = std::string(hbufp); // copies to the output
+    // The output buffer cannot grow, so the output will be truncated.
+    // If the stack buffer was used, it holds everything that fits.
+    if(dest == buf)
+    {
+        out.append(buf, len);
+        return FormatErrc::Ok;
+    }
 
-        if(n2 < 0 || n2 >= neededsize)
-            throw std::runtime_error(std::string("Error here: ") +
-                                     std::to_string(n2));
+    // Otherwise, the null written by snprintf replaced the last character
+    // that fits. Format again, with the null in the spare byte if there is one,
+    if(out.spare_byte())
+    {
+        snprintf(dest, avail+1, fmt, subst);
+        out.commit(len);
+        return FormatErrc::Ok;
     }
-    else
-        fmt = std::string(buf);
+
+    // or else one byte earlier, over the end of the previous output
+    // (which is restored after moving the conversion into place).
+    if(out.size() == 0)
+        return handle_fmt_start_truncated_(out, fmt, subst);
+
+    const char prev = dest[-1];
+    snprintf(dest-1, avail+1, fmt, subst);
+    memmove(dest, dest-1, avail);
+    dest[-1] = prev;
+    out.commit(len);
+    return FormatErrc::Ok;
 }
 
 
 
 template<typename T>
-void handle_fmt_(std::string & fmt,
-                 const char * length,
-                 char spec, T subst)
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, T subst)
 {
     typedef typename std::remove_reference<T>::type noref_T; 
     typedef typename std::remove_cv<noref_T>::type nocv_T; 
@@ -112,82 +185,125 @@ void handle_fmt_(std::string & fmt,
     typedef typename PFTypeMap<actual_T>::cast_type cast_type;
     const char * pftype  = PFTypeMap<actual_T>::pftype;
     const char * pflength = PFTypeMap<actual_T>::pflength;
-    const char * mangled_type = typeid(actual_T).name();
-
 
-    fmt.reserve(fmt.size() + 5);
+    const char * length = fs.length;
+    char spec = fs.spec;
 
-    if(strlen(length) == 0 && spec == '?') // auto deduction
+    if(length[0] == '\0' && spec == '?') // auto deduction
     {
-        fmt += pflength;
-        fmt += pftype[0];  // first type = default
+        length = pflength;
+        spec = pftype[0];  // first type = default
     }
     else
     {
         // given a length and type spec, is it valid?
         if(strcmp(length, pflength) != 0)
-        {
-            std::string errstr = "Bad length specifier ";
-            errstr += length;
-            errstr += " for type ";
-            errstr += mangled_type;
-            throw std::runtime_error(errstr);
-        }
+            return FormatErrc::BadLength;
 
         // see if spec occurs in pftype
         if(strchr(pftype, spec) == nullptr)
-        {
-            std::string errstr = "Bad type specifier ";
-            errstr += spec;
-            errstr += " for type ";
-            errstr += mangled_type;
-            throw std::runtime_error(errstr);
-        }
-
-        fmt += length;
-        fmt += spec;
+            return FormatErrc::BadType;
     }
 
-    handle_fmt_single_(fmt, static_cast<cast_type>(subst));
+    // Try to do the conversion ourselves
+    if(convert_native_(out, fs, spec, static_cast<cast_type>(subst)))
+        return FormatErrc::Ok;
+
+    // The complete format passed to printf. This is built on the
+    // stack unless the specification is unusually long.
+    const size_t nformat = fs.format.size();
+    const size_t nlength = strlen(length);
+    char sbuf[64];
+    std::unique_ptr<char[]> hbuf;
+    char * fmt = sbuf;
+    if(nformat + nlength + 2 > sizeof(sbuf))
+    {
+        hbuf.reset(new char[nformat + nlength + 2]);
+        fmt = hbuf.get();
+    }
+
+    memcpy(fmt, fs.format.data(), nformat);
+    memcpy(fmt + nformat, length, nlength);
+    fmt[nformat + nlength] = spec;
+    fmt[nformat + nlength + 1] = '\0';
+
+    return handle_fmt_single_(out, fmt, static_cast<cast_type>(subst));
 }
 
 
 // const char * , since we don't always want it to be %s
 // (ie, we might want it passed to %p)
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, const char * subst)
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, const char * subst)
 {
-    if(spec == 's' || spec == '?')
-        handle_fmt_<const char *>(fmt, length, spec, subst);
+    if(fs.spec == 's' || fs.spec == '?')
+        return handle_fmt_<const char *>(out, fs, subst);
     else
-        handle_fmt_<void const *>(fmt, length, spec, subst);
+        return handle_fmt_<void const *>(out, fs, subst);
 }
 
 
 // char * , since we don't always want it to be %s
 // (ie, we might want it passed to %p)
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, char * subst)
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, char * subst)
 {
-    handle_fmt_(fmt, length, spec, static_cast<const char *>(subst));
+    return handle_fmt_(out, fs, static_cast<const char *>(subst));
 }
 
 
 // std::string - for convenience
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, const std::string & subst)
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs,
+                       const std::string & subst)
+{
+    return handle_fmt_(out, fs, subst.c_str());
+}
+
+
+// StringRef - not null terminated, so never passed to printf
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs,
+                       const StringRef & subst)
+{
+    if(fs.length[0] != '\0')
+        return FormatErrc::BadLength;
+
+    if(fs.spec != 's' && fs.spec != '?')
+        return FormatErrc::BadType;
+
+    convert_string_(out, fs, subst.data(), subst.size());
+    return FormatErrc::Ok;
+}
+
+
+// User-defined types - no length, and the spec must be one of pftype
+FormatErrc check_user_spec_(const FormatSpec & fs, const char * pftype, char & spec) noexcept
 {
-    handle_fmt_(fmt, length, spec, subst.c_str());
+    if(fs.length[0] != '\0')
+        return FormatErrc::BadLength;
+
+    spec = fs.spec;
+    if(spec == '?')
+        spec = pftype[0];
+    else if(strchr(pftype, spec) == nullptr)
+        return FormatErrc::BadType;
+
+    return FormatErrc::Ok;
 }
 
+} // close namespace detail
+
+
+void write_field(OutputBuffer & out, const ConvSpec & cs, const char * s, size_t n)
+{
+    detail::convert_string_(out, cs, s, n);
+}
 
 
+namespace detail {
 /////////////////////////////////////////
 // Explicitly instantiate the templates
 // of handle_fmt_
 /////////////////////////////////////////
 #define DECLARE_TEMPLATE_FORMAT(type) \
-       template void handle_fmt_<type>(std::string &, const char *, char, type);
+       template FormatErrc handle_fmt_<type>(OutputBuffer &, const FormatSpec &, type);
 
 DECLARE_TEMPLATE_FORMAT(bool)
 DECLARE_TEMPLATE_FORMAT(char)
@@ -210,6 +326,32 @@ DECLARE_TEMPLATE_FORMAT(void const *)
 
 #undef DECLARE_TEMPLATE_FORMAT
 
+
+#define DECLARE_TEMPLATE_SINGLE(type) \
+       template FormatErrc handle_fmt_single_<type>(OutputBuffer &, const char *, type);
+
+DECLARE_TEMPLATE_SINGLE(int)
+DECLARE_TEMPLATE_SINGLE(char)
+DECLARE_TEMPLATE_SINGLE(unsigned char)
+DECLARE_TEMPLATE_SINGLE(signed char)
+DECLARE_TEMPLATE_SINGLE(unsigned short)
+DECLARE_TEMPLATE_SINGLE(signed short)
+DECLARE_TEMPLATE_SINGLE(unsigned int)
+DECLARE_TEMPLATE_SINGLE(unsigned long)
+DECLARE_TEMPLATE_SINGLE(signed long)
+DECLARE_TEMPLATE_SINGLE(unsigned long long)
+DECLARE_TEMPLATE_SINGLE(signed long long)
+
+DECLARE_TEMPLATE_SINGLE(double)
+DECLARE_TEMPLATE_SINGLE(long double)
+
+DECLARE_TEMPLATE_SINGLE(const char *)
+DECLARE_TEMPLATE_SINGLE(char *)
+DECLARE_TEMPLATE_SINGLE(const void *)
+DECLARE_TEMPLATE_SINGLE(void *)
+
+#undef DECLARE_TEMPLATE_SINGLE
+
 } // close namespace detail
 } // close namespace bpprint
 
@@ -1,31 +1,286 @@
 #pragma once
 
 #include <string>
+#include <type_traits>
+
+#include "bpprint/FormatError.hpp"
+#include "bpprint/OutputBuffer.hpp"
+#include "bpprint/StringRef.hpp"
 
 
 namespace bpprint {
 namespace detail {
 
 
+/*! \brief Flags that may appear in a format specification
+ *
+ * These are combined (bitwise or) into FormatSpec::flags
+ */
+enum FormatFlags
+{
+    FLAG_MINUS = 0x01, //!< '-' Left justify
+    FLAG_PLUS  = 0x02, //!< '+' Always print the sign
+    FLAG_SPACE = 0x04, //!< ' ' Space in place of a positive sign
+    FLAG_HASH  = 0x08, //!< '#' Alternate form
+    FLAG_ZERO  = 0x10  //!< '0' Pad with zeros
+};
+
+
+/*! \brief The parts of a specification that control a conversion
+ *
+ * These are the parts used by the native conversions (see Convert.hpp)
+ */
+struct ConvSpec
+{
+    //! Flags given in the specification (see FormatFlags)
+    unsigned int flags;
+
+    //! The field width (-1 if not given)
+    int width;
+
+    //! The precision (-1 if not given)
+    int precision;
+};
+
+
+/*! \brief A single, decoded format specification
+ *
+ * This stores a format specification (such as "%d" or "%12.8e")
+ * broken down into its various parts.
+ *
+ * Arguments are normally taken in order. A specification may instead
+ * give the position of its argument (as in "%2$d"), and the width
+ * and precision may be taken from arguments (as in "%*.*f" or "%1$*2$d").
+ */
+struct FormatSpec : public ConvSpec
+{
+    //! The format specification itself, except for the argument
+    //  position, and the length and type specifier characters (ie, "%-12.8")
+    std::string format;
+
+    //! The length specifier
+    char length[3];
+
+    //! The type specifier character
+    char spec;
+
+    //! Position (from one) of the argument, or 0 if taken in order
+    unsigned int argpos;
+
+    //! If the width is given by an argument ('*'), the position of the
+    //  argument (from one, or 0 if taken in order). Otherwise, -1.
+    int width_arg;
+
+    //! If the precision is given by an argument, the position of the
+    //  argument (as for width_arg). Otherwise, -1.
+    int prec_arg;
+};
+
+
+/*! \brief The arguments used by a specification
+ *
+ * Indices are from zero, with FormatResult::npos for a width or
+ * precision not given by an argument.
+ */
+struct SpecArgs_
+{
+    size_t value;      //!< The argument to format
+    size_t width;      //!< The argument giving the width
+    size_t precision;  //!< The argument giving the precision
+
+    //! One more than the highest index used
+    size_t end(void) const noexcept
+    {
+        size_t e = value+1;
+        if(width != FormatResult::npos && width >= e)
+            e = width+1;
+        if(precision != FormatResult::npos && precision >= e)
+            e = precision+1;
+        return e;
+    }
+};
+
+
+/*! \brief Does a specification use arguments other than the next one in order?
+ *
+ * These are specifications with a position, or with a width or
+ * precision given by an argument.
+ */
+inline bool is_indexed_(const FormatSpec & fs) noexcept
+{
+    return fs.argpos != 0 || fs.width_arg >= 0 || fs.prec_arg >= 0;
+}
+
+
+/*! \brief Identifies the type of an argument stored in binary form
+ *
+ * There is one tag for each distinct PFTypeMap::cast_type
+ */
+enum class ArgTag : unsigned char
+{
+    Char, SChar, Short, Int, Long, LongLong,
+    UChar, UShort, UInt, ULong, ULongLong,
+    Double, LongDouble,
+    CString,  //!< const char * or char * (may also be used with %p)
+    String,   //!< std::string, StringRef, or std::string_view
+    Pointer
+};
+
+
+/*! \brief Mapping of basic types to their printf specifiers
+ *
+ * Each specialization contains the length specifier (pflength)
+ * and the valid type specifiers (pftype, the first being the default)
+ * for a type, as well as the type it should be converted to when
+ * passing it to printf (cast_type). The tag identifies the
+ * cast_type when arguments are stored in binary form, and the
+ * name is used in error messages.
+ */
+template<typename T> struct PFTypeMap { };
+
+#define DECLARE_PFTYPE(t, cast, length, pft, tg) template<> struct PFTypeMap<t> { \
+         static constexpr const char * pflength = length; \
+         static constexpr const char * pftype = pft; \
+         static constexpr ArgTag tag = ArgTag::tg; \
+         static constexpr const char * name = #t; \
+         typedef cast cast_type; \
+       };
+
+
+DECLARE_PFTYPE(bool,               int,                 "",    "d",    Int)
+DECLARE_PFTYPE(char,               char,                "",    "c",    Char)
+
+DECLARE_PFTYPE(signed char,        signed char,         "hh",  "d",    SChar)
+DECLARE_PFTYPE(signed short,       signed short,        "h",   "d",    Short)
+DECLARE_PFTYPE(signed int,         signed int,          "",    "d",    Int)
+DECLARE_PFTYPE(signed long,        signed long,         "l",   "d",    Long)
+DECLARE_PFTYPE(signed long long,   signed long long,    "ll",  "d",    LongLong)
+DECLARE_PFTYPE(unsigned char,      unsigned char,       "hh",  "uoxX", UChar)
+DECLARE_PFTYPE(unsigned short,     unsigned short,      "h",   "uoxX", UShort)
+DECLARE_PFTYPE(unsigned int,       unsigned int,        "",    "uoxX", UInt)
+DECLARE_PFTYPE(unsigned long,      unsigned long,       "l",   "uoxX", ULong)
+DECLARE_PFTYPE(unsigned long long, unsigned long long,  "ll",  "uoxX", ULongLong)
+
+DECLARE_PFTYPE(float,            double, "",  "fFeEaAgG", Double)
+DECLARE_PFTYPE(double,           double, "",  "fFeEaAgG", Double)
+DECLARE_PFTYPE(long double, long double, "L", "fFeEaAgG", LongDouble)
+
+DECLARE_PFTYPE(const char *, const char *, "", "s", CString)
+DECLARE_PFTYPE(char *,       char *,       "", "s", CString)
+DECLARE_PFTYPE(std::string,  std::string,  "", "s", String)
+DECLARE_PFTYPE(StringRef,    StringRef,    "", "s", String)
+
+DECLARE_PFTYPE(const void *, const void *, "", "p", Pointer)
+DECLARE_PFTYPE(void *,       void *,       "", "p", Pointer)
+
+#undef DECLARE_PFTYPE
+
+} // close namespace detail
+
+
+
+//! Flags, width, and precision of a specification (for Formatter)
+using detail::ConvSpec;
+
+using detail::FormatFlags;
+using detail::FLAG_MINUS;
+using detail::FLAG_PLUS;
+using detail::FLAG_SPACE;
+using detail::FLAG_HASH;
+using detail::FLAG_ZERO;
+
+
+/*! \brief Formatting of user-defined types
+ *
+ * Specialize this for a type to allow it to be passed directly as an
+ * argument. A specialization contains the valid type specifiers (pftype,
+ * the first being the default for %?) and a function writing a value
+ * directly to the output:
+ *
+ * \code{.cpp}
+ * namespace bpprint {
+ * template<> struct Formatter<Price>
+ * {
+ *     static constexpr const char * pftype = "fs";
+ *     static void format(OutputBuffer & out, const ConvSpec & cs, char spec, const Price & value);
+ * };
+ * }
+ * \endcode
+ *
+ * The type specifier is checked before format() is called (at compile
+ * time for BPPRINT_FMT), and `%?` is passed as the default. Length
+ * specifiers are not allowed.
+ *
+ * \tparam T The (decayed) type of the argument
+ */
+template<typename T> struct Formatter { };
+
+
+/*! \brief Write a string, applying the width, precision, and '-' flag
+ *
+ * This is the same as formatting the string with %s, and is intended
+ * for use by Formatter specializations.
+ *
+ * \param [in] out The output is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] s The string to write
+ * \param [in] n The length of \p s
+ */
+void write_field(OutputBuffer & out, const ConvSpec & cs, const char * s, size_t n);
+
+
+namespace detail {
+
+
+//! Helper for detecting members (void_t)
+template<typename T> struct VoidT_ { typedef void type; };
+
+
+//! Does a type have a specialization of Formatter?
+template<typename T, typename = void>
+struct HasFormatter_ : public std::false_type { };
+
+template<typename T>
+struct HasFormatter_<T, typename VoidT_<decltype(Formatter<T>::pftype)>::type>
+    : public std::true_type { };
+
+
+/*! \brief Handles substitution of a single specifier
+ *
+ * This takes a string containing a single, complete format specifier
+ * and substitutes in the value. By this point, the type
+ * should already have been checked against the type specifier
+ * of the format.
+ *
+ * \tparam T The type of data to substitute with. Must be the cast_type
+ *           of one of the PFTypeMap entries
+ *
+ * \param [in] out The formatted string is appended to this buffer
+ * \param [in] fmt String with a single format specifier
+ * \param [in] subst What to put in place of the specifier
+ * \return FormatErrc::ConversionFailed if snprintf fails, otherwise FormatErrc::Ok
+ */
+template<typename T>
+FormatErrc handle_fmt_single_(OutputBuffer & out, const char * fmt, T subst);
+
+
 /*! \brief Prepare and check a decomposed format
  *
  * This checks the type against the type specifier in the
  * format string (that has been decomposed into its pieces).
- *
- * \throw std::runtime_error If there is a problem with the substitution,
- *        such as if the type specification or length specification
- *        does not match the data type passed in.
+ * Nothing is written if the check fails.
  *
  * \tparam T The type of data to substitute with
  *
- * \param [in] fmt The format specifier without the length or type specifiers
- * \param [in] length The length specifier
- * \param [in] spec The type specifier
+ * \param [in] out The formatted string is appended to this buffer
+ * \param [in] fs The decoded format specification
  * \param [in] subst What to put in place of the specifier
+ * \return FormatErrc::Ok, or the problem with the substitution (such as
+ *         a type or length specification that does not match the data
+ *         type passed in)
  */
 template<typename T>
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, T subst);
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, T subst);
 
 
 /*! \brief Prepare and check a decomposed format
@@ -33,10 +288,9 @@ void handle_fmt_(std::string & fmt, const char * length,
  * Overload for pointers, which are always passwd as `void *`
  */
 template<typename T>
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, T * subst)
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, T * subst)
 {
-    return handle_fmt_<void const *>(fmt, length, spec, subst);
+    return handle_fmt_<void const *>(out, fs, subst);
 }
 
 
@@ -45,8 +299,7 @@ void handle_fmt_(std::string & fmt, const char * length,
  * Overload for `char *`, since we may not always want it
  * to be used as a string (ie, %p)
  */
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, const char * subst);
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, const char * subst);
 
 
 /*! \brief Prepare and check a decomposed format
@@ -54,16 +307,86 @@ void handle_fmt_(std::string & fmt, const char * length,
  * Overload for `char *`, since we may not always want it
  * to be used as a string (ie, %p)
  */
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, char * subst);
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs, char * subst);
 
 
 /*! \brief Prepare and check a decomposed format
  *
  * Overload for `std::string`, so we can pass it to %s
  */
-void handle_fmt_(std::string & fmt, const char * length,
-                 char spec, const std::string & subst);
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs,
+                       const std::string & subst);
+
+
+/*! \brief Prepare and check a decomposed format
+ *
+ * Overload for StringRef, which can only be used with %s
+ */
+FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs,
+                       const StringRef & subst);
+
+
+#if __cplusplus >= 201703L
+/*! \brief Prepare and check a decomposed format
+ *
+ * Overload for std::string_view, which is handled as a StringRef
+ */
+inline FormatErrc handle_fmt_(OutputBuffer & out, const FormatSpec & fs,
+                              std::string_view subst)
+{
+    return handle_fmt_(out, fs, StringRef(subst));
+}
+#endif
+
+
+/*! \brief Check a specification against a user-defined type
+ *
+ * \param [in] fs The decoded format specification
+ * \param [in] pftype The valid type specifiers (see Formatter)
+ * \param [out] spec The type specifier, with '?' replaced by the default
+ * \return FormatErrc::BadLength if a length specifier is given,
+ *         FormatErrc::BadType if the type specifier is not in \p pftype,
+ *         otherwise FormatErrc::Ok
+ */
+FormatErrc check_user_spec_(const FormatSpec & fs, const char * pftype, char & spec) noexcept;
+
+
+/*! \brief Check and format a user-defined type
+ *
+ * \tparam T A type with a specialization of Formatter
+ */
+template<typename T>
+FormatErrc handle_user_fmt_(OutputBuffer & out, const FormatSpec & fs, const T & subst)
+{
+    char spec;
+    const FormatErrc errc = check_user_spec_(fs, Formatter<T>::pftype, spec);
+    if(errc == FormatErrc::Ok)
+        Formatter<T>::format(out, fs, spec, subst);
+    return errc;
+}
+
+
+/*! \brief Check and format a single argument of any valid type
+ *
+ * Types with a Formatter are handled by it, and all others by handle_fmt_
+ */
+template<typename T>
+FormatErrc handle_arg_(OutputBuffer & out, const FormatSpec & fs, const T & subst, std::false_type)
+{
+    return handle_fmt_(out, fs, subst);
+}
+
+template<typename T>
+FormatErrc handle_arg_(OutputBuffer & out, const FormatSpec & fs, const T & subst, std::true_type)
+{
+    return handle_user_fmt_(out, fs, subst);
+}
+
+template<typename T>
+FormatErrc handle_arg_(OutputBuffer & out, const FormatSpec & fs, const T & subst)
+{
+    return handle_arg_(out, fs, subst, HasFormatter_<typename std::decay<T>::type>());
+}
 
 
 
@@ -74,10 +397,11 @@ void handle_fmt_(std::string & fmt, const char * length,
 // from std:true_type
 /////////////////////////////////////////////////////////
 
-template<typename T> struct ValidPrintfArg : public std::false_type { };
+// Types with a Formatter are also valid
+template<typename T> struct ValidPrintfArg : public HasFormatter_<T> { };
 
 #define DECLARE_VALID_FORMAT(type) \
-    extern template void handle_fmt_<type>(std::string &, const char *, char, type); \
+    extern template FormatErrc handle_fmt_<type>(OutputBuffer &, const FormatSpec &, type); \
     template<> struct ValidPrintfArg<type> : public std::true_type { };
 
 DECLARE_VALID_FORMAT(bool)
@@ -102,13 +426,90 @@ DECLARE_VALID_FORMAT(void const *)
 #undef DECLARE_VALID_FORMAT
 
 
+#define DECLARE_VALID_SINGLE(type) \
+    extern template FormatErrc handle_fmt_single_<type>(OutputBuffer &, const char *, type);
+
+DECLARE_VALID_SINGLE(int)
+DECLARE_VALID_SINGLE(char)
+DECLARE_VALID_SINGLE(unsigned char)
+DECLARE_VALID_SINGLE(signed char)
+DECLARE_VALID_SINGLE(unsigned short)
+DECLARE_VALID_SINGLE(signed short)
+DECLARE_VALID_SINGLE(unsigned int)
+DECLARE_VALID_SINGLE(unsigned long)
+DECLARE_VALID_SINGLE(signed long)
+DECLARE_VALID_SINGLE(unsigned long long)
+DECLARE_VALID_SINGLE(signed long long)
+
+DECLARE_VALID_SINGLE(double)
+DECLARE_VALID_SINGLE(long double)
+
+DECLARE_VALID_SINGLE(const char *)
+DECLARE_VALID_SINGLE(char *)
+DECLARE_VALID_SINGLE(const void *)
+DECLARE_VALID_SINGLE(void *)
+
+#undef DECLARE_VALID_SINGLE
+
+
 // Mark the other special types as valid as well
 template<> struct ValidPrintfArg<std::string> : public std::true_type { };
+template<> struct ValidPrintfArg<StringRef> : public std::true_type { };
+#if __cplusplus >= 201703L
+template<> struct ValidPrintfArg<std::string_view> : public std::true_type { };
+#endif
 template<> struct ValidPrintfArg<char *> : public std::true_type { };
 template<> struct ValidPrintfArg<const char *> : public std::true_type { };
 template<typename T> struct ValidPrintfArg<T *> : public std::true_type { };
 
 
+/*! \brief Name of an argument type, for error messages
+ *
+ * \tparam T The (decayed) type of the argument
+ */
+template<typename T, bool User = HasFormatter_<T>::value>
+struct TypeName_
+{
+    static constexpr const char * get(void) { return PFTypeMap<T>::name; }
+};
+
+template<typename T>
+struct TypeName_<T, true>
+{
+    static constexpr const char * get(void) { return "user-defined type"; }
+};
+
+template<typename T>
+struct TypeName_<T *, false>
+{
+    static constexpr const char * get(void) { return "pointer"; }
+};
+
+template<>
+struct TypeName_<const char *, false>
+{
+    static constexpr const char * get(void) { return PFTypeMap<const char *>::name; }
+};
+
+template<> struct TypeName_<char *, false> : public TypeName_<const char *> { };
+#if __cplusplus >= 201703L
+template<>
+struct TypeName_<std::string_view, false>
+{
+    static constexpr const char * get(void) { return "std::string_view"; }
+};
+#endif
+
+
+/*! \brief Are all the (decayed) types valid printf arguments? */
+template<typename... Targs> struct ValidPrintfArgs : public std::true_type { };
+
+template<typename T, typename... Targs>
+struct ValidPrintfArgs<T, Targs...>
+    : public std::integral_constant<bool, ValidPrintfArg<typename std::decay<T>::type>::value &&
+                                          ValidPrintfArgs<Targs...>::value> { };
+
+
 } // close namespace detail
 } // close namespace bpprint
 
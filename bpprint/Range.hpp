@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include "bpprint/Format.hpp"
+
+/*! \file
+ *
+ * Formatting of ranges
+ *
+ * bpprint::join() wraps a container (or a pair of iterators) so that it
+ * can be passed as a single %s argument. Each element is formatted with
+ * its own specification and written directly to the output, separated
+ * by a separator string:
+ *
+ * \code{.cpp}
+ * std::vector<int> ids = { 1, 2, 3 };
+ * bpprint::format_string("ids=[%s]", bpprint::join(ids, ", "));          // ids=[1, 2, 3]
+ * bpprint::format_string("%s", bpprint::join(ids, " ", "%04d", 2));      // 0001 0002 ...
+ * \endcode
+ */
+
+namespace bpprint {
+
+
+/*! \brief A range of values, and how to format them
+ *
+ * The element specification is decoded once, when the object is
+ * created, and checked against the first element. Formatting then
+ * writes each element directly to the output, without building
+ * intermediate strings.
+ *
+ * At most \p limit elements are written. If there are more, the output
+ * ends with the separator and "...". With a limit of zero, no elements
+ * are written, so the output of a non-empty range is just "..." (and
+ * that of an empty range is empty).
+ *
+ * The range is not copied, so the object must be used before the range
+ * goes out of scope (usually, it is created and used in the same
+ * expression). It is traversed more than once, so the iterators must be
+ * (at least) forward iterators.
+ *
+ * Objects are created with bpprint::join().
+ *
+ * \tparam Iter Type of the iterators
+ */
+template<typename Iter>
+class JoinView
+{
+    public:
+        typedef typename std::decay<decltype(*std::declval<Iter>())>::type value_type;
+
+        static_assert(detail::ValidPrintfArg<value_type>::value,
+                      "Invalid element type passed to join");
+
+
+        //! No limit on the number of elements
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+
+        /*! \brief Decode the element specification and check it
+         *
+         * \throw bpprint::format_error if \p spec is not a single, valid
+         *        specification, or does not match the type of the elements
+         *
+         * \param [in] first, last The range of elements
+         * \param [in] sep The separator written between elements
+         * \param [in] spec The specification for each element (such as "%d" or "%08.3f")
+         * \param [in] limit The maximum number of elements to write. If zero,
+         *                   a non-empty range is written as "...".
+         */
+        JoinView(Iter first, Iter last, const char * sep, const char * spec, size_t limit)
+            : first_(first), last_(last), sep_(sep), nsep_(strlen(sep)), limit_(limit)
+        {
+            const size_t len = strlen(spec);
+            size_t end = 0;
+
+            FormatErrc errc = FormatErrc::BadSpec;
+            if(len > 0 && spec[0] == '%')
+                errc = detail::parse_format_spec_(spec_, spec, len, 0, end);
+
+            if(errc == FormatErrc::Ok && (end != len || detail::is_indexed_(spec_)))
+                errc = FormatErrc::BadSpec;
+
+            FormatResult res;
+            if(errc != FormatErrc::Ok)
+            {
+                detail::set_error_(res, errc, FormatResult::npos, 0);
+                detail::throw_format_error_(res);
+            }
+
+            // All elements have the same type, so checking the first is enough
+            if(first_ != last_)
+            {
+                CountingBuffer cb;
+                errc = detail::handle_arg_(cb, spec_, *first_);
+                if(errc != FormatErrc::Ok)
+                {
+                    detail::set_error_(res, errc, FormatResult::npos, 0, detail::TypeName_<value_type>::get());
+                    detail::throw_format_error_(res);
+                }
+            }
+        }
+
+
+        /*! \brief Write the elements to a buffer
+         *
+         * \param [in] out The output is appended to this buffer
+         */
+        void format_to(OutputBuffer & out) const
+        {
+            size_t n = 0;
+            for(Iter it = first_; it != last_; ++it, ++n)
+            {
+                if(n > 0)
+                    out.append(sep_, nsep_);
+
+                // There is no separator before "..." if no elements are written
+                if(n == limit_)
+                {
+                    out.append("...", 3);
+                    break;
+                }
+
+                detail::handle_arg_(out, spec_, *it);
+            }
+        }
+
+
+    private:
+        Iter first_;
+        Iter last_;
+        const char * sep_;
+        size_t nsep_;
+        size_t limit_;
+        detail::FormatSpec spec_;
+};
+
+
+template<typename Iter>
+constexpr size_t JoinView<Iter>::npos;
+
+
+/*! \brief Ranges are formatted with %s
+ *
+ * The width, precision, and '-' flag apply to the output as a whole.
+ */
+template<typename Iter>
+struct Formatter<JoinView<Iter>>
+{
+    static constexpr const char * pftype = "s";
+
+    static void format(OutputBuffer & out, const ConvSpec & cs, char, const JoinView<Iter> & v)
+    {
+        if(cs.width <= 0 && cs.precision < 0)
+        {
+            v.format_to(out);
+            return;
+        }
+
+        MemoryBuffer buf;
+        v.format_to(buf);
+        write_field(out, cs, buf.data(), buf.size());
+    }
+};
+
+
+/*! \brief Format the elements of a range, given by iterators
+ *
+ * \throw bpprint::format_error if \p spec is invalid for the elements
+ *
+ * \param [in] first, last The range of elements
+ * \param [in] sep The separator written between elements (", " by default)
+ * \param [in] spec The specification for each element (%? by default)
+ * \param [in] limit The maximum number of elements to write (all by default).
+ *                   If zero, a non-empty range is written as "...".
+ */
+template<typename Iter>
+JoinView<Iter> join(Iter first, Iter last, const char * sep = ", ", const char * spec = "%?",
+                    size_t limit = JoinView<Iter>::npos)
+{
+    return JoinView<Iter>(first, last, sep, spec, limit);
+}
+
+
+/*! \brief Format the elements of a container (or array)
+ *
+ * \throw bpprint::format_error if \p spec is invalid for the elements
+ *
+ * \param [in] range The container (captured by reference)
+ * \param [in] sep The separator written between elements (", " by default)
+ * \param [in] spec The specification for each element (%? by default)
+ * \param [in] limit The maximum number of elements to write (all by default).
+ *                   If zero, a non-empty range is written as "...".
+ */
+template<typename Range>
+auto join(const Range & range, const char * sep = ", ", const char * spec = "%?",
+          size_t limit = std::numeric_limits<size_t>::max()) -> JoinView<decltype(std::begin(range))>
+{
+    return JoinView<decltype(std::begin(range))>(std::begin(range), std::end(range), sep, spec, limit);
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <cstring>
+
+#if !defined(BPPRINT_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+    #define BPPRINT_SCAN_X86
+    #include <immintrin.h>
+#endif
+
+#include "bpprint/Format.hpp"
+
+
+namespace bpprint {
+namespace detail {
+
+
+namespace {
+
+typedef size_t (*FindPercentFn_)(const char *, size_t);
+
+
+#ifndef BPPRINT_SCAN_X86
+
+// Portable version. The C library's memchr is usually vectorized already.
+size_t find_percent_generic_(const char * str, size_t len) noexcept
+{
+    const void * p = memchr(str, '%', len);
+    return p ? static_cast<size_t>(static_cast<const char *>(p) - str) : len;
+}
+
+#else
+
+// Compares 16 characters at a time
+size_t find_percent_sse2_(const char * str, size_t len) noexcept
+{
+    const __m128i pct = _mm_set1_epi8('%');
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pct)));
+        if(mask != 0)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+
+    for(; i < len; i++)
+        if(str[i] == '%')
+            return i;
+
+    return len;
+}
+
+
+// Compares 32 characters at a time. Only used if the processor supports it.
+__attribute__((target("avx2")))
+size_t find_percent_avx2_(const char * str, size_t len) noexcept
+{
+    const __m256i pct = _mm256_set1_epi8('%');
+
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32)
+    {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + i));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pct)));
+        if(mask != 0)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+
+    return i + find_percent_sse2_(str + i, len - i);
+}
+
+#endif
+
+
+size_t find_percent_resolve_(const char * str, size_t len) noexcept;
+
+// Starts out pointing to find_percent_resolve_, which picks the
+// best version on first use. Constant initialization means this
+// is valid even during static initialization of other files.
+std::atomic<FindPercentFn_> find_percent_impl_(find_percent_resolve_);
+
+
+FindPercentFn_ select_find_percent_(void) noexcept
+{
+#ifdef BPPRINT_SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return find_percent_avx2_;
+    return find_percent_sse2_;
+#else
+    return find_percent_generic_;
+#endif
+}
+
+
+size_t find_percent_resolve_(const char * str, size_t len) noexcept
+{
+    const FindPercentFn_ fn = select_find_percent_();
+    find_percent_impl_.store(fn, std::memory_order_relaxed);
+    return fn(str, len);
+}
+
+} // close anonymous namespace
+
+
+
+size_t find_percent_(const char * str, size_t len) noexcept
+{
+    // Short runs of literal text are most common, and are
+    // not worth calling through the pointer
+    if(len < 16)
+    {
+        for(size_t i = 0; i < len; i++)
+            if(str[i] == '%')
+                return i;
+        return len;
+    }
+
+    return find_percent_impl_.load(std::memory_order_relaxed)(str, len);
+}
+
+
+} // close namespace detail
+} // close namespace bpprint
@@ -0,0 +1,681 @@
+#pragma once
+
+#include <climits>
+
+#include "bpprint/Format.hpp"
+#include "bpprint/Convert.hpp"
+
+/*! \file
+ *
+ * Format strings that are parsed and checked at compile time
+ *
+ * A string literal wrapped in BPPRINT_FMT can be passed to format_to,
+ * format_stream, or format_string in place of a normal format string.
+ * The format string is then parsed by the compiler, and mismatches in
+ * the number or types of the arguments are reported via static_assert.
+ * No parsing or checking is done at run time.
+ *
+ * \code{.cpp}
+ * bpprint::format_stream(std::cout, BPPRINT_FMT("%d items at %.2f\n"), n, price);
+ * \endcode
+ */
+
+
+/*! \brief Wrap a string literal for compile-time parsing
+ *
+ * The result is an object of a unique type that carries the
+ * string literal with it.
+ */
+#define BPPRINT_FMT(str) \
+    [] { \
+        struct bpprint_static_format_ : public ::bpprint::detail::StaticFormatBase \
+        { \
+            static constexpr const char * data(void) { return str; } \
+            static constexpr size_t size(void) { return sizeof(str)-1; } \
+        }; \
+        return bpprint_static_format_(); \
+    }()
+
+
+namespace bpprint {
+namespace detail {
+
+
+/*! \brief Base class of all format strings created with BPPRINT_FMT
+ *
+ * Derived classes contain static constexpr data() and size() functions
+ * returning the string literal and its length.
+ */
+struct StaticFormatBase { };
+
+
+/*! \brief A sequence of indices 0..N-1, used for expanding packs */
+template<size_t... I> struct Indices { };
+
+template<size_t N, size_t... I>
+struct MakeIndices : public MakeIndices<N-1, N-1, I...> { };
+
+template<size_t... I>
+struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+
+
+//////////////////////////////////////////////////////////////
+// Constexpr parsing of the format string
+//
+// These are all written as single return statements (C++11).
+// Scanning for '%' is done by splitting the range in half so
+// that the recursion depth stays small for long strings.
+//////////////////////////////////////////////////////////////
+
+//! Does the null-terminated \p s contain \p c?
+constexpr bool sf_contains_(const char * s, char c)
+{
+    return s[0] == '\0' ? false : (s[0] == c || sf_contains_(s+1, c));
+}
+
+//! Are the \p n characters at \p a equal to the null-terminated \p b?
+constexpr bool sf_equal_(const char * a, size_t n, const char * b)
+{
+    return n == 0 ? b[0] == '\0' : (b[0] == a[0] && sf_equal_(a+1, n-1, b+1));
+}
+
+//! Length of a null-terminated string
+constexpr size_t sf_strlen_(const char * s)
+{
+    return s[0] == '\0' ? 0 : 1 + sf_strlen_(s+1);
+}
+
+constexpr size_t sf_find_pct_(const char * s, size_t pos, size_t end);
+
+constexpr size_t sf_find_pct_pick_(size_t left, const char * s, size_t mid, size_t end)
+{
+    return left != mid ? left : sf_find_pct_(s, mid, end);
+}
+
+//! Index of the first '%' in [pos, end), or end if there isn't one
+constexpr size_t sf_find_pct_(const char * s, size_t pos, size_t end)
+{
+    return pos >= end ? end :
+           end - pos == 1 ? (s[pos] == '%' ? pos : end) :
+           sf_find_pct_pick_(sf_find_pct_(s, pos, pos + (end-pos)/2),
+                             s, pos + (end-pos)/2, end);
+}
+
+constexpr size_t sf_find_spec_(const char * s, size_t len, size_t pos);
+
+constexpr size_t sf_find_spec_pick_(const char * s, size_t len, size_t pct)
+{
+    return pct >= len ? len :
+           (pct+1 < len && s[pct+1] == '%') ? sf_find_spec_(s, len, pct+2) : pct;
+}
+
+//! Index of the '%' starting the next specification (skipping %%), or len
+constexpr size_t sf_find_spec_(const char * s, size_t len, size_t pos)
+{
+    return sf_find_spec_pick_(s, len, sf_find_pct_(s, pos, len));
+}
+
+//! Skip over characters of \p s found in \p chars
+constexpr size_t sf_skip_(const char * s, size_t len, size_t pos, const char * chars)
+{
+    return (pos < len && sf_contains_(chars, s[pos])) ? sf_skip_(s, len, pos+1, chars) : pos;
+}
+
+//! Skip the precision (including the period)
+constexpr size_t sf_skip_prec_(const char * s, size_t len, size_t pos)
+{
+    return (pos < len && s[pos] == '.') ? sf_skip_(s, len, pos+1, "0123456789") : pos;
+}
+
+//! Given the index of a '%', find the start of the length specifier
+constexpr size_t sf_length_begin_(const char * s, size_t len, size_t pct)
+{
+    return sf_skip_prec_(s, len, sf_skip_(s, len, sf_skip_(s, len, pct+1, "+- #0"), "0123456789"));
+}
+
+//! Given the index of a '%', find the index of the type specifier
+constexpr size_t sf_spec_pos_(const char * s, size_t len, size_t pct)
+{
+    return sf_skip_(s, len, sf_length_begin_(s, len, pct), "hljztL");
+}
+
+//! Given the index of a '%', find the index just past the specification
+constexpr size_t sf_spec_end_(const char * s, size_t len, size_t pct)
+{
+    return sf_spec_pos_(s, len, pct) + 1;
+}
+
+//! Is the specification starting at \p pct well formed?
+constexpr bool sf_spec_valid_(const char * s, size_t len, size_t pct)
+{
+    return sf_spec_pos_(s, len, pct) < len &&
+           sf_contains_("diuoxXfFeEgGaAcsp?", s[sf_spec_pos_(s, len, pct)]) &&
+           sf_spec_pos_(s, len, pct) - sf_length_begin_(s, len, pct) <= 2;
+}
+
+//! Does the specification starting at \p pct use an argument position or '*'?
+constexpr bool sf_spec_indexed_(const char * s, size_t len, size_t pct)
+{
+    return sf_spec_pos_(s, len, pct) < len &&
+           (s[sf_spec_pos_(s, len, pct)] == '$' || s[sf_spec_pos_(s, len, pct)] == '*');
+}
+
+//! Does any specification in \p s (starting at \p pos) use an argument position or '*'?
+constexpr bool sf_any_indexed_(const char * s, size_t len, size_t pos)
+{
+    return sf_find_spec_(s, len, pos) >= len ? false :
+           (sf_spec_indexed_(s, len, sf_find_spec_(s, len, pos)) ||
+            sf_any_indexed_(s, len, sf_spec_end_(s, len, sf_find_spec_(s, len, pos))));
+}
+
+//! Number of specifications in \p s, starting at \p pos
+constexpr size_t sf_count_specs_(const char * s, size_t len, size_t pos)
+{
+    return sf_find_spec_(s, len, pos) >= len ? 0 :
+           1 + sf_count_specs_(s, len, sf_spec_end_(s, len, sf_find_spec_(s, len, pos)));
+}
+
+//! Does the (decimal) number in [pos, end) fit in an int?
+constexpr bool sf_number_fits_(const char * s, size_t pos, size_t end, int acc)
+{
+    return pos >= end ? true :
+           acc > (INT_MAX - (s[pos] - '0')) / 10 ? false :
+           sf_number_fits_(s, pos+1, end, acc*10 + (s[pos] - '0'));
+}
+
+//! Value of the (decimal) number in [pos, end), or 0 if it does not fit in an int
+constexpr int sf_number_(const char * s, size_t pos, size_t end, int acc)
+{
+    return !sf_number_fits_(s, pos, end, acc) ? 0 :
+           pos >= end ? acc : sf_number_(s, pos+1, end, acc*10 + (s[pos] - '0'));
+}
+
+//! Flag (see FormatFlags) corresponding to a character
+constexpr unsigned int sf_flag_bit_(char c)
+{
+    return c == '-' ? unsigned(FLAG_MINUS) :
+           c == '+' ? unsigned(FLAG_PLUS)  :
+           c == ' ' ? unsigned(FLAG_SPACE) :
+           c == '#' ? unsigned(FLAG_HASH)  :
+           c == '0' ? unsigned(FLAG_ZERO)  : 0u;
+}
+
+//! Combined flags for the flag characters in [pos, end)
+constexpr unsigned int sf_flags_(const char * s, size_t pos, size_t end)
+{
+    return pos >= end ? 0u : sf_flag_bit_(s[pos]) | sf_flags_(s, pos+1, end);
+}
+
+//! Index of the '%' starting the \p n-th specification, starting at \p pos
+constexpr size_t sf_nth_spec_(const char * s, size_t len, size_t n, size_t pos)
+{
+    return n == 0 ? sf_find_spec_(s, len, pos) :
+           sf_nth_spec_(s, len, n-1, sf_spec_end_(s, len, sf_find_spec_(s, len, pos)));
+}
+
+//! Index where the literal text before the \p n-th specification begins
+constexpr size_t sf_literal_begin_(const char * s, size_t len, size_t n)
+{
+    return n == 0 ? 0 : sf_spec_end_(s, len, sf_nth_spec_(s, len, n-1, 0));
+}
+
+
+
+/*! \brief Location of the pieces of a single specification
+ *
+ * \tparam S The format string type (from BPPRINT_FMT)
+ * \tparam I Which specification
+ */
+template<typename S, size_t I>
+struct StaticSpec_
+{
+    //! Index where the literal text before this specification begins
+    static constexpr size_t literal_begin = sf_literal_begin_(S::data(), S::size(), I);
+
+    //! Index of the '%'
+    static constexpr size_t begin = sf_nth_spec_(S::data(), S::size(), I, 0);
+
+    //! Index of the field width
+    static constexpr size_t width_begin = sf_skip_(S::data(), S::size(), begin+1, "+- #0");
+
+    //! Index of the precision (the period)
+    static constexpr size_t prec_begin = sf_skip_(S::data(), S::size(), width_begin, "0123456789");
+
+    //! Index of the length specifier
+    static constexpr size_t length_begin = sf_length_begin_(S::data(), S::size(), begin);
+
+    //! Flags given in the specification
+    static constexpr unsigned int flags = sf_flags_(S::data(), begin+1, width_begin);
+
+    //! The field width (-1 if not given)
+    static constexpr int width = prec_begin > width_begin ?
+                                 sf_number_(S::data(), width_begin, prec_begin, 0) : -1;
+
+    //! The precision (-1 if not given)
+    static constexpr int precision = length_begin > prec_begin ?
+                                     sf_number_(S::data(), prec_begin+1, length_begin, 0) : -1;
+
+    //! Do the field width and precision fit in an int?
+    static constexpr bool numbers_fit = sf_number_fits_(S::data(), width_begin, prec_begin, 0) &&
+                                        (length_begin <= prec_begin ||
+                                         sf_number_fits_(S::data(), prec_begin+1, length_begin, 0));
+
+    //! Index of the type specifier
+    static constexpr size_t spec_pos = sf_spec_pos_(S::data(), S::size(), begin);
+
+    //! Index just past the specification
+    static constexpr size_t end = spec_pos + 1;
+
+    //! The type specifier
+    static constexpr char spec = S::data()[spec_pos];
+
+    //! Is the specification well formed?
+    static constexpr bool valid = sf_spec_valid_(S::data(), S::size(), begin);
+};
+
+
+
+/*! \brief How an argument is checked and passed to printf
+ *
+ * This mirrors the overloads of handle_fmt_. The argument is
+ * checked against the PFTypeMap entry of check_type, and is converted
+ * to its cast_type before being passed to printf.
+ *
+ * \tparam T The type of the argument
+ * \tparam Spec The type specifier it is used with
+ */
+template<typename T, char Spec>
+struct StaticArg_
+{
+    typedef T check_type;
+
+    static typename PFTypeMap<T>::cast_type convert(const T & arg)
+    {
+        return static_cast<typename PFTypeMap<T>::cast_type>(arg);
+    }
+};
+
+// Pointers are always passed as void *
+template<typename T, char Spec>
+struct StaticArg_<T *, Spec>
+{
+    typedef void const * check_type;
+
+    static void const * convert(const T * arg) { return arg; }
+};
+
+// char * may be a string or a pointer
+template<char Spec>
+struct StaticArg_<const char *, Spec>
+{
+    static constexpr bool is_str = (Spec == 's' || Spec == '?');
+
+    typedef typename std::conditional<is_str, const char *, void const *>::type check_type;
+
+    static check_type convert(const char * arg) { return arg; }
+};
+
+template<char Spec>
+struct StaticArg_<char *, Spec> : public StaticArg_<const char *, Spec> { };
+
+template<char Spec>
+struct StaticArg_<std::string, Spec>
+{
+    typedef typename StaticArg_<const char *, Spec>::check_type check_type;
+
+    static check_type convert(const std::string & arg) { return arg.c_str(); }
+};
+
+#if __cplusplus >= 201703L
+template<char Spec>
+struct StaticArg_<std::string_view, Spec>
+{
+    typedef StringRef check_type;
+
+    static StringRef convert(std::string_view arg) { return arg; }
+};
+#endif
+
+
+
+/*! \brief The complete printf format for a single specification
+ *
+ * This is the specification as written in the format string, except
+ * that the '?' specifier is replaced by the default for the type.
+ * The string is built entirely at compile time.
+ *
+ * \tparam S The format string type (from BPPRINT_FMT)
+ * \tparam I Which specification
+ * \tparam T The type used for checking (StaticArg_::check_type)
+ */
+template<typename S, size_t I, typename T>
+struct StaticSpecString_
+{
+    typedef StaticSpec_<S, I> Spec;
+
+    static constexpr bool is_auto = (Spec::spec == '?');
+
+    //! Number of characters before the length specifier
+    static constexpr size_t nprefix = Spec::length_begin - Spec::begin;
+
+    //! Number of characters in the final string
+    static constexpr size_t size = nprefix +
+                                   (is_auto ? sf_strlen_(PFTypeMap<T>::pflength) + 1
+                                            : Spec::end - Spec::length_begin);
+
+    //! Character \p i of the final string
+    static constexpr char at(size_t i)
+    {
+        return i < nprefix ? S::data()[Spec::begin + i] :
+               !is_auto ? S::data()[Spec::begin + i] :
+               i - nprefix < sf_strlen_(PFTypeMap<T>::pflength) ? PFTypeMap<T>::pflength[i - nprefix] :
+               PFTypeMap<T>::pftype[0];
+    }
+
+    template<size_t... J>
+    struct Build
+    {
+        static constexpr char value[sizeof...(J)+1] = { at(J)..., '\0' };
+    };
+
+    template<size_t... J>
+    static constexpr const char * get(Indices<J...>) { return Build<J...>::value; }
+
+    //! Get the null-terminated format string
+    static constexpr const char * str(void) { return get(typename MakeIndices<size>::type()); }
+};
+
+template<typename S, size_t I, typename T>
+template<size_t... J>
+constexpr char StaticSpecString_<S, I, T>::Build<J...>::value[sizeof...(J)+1];
+
+
+
+/*! \brief Write literal text from the format string
+ *
+ * Writes the characters in [Begin, End), replacing %% with %.
+ * The positions of any %% are found at compile time.
+ */
+template<typename S, size_t Begin, size_t End,
+         size_t Pct = sf_find_pct_(S::data(), Begin, End)>
+struct StaticLiteral_
+{
+    static void write(OutputBuffer & out)
+    {
+        // Includes a single %
+        out.append_literal(S::data()+Begin, Pct+1-Begin);
+        StaticLiteral_<S, Pct+2, End>::write(out);
+    }
+};
+
+template<typename S, size_t Begin, size_t End>
+struct StaticLiteral_<S, Begin, End, End>
+{
+    static void write(OutputBuffer & out)
+    {
+        if(End > Begin)
+            out.append_literal(S::data()+Begin, End-Begin);
+    }
+};
+
+
+
+/*! \brief Convert a single value, falling back to printf if needed
+ *
+ * \param [in] out The converted value is appended to this buffer
+ * \param [in] cs Flags, width, and precision
+ * \param [in] spec The (resolved) type specifier
+ * \param [in] pffmt The complete printf format, for the fallback
+ * \param [in] subst The value to convert
+ * \return FormatErrc::ConversionFailed if snprintf fails, otherwise FormatErrc::Ok
+ */
+template<typename T>
+FormatErrc static_convert_(OutputBuffer & out, const ConvSpec & cs, char spec,
+                           const char * pffmt, T subst)
+{
+    if(convert_native_(out, cs, spec, subst))
+        return FormatErrc::Ok;
+    return handle_fmt_single_(out, pffmt, subst);
+}
+
+
+//! StringRef is always converted natively
+inline FormatErrc static_convert_(OutputBuffer & out, const ConvSpec & cs, char,
+                                  const char *, StringRef subst)
+{
+    convert_string_(out, cs, subst.data(), subst.size());
+    return FormatErrc::Ok;
+}
+
+
+/*! \brief Check and convert an argument of a basic type
+ *
+ * The argument is checked against its PFTypeMap entry
+ */
+template<typename S, size_t I, typename T>
+FormatErrc static_format_value_(OutputBuffer & out, const ConvSpec & cs, const T & arg, std::false_type)
+{
+    typedef typename std::decay<T>::type actual_T;
+
+    typedef StaticSpec_<S, I> Spec;
+    typedef StaticArg_<actual_T, Spec::spec> Arg;
+    typedef typename Arg::check_type check_type;
+
+    static_assert(Spec::spec == '?' ?
+                      Spec::spec_pos == Spec::length_begin :
+                      sf_equal_(S::data() + Spec::length_begin,
+                                Spec::spec_pos - Spec::length_begin,
+                                PFTypeMap<check_type>::pflength),
+                  "Bad length specifier for argument type");
+
+    static_assert(Spec::spec == '?' ||
+                  sf_contains_(PFTypeMap<check_type>::pftype, Spec::spec),
+                  "Bad type specifier for argument type");
+
+    // The type specifier, with '?' replaced by the default
+    static constexpr char spec = Spec::spec == '?' ? PFTypeMap<check_type>::pftype[0] : Spec::spec;
+
+    return static_convert_(out, cs, spec, StaticSpecString_<S, I, check_type>::str(), Arg::convert(arg));
+}
+
+
+/*! \brief Check and convert an argument of a user-defined type
+ *
+ * The argument is checked against its Formatter
+ */
+template<typename S, size_t I, typename T>
+FormatErrc static_format_value_(OutputBuffer & out, const ConvSpec & cs, const T & arg, std::true_type)
+{
+    typedef StaticSpec_<S, I> Spec;
+
+    static_assert(Spec::spec_pos == Spec::length_begin,
+                  "Bad length specifier for argument type");
+
+    static_assert(Spec::spec == '?' ||
+                  sf_contains_(Formatter<T>::pftype, Spec::spec),
+                  "Bad type specifier for argument type");
+
+    static constexpr char spec = Spec::spec == '?' ? Formatter<T>::pftype[0] : Spec::spec;
+
+    Formatter<T>::format(out, cs, spec, arg);
+    return FormatErrc::Ok;
+}
+
+
+/*! \brief Check and format a single argument of a static format string
+ *
+ * Writes the literal text before specification \p I, followed by
+ * the formatted argument
+ *
+ * \return False (with \p res filled in) if the conversion failed
+ */
+template<typename S, size_t I, typename T>
+bool static_format_arg_(OutputBuffer & out, FormatResult & res, const T & arg)
+{
+    typedef typename std::decay<T>::type actual_T;
+
+    static_assert(ValidPrintfArg<actual_T>::value == true,
+                  "Invalid argument type passed to Format");
+
+    typedef StaticSpec_<S, I> Spec;
+    static_assert(Spec::valid, "Badly formed format specification");
+    static_assert(Spec::numbers_fit, "Field width or precision is too large");
+
+    StaticLiteral_<S, Spec::literal_begin, Spec::begin>::write(out);
+
+    const ConvSpec cs = { Spec::flags, Spec::width, Spec::precision };
+    const FormatErrc errc = static_format_value_<S, I>(out, cs, arg, HasFormatter_<actual_T>());
+    if(errc != FormatErrc::Ok)
+        return set_error_(res, errc, I, Spec::begin, TypeName_<actual_T>::get());
+    return true;
+}
+
+
+/*! \brief Checks of a static format string that do not depend on the argument types
+ *
+ * \tparam S The format string
+ * \tparam N The number of arguments
+ */
+template<typename S, size_t N>
+struct StaticCheck_
+{
+    static constexpr bool indexed = sf_any_indexed_(S::data(), S::size(), 0);
+    static_assert(!indexed, "Positional arguments and '*' are not supported in BPPRINT_FMT");
+
+    static constexpr bool count_ok = (sf_count_specs_(S::data(), S::size(), 0) == N);
+    static_assert(indexed || count_ok, "Wrong number of arguments for format string");
+
+    //! Whether the arguments can be formatted
+    typedef std::integral_constant<bool, !indexed && count_ok> type;
+};
+
+
+//! The format string cannot be used. static_assert has already fired
+template<typename S, size_t... I, typename... Targs>
+bool static_format_(std::false_type, OutputBuffer &, FormatResult &, Indices<I...>, const Targs &...)
+{
+    return true;
+}
+
+
+//! Format all arguments of a static format string
+template<typename S, size_t... I, typename... Targs>
+bool static_format_(std::true_type, OutputBuffer & out, FormatResult & res,
+                    Indices<I...>, const Targs &... args)
+{
+    // Expands to one call per argument, in order, stopping at the first error
+    bool ok = true;
+    int expand[] = { 0, (ok = ok && static_format_arg_<S, I>(out, res, args), 0)... };
+    (void)expand;
+
+    if(ok)
+        StaticLiteral_<S, sf_literal_begin_(S::data(), S::size(), sizeof...(I)), S::size()>::write(out);
+    return ok;
+}
+
+} // close namespace detail
+
+
+
+/* \brief Apply a compile-time format string, outputting it to a buffer
+ *
+ * The number and types of the arguments are checked at compile time.
+ * The output is appended to \p out.
+ *
+ * \throw format_error if snprintf fails
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] fmt The format string, created with BPPRINT_FMT
+ * \param [in] args Arguments to the format string
+ */
+template<typename S, typename... Targs>
+typename std::enable_if<std::is_base_of<detail::StaticFormatBase, S>::value>::type
+format_to(OutputBuffer & out, S fmt, Targs &&... args)
+{
+    (void)fmt;
+
+#ifdef BPPRINT_STATS
+    const detail::CallStats_ stats(out, S::data(), S::size());
+#endif
+
+    const detail::CallDepth_ depth(out);
+
+    typedef typename detail::StaticCheck_<S, sizeof...(args)>::type checked;
+
+    FormatResult res;
+    if(!detail::static_format_<S>(checked(), out, res,
+                                  typename detail::MakeIndices<sizeof...(args)>::type(),
+                                  args...))
+        detail::throw_format_error_(res);
+}
+
+
+
+/* \brief Apply a compile-time format string, reporting errors without throwing
+ *
+ * The number and types of the arguments are checked at compile time,
+ * so the only errors are failures of snprintf (see try_format_to in Format.hpp)
+ *
+ * \param [in] out The buffer to output to
+ * \param [in] fmt The format string, created with BPPRINT_FMT
+ * \param [in] args Arguments to the format string
+ * \return The outcome
+ */
+template<typename S, typename... Targs>
+typename std::enable_if<std::is_base_of<detail::StaticFormatBase, S>::value, FormatResult>::type
+try_format_to(OutputBuffer & out, S fmt, Targs &&... args) noexcept
+{
+    (void)fmt;
+
+#ifdef BPPRINT_STATS
+    const detail::CallStats_ stats(out, S::data(), S::size());
+#endif
+
+    const detail::CallDepth_ depth(out);
+
+    typedef typename detail::StaticCheck_<S, sizeof...(args)>::type checked;
+
+    FormatResult res;
+    detail::static_format_<S>(checked(), out, res,
+                              typename detail::MakeIndices<sizeof...(args)>::type(),
+                              args...);
+    return res;
+}
+
+
+
+/* \brief Apply a compile-time format string, outputting it to an ostream
+ *
+ * The number and types of the arguments are checked at compile time.
+ *
+ * \param [in] os The ostream to output to
+ * \param [in] fmt The format string, created with BPPRINT_FMT
+ * \param [in] args Arguments to the format string
+ */
+template<typename S, typename... Targs>
+typename std::enable_if<std::is_base_of<detail::StaticFormatBase, S>::value>::type
+format_stream(std::ostream & os, S fmt, Targs &&... args)
+{
+    MemoryBuffer buf;
+    format_to(buf, fmt, std::forward<Targs>(args)...);
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+
+
+/* \brief Apply a compile-time format string
+ *
+ * The number and types of the arguments are checked at compile time.
+ */
+template<typename S, typename... Targs>
+typename std::enable_if<std::is_base_of<detail::StaticFormatBase, S>::value, std::string>::type
+format_string(S fmt, Targs &&... args)
+{
+    MemoryBuffer buf;
+    format_to(buf, fmt, std::forward<Targs>(args)...);
+    return buf.str();
+}
+
+
+} // close namespace bpprint
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+namespace bpprint {
+
+
+/*! \brief A non-owning reference to a string
+ *
+ * This can be passed as an argument for %s (or %?) without copying
+ * the string. The string does not need to be null terminated. Unlike
+ * printf, all characters are output, including any embedded nulls
+ * (subject to the precision).
+ *
+ * Under C++17, `std::string_view` may be passed directly as well.
+ */
+class StringRef
+{
+    public:
+        StringRef(void) noexcept : data_(""), size_(0) { }
+
+        StringRef(const char * s, size_t n) noexcept : data_(s), size_(n) { }
+
+        StringRef(const char * s) noexcept : data_(s), size_(strlen(s)) { }
+
+        StringRef(const std::string & s) noexcept : data_(s.data()), size_(s.size()) { }
+
+#if __cplusplus >= 201703L
+        StringRef(std::string_view s) noexcept : data_(s.data()), size_(s.size()) { }
+#endif
+
+        //! Pointer to the characters (not necessarily null terminated)
+        const char * data(void) const noexcept { return data_; }
+
+        //! Number of characters
+        size_t size(void) const noexcept { return size_; }
+
+
+    private:
+        const char * data_;
+        size_t size_;
+};
+
+
+} // close namespace bpprint
@@ -0,0 +1,228 @@
+/*! \file
+ *
+ * Checks that formatting does not allocate memory unnecessarily
+ *
+ * Global operator new/delete are replaced with versions that
+ * count the number of allocations.
+ */
+
+#include <bpprint/Format.hpp>
+#include <bpprint/StaticFormat.hpp>
+#include <bpprint/Lazy.hpp>
+#include <bpprint/FdSink.hpp>
+#include <bpprint/Arena.hpp>
+#include <bpprint/Range.hpp>
+#include <bpprint/FixedString.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <new>
+#include <vector>
+
+static size_t nalloc = 0;
+
+void * operator new(size_t n)
+{
+    nalloc++;
+    void * p = malloc(n == 0 ? 1 : n);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+    free(p);
+}
+
+
+// A user-defined type written directly to the output
+struct Price
+{
+    long long cents;
+};
+
+namespace bpprint {
+template<>
+struct Formatter<Price>
+{
+    static constexpr const char * pftype = "f";
+
+    static void format(OutputBuffer & out, const ConvSpec & cs, char, const Price & p)
+    {
+        char tmp[32];
+        const int n = snprintf(tmp, sizeof(tmp), "%lld.%02lld", p.cents/100, p.cents%100);
+        write_field(out, cs, tmp, static_cast<size_t>(n));
+    }
+};
+}
+
+
+// Check the number of allocations done by a single statement
+// (buf is emptied first, so it never needs to grow)
+#define CHECK_ALLOCS(expected, ...) \
+    do { \
+        buf.clear(); \
+        const size_t before_ = nalloc; \
+        __VA_ARGS__; \
+        const size_t count_ = nalloc - before_; \
+        std::cout << #__VA_ARGS__ << "\n    allocations: " << count_ << "\n"; \
+        if(count_ != (expected)) \
+            throw std::runtime_error("!!!!! UNEXPECTED ALLOCATIONS !!!!!\n"); \
+    } while(0)
+
+
+int main(void)
+{
+#ifdef BPPRINT_STATS
+    // Counting calls for each format string allocates
+    std::cout << "Skipped (built with BPPRINT_STATS)\n";
+    return 0;
+#endif
+
+    try {
+        // Longer than any small string buffer
+        const std::string longstr("This string is too long to be stored inline");
+        const std::string fmt("%s: %d %s");
+        const bpprint::CompiledFormat cf(fmt);
+        const bpprint::StringRef ref(longstr);
+
+        bpprint::MemoryBuffer buf;
+        char fixed[128];
+
+        CHECK_ALLOCS(0, bpprint::format_to(buf, fmt, longstr, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, cf, longstr, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, BPPRINT_FMT("%s: %d %s"), longstr, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, cf, ref, 5, ref));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, BPPRINT_FMT("%s: %d %?"), ref, 5, ref));
+        CHECK_ALLOCS(0, bpprint::format_to_n(fixed, sizeof(fixed), cf, longstr, 5, longstr));
+
+        // Output too large for the stack buffer goes directly into the output buffer
+        bpprint::format_to(buf, "%1000e", 1.0);
+        CHECK_ALLOCS(0, bpprint::format_to(buf, "%1000e", 1.0));
+
+        // Truncated in fixed storage, within the stack buffer, with a spare byte,
+        // after earlier output, or at the start of the storage
+        const bpprint::CompiledFormat ecf("%1000e");
+        const bpprint::CompiledFormat iecf("%d %1000e");
+        char large[513];
+        bpprint::FixedBuffer lbuf(large, sizeof(large) - 1, true);
+        CHECK_ALLOCS(0, bpprint::format_to_n(fixed, sizeof(fixed), ecf, 1.0));
+        CHECK_ALLOCS(0, bpprint::format_to(lbuf, ecf, 1.0));
+        char big[300];
+        CHECK_ALLOCS(0, bpprint::format_to_n(big, sizeof(big), ecf, 1.0));
+        CHECK_ALLOCS(0, bpprint::format_to_n(big, sizeof(big), iecf, 1, 1.0));
+
+        // C string formats, once they are in the format cache
+        bpprint::format_to(buf, "%s: %d %s", longstr, 5, longstr);
+        CHECK_ALLOCS(0, bpprint::format_to(buf, "%s: %d %s", longstr, 5, longstr));
+
+        // Temporaries are forwarded, not copied
+        CHECK_ALLOCS(1, bpprint::format_to(buf, cf, std::string(longstr), 5, longstr));
+
+#if __cplusplus >= 201703L
+        const std::string_view view(longstr);
+        CHECK_ALLOCS(0, bpprint::format_to(buf, cf, view, 5, view));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, BPPRINT_FMT("%s: %d %?"), view, 5, view));
+#endif
+
+        // User-defined types
+        const Price price{ 123456 };
+        bpprint::format_to(buf, "%s: %10f", longstr, price);
+        CHECK_ALLOCS(0, bpprint::format_to(buf, "%s: %10f", longstr, price));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, BPPRINT_FMT("%s: %10f"), longstr, price));
+
+        // Ranges are written element by element
+        const std::vector<double> values(100, 2.5);
+        const std::vector<Price> prices(10, price);
+        bpprint::format_to(buf, "values=[%s]", bpprint::join(values, ", ", "%.3f"));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, "values=[%s]", bpprint::join(values, ", ", "%.3f")));
+        CHECK_ALLOCS(0, bpprint::format_to(buf, cf, bpprint::join(prices, " "), 5, bpprint::join(values, ";", "%g", 4)));
+
+        // Deferred formatting that is never used
+        CHECK_ALLOCS(0, auto l = bpprint::lazy("%s: %d %s", longstr, 5, longstr); (void)l);
+        CHECK_ALLOCS(0, bpprint::lazy("%s: %d %s", longstr, 5, longstr).format_to(buf));
+
+        // Writing to a file descriptor
+        const int devnull = open("/dev/null", O_WRONLY);
+        CHECK_ALLOCS(0, bpprint::format_fd(devnull, "%s: %d %s", longstr, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::format_fd(devnull, cf, longstr, 5, longstr));
+        close(devnull);
+
+        // Arguments used out of order
+        const bpprint::CompiledFormat pcf("%2$s: %1$d %3$-*4$.*5$s");
+        CHECK_ALLOCS(0, bpprint::format_to(buf, pcf, 5, longstr, longstr, 12, 8));
+        bpprint::format_to(buf, "%2$s: %1$d %3$*4$d", 5, longstr, 3, 4);
+        CHECK_ALLOCS(0, bpprint::format_to(buf, "%2$s: %1$d %3$*4$d", 5, longstr, 3, 4));
+
+        // Only the length of the output
+        CHECK_ALLOCS(0, bpprint::formatted_size(cf, longstr, 5, longstr));
+        bpprint::formatted_size("%1000e %s", 1.0, longstr);
+        CHECK_ALLOCS(0, bpprint::formatted_size("%1000e %s", 1.0, longstr));
+
+        // Errors reported without throwing
+        CHECK_ALLOCS(0, bpprint::try_format_to(buf, cf, longstr, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::try_format_to(buf, cf, 5, 5, longstr));
+        CHECK_ALLOCS(0, bpprint::try_format_to(buf, "%s: %d %s", longstr, 5));
+
+        // Results stored inline
+        const std::string shortstr("short");
+        bpprint::format_fixed<128>("%s: %d %s", shortstr, 5, longstr);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<128>("%s: %d %s", shortstr, 5, longstr); (void)f);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<128>(cf, shortstr, 5, longstr); (void)f);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<16>(BPPRINT_FMT("%s: %d %s"), longstr, 5, longstr); (void)f);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<16, bpprint::FixedOverflow::Report>(fmt, longstr, 5, 5); (void)f);
+
+        // Conversions done by snprintf, cut off by the end of the storage
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<16>(ecf, 1.0); (void)f);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<400>(ecf, 1.0); (void)f);
+        CHECK_ALLOCS(0, auto f = bpprint::format_fixed<300>(BPPRINT_FMT("%400e"), 2.5); (void)f);
+
+        // Only the result string
+        std::string result;
+        CHECK_ALLOCS(1, result = bpprint::format_string(cf, longstr, 5, longstr));
+        if(result != longstr + ": 5 " + longstr)
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT !!!!!\n");
+
+        // Output and result placed in an arena
+        char storage[4096];
+        bpprint::Arena arena(storage, sizeof(storage));
+        const bpprint::ArenaAllocator<char> alloc(arena);
+        bpprint::ArenaString aresult(alloc);
+        CHECK_ALLOCS(0, aresult = bpprint::format_string(std::allocator_arg, alloc, cf, longstr, 5, longstr));
+        CHECK_ALLOCS(0, aresult = bpprint::format_string(std::allocator_arg, alloc, "%1000e", 1.0));
+        CHECK_ALLOCS(0, bpprint::AllocatorBuffer<bpprint::ArenaAllocator<char>> abuf(alloc);
+                        bpprint::format_to(abuf, "%1000e", 1.0));
+        if(arena.heap_size() != 0)
+            throw std::runtime_error("!!!!! ARENA USED THE HEAP !!!!!\n");
+    }
+    catch(std::exception & ex)
+    {
+        std::cout << "Test failed: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*! \file
+ *
+ * Tests of the asynchronous logger
+ *
+ * Output is written to a temporary file, and compared
+ * with the output of format_string.
+ */
+
+#include <bpprint/AsyncLogger.hpp>
+#include <bpprint/Format.hpp>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+// Read everything written to a temporary file so far
+std::string read_file(FILE * f)
+{
+    fflush(f);
+    rewind(f);
+
+    std::string ret;
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        ret.append(buf, n);
+    return ret;
+}
+
+
+// Split output into lines
+std::vector<std::string> split_lines(const std::string & str)
+{
+    std::vector<std::string> lines;
+    std::istringstream ss(str);
+    std::string line;
+    while(std::getline(ss, line))
+        lines.push_back(line);
+    return lines;
+}
+
+
+void test_types(void)
+{
+    FILE * f = tmpfile();
+    const std::string str("a std::string");
+    const char * cstr = "a C string";
+    const char * nullstr = nullptr;
+    const int i = 5;
+    std::string expected;
+
+    {
+        bpprint::AsyncLogger logger(fileno(f));
+
+        #define LOG_AND_EXPECT(...) \
+            do { \
+                if(!logger.log(__VA_ARGS__)) \
+                    throw std::runtime_error("!!!!! MESSAGE DROPPED !!!!!\n"); \
+                expected += bpprint::format_string(__VA_ARGS__); \
+            } while(0)
+
+        LOG_AND_EXPECT("no arguments\n");
+        LOG_AND_EXPECT("%d %u %ld %lu %lld %llu\n", -1, 2u, -3l, 4ul, -5ll, 6ull);
+        LOG_AND_EXPECT("%hhd %hhu %hd %hu %c %d\n", static_cast<signed char>(-7),
+                       static_cast<unsigned char>(8), static_cast<short>(-9),
+                       static_cast<unsigned short>(10), 'x', true);
+        LOG_AND_EXPECT("%f %e %.3g %Lf %f\n", 1.5, 2.5e-10, 3.14159, 4.5L, 0.25f);
+        LOG_AND_EXPECT("%s|%-20s|%.4s|%s\n", str, cstr, cstr, nullstr);
+        LOG_AND_EXPECT("%p %p\n", static_cast<const void *>(cstr), &i);
+        LOG_AND_EXPECT("%p %s\n", cstr, cstr);
+        LOG_AND_EXPECT("%? %? %? %?\n", 1, 2.0, str, bpprint::StringRef(cstr, 3));
+        LOG_AND_EXPECT("[%s]\n", std::string("a\0b", 3));
+
+        #undef LOG_AND_EXPECT
+
+        // Reported in the output, rather than thrown
+        logger.log("%d\n", 1.0);
+        logger.log("%d %d\n", 1);
+        try {
+            bpprint::format_string("%d\n", 1.0);
+        }
+        catch(std::exception & ex)
+        {
+            expected += std::string("[bpprint error: ") + ex.what() + "]\n";
+        }
+        expected += "[bpprint error: Not enough arguments given to format string (argument 1, offset 3)]\n";
+
+        logger.flush();
+        if(logger.queue_depth() != 0 || logger.written() != 11)
+            throw std::runtime_error("!!!!! BAD LOGGER STATISTICS !!!!!\n");
+    }
+
+    const std::string output = read_file(f);
+    fclose(f);
+
+    std::cout << "Async output:\n" << output;
+    if(output != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (ASYNC) !!!!!\n");
+}
+
+
+// Log from several threads. Returns the output
+std::string log_threads(bpprint::AsyncLogger & logger, FILE * f, int nthread, int nmsg)
+{
+    std::vector<std::thread> threads;
+    for(int t = 0; t < nthread; t++)
+    {
+        threads.emplace_back([&logger, t, nmsg]{
+            for(int i = 0; i < nmsg; i++)
+                logger.log("thread %d message %d %s\n", t, i, std::string(static_cast<size_t>(i % 50), '*'));
+        });
+    }
+
+    for(auto & t : threads)
+        t.join();
+
+    logger.flush();
+    return read_file(f);
+}
+
+
+// Check that messages from each thread are in order,
+// and return the number of messages
+size_t check_order(const std::string & output, int nthread)
+{
+    std::map<int, int> last;
+    for(int t = 0; t < nthread; t++)
+        last[t] = -1;
+
+    const std::vector<std::string> lines = split_lines(output);
+    for(const auto & line : lines)
+    {
+        int t, i;
+        if(sscanf(line.c_str(), "thread %d message %d", &t, &i) != 2 || i <= last[t])
+            throw std::runtime_error("!!!!! BAD ASYNC OUTPUT: " + line + " !!!!!\n");
+
+        const std::string expected = bpprint::format_string("thread %d message %d %s", t, i,
+                                                            std::string(static_cast<size_t>(i % 50), '*'));
+        if(line != expected)
+            throw std::runtime_error("!!!!! BAD ASYNC OUTPUT: " + line + " !!!!!\n");
+        last[t] = i;
+    }
+
+    return lines.size();
+}
+
+
+void test_threads(void)
+{
+    const int nthread = 4;
+    const int nmsg = 20000;
+
+    // Blocking - nothing is lost
+    {
+        FILE * f = tmpfile();
+        bpprint::AsyncLogger logger(fileno(f), 1024, bpprint::AsyncLogger::OverflowPolicy::Block);
+        const std::string output = log_threads(logger, f, nthread, nmsg);
+        fclose(f);
+
+        const size_t n = check_order(output, nthread);
+        std::cout << "Blocking: " << n << " messages, " << logger.dropped() << " dropped\n";
+        if(n != nthread*nmsg || logger.dropped() != 0 || logger.written() != n)
+            throw std::runtime_error("!!!!! MESSAGES LOST (BLOCKING) !!!!!\n");
+    }
+
+    // Dropping - everything is either written or dropped
+    {
+        FILE * f = tmpfile();
+        bpprint::AsyncLogger logger(fileno(f), 1024, bpprint::AsyncLogger::OverflowPolicy::Drop);
+        const std::string output = log_threads(logger, f, nthread, nmsg);
+        fclose(f);
+
+        const size_t n = check_order(output, nthread);
+        std::cout << "Dropping: " << n << " messages, " << logger.dropped() << " dropped\n";
+        if(n + logger.dropped() != nthread*nmsg || logger.written() != n)
+            throw std::runtime_error("!!!!! MESSAGES LOST (DROPPING) !!!!!\n");
+
+        // Too large for the queue
+        if(logger.log("%s", std::string(1000, 'x')) || logger.dropped() != nthread*nmsg - n + 1)
+            throw std::runtime_error("!!!!! LARGE MESSAGE NOT DROPPED !!!!!\n");
+    }
+}
+
+
+void test_many_loggers(void)
+{
+    // This thread outlives every logger, so it must let go of their queues
+    FILE * f = tmpfile();
+    std::string expected;
+    for(int i = 0; i < 200; i++)
+    {
+        bpprint::AsyncLogger logger(fileno(f), 1 << 20);
+        logger.log("logger %d\n", i);
+        logger.flush();
+        expected += bpprint::format_string("logger %d\n", i);
+    }
+
+    const std::string output = read_file(f);
+    fclose(f);
+
+    if(output != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (MANY LOGGERS) !!!!!\n");
+}
+
+
+int main(void)
+{
+    try {
+        test_types();
+        test_threads();
+        test_many_loggers();
+    }
+    catch(std::exception & ex)
+    {
+        std::cout << "Test failed: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
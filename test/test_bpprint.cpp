@@ -1,5 +1,24 @@
 #include <bpprint/Format.hpp>
+#include <bpprint/StaticFormat.hpp>
+#include <bpprint/Lazy.hpp>
+#include <bpprint/BinaryLog.hpp>
+#include <bpprint/Batch.hpp>
+#include <bpprint/FdSink.hpp>
+#include <bpprint/Arena.hpp>
+#include <bpprint/Range.hpp>
+#include <bpprint/FixedString.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #if defined(__clang__)
     #pragma clang diagnostic push
@@ -7,6 +26,69 @@
 #endif
 
 
+// A fixed-point price, formatted through bpprint::Formatter
+struct Price
+{
+    long long cents;
+};
+
+// An identifier, formatted using bpprint itself
+struct UserId
+{
+    unsigned int id;
+};
+
+// A tag, formatted using bpprint with a format string that is built each time
+struct Tag
+{
+    int n;
+};
+
+namespace bpprint {
+
+template<>
+struct Formatter<Price>
+{
+    static constexpr const char * pftype = "fs";
+
+    // %f is the amount, %s includes the currency
+    static void format(OutputBuffer & out, const ConvSpec & cs, char spec, const Price & p)
+    {
+        const unsigned long long a = p.cents < 0 ? 0ull - static_cast<unsigned long long>(p.cents)
+                                                 : static_cast<unsigned long long>(p.cents);
+        char tmp[32];
+        const int n = snprintf(tmp, sizeof(tmp), "%s%s%llu.%02llu", spec == 's' ? "$" : "",
+                               p.cents < 0 ? "-" : "", a/100, a%100);
+        write_field(out, cs, tmp, static_cast<size_t>(n));
+    }
+};
+
+template<>
+struct Formatter<UserId>
+{
+    static constexpr const char * pftype = "dx";
+
+    static void format(OutputBuffer & out, const ConvSpec &, char spec, const UserId & u)
+    {
+        format_to(out, spec == 'x' ? "user-%x" : "user-%u", u.id);
+    }
+};
+
+template<>
+struct Formatter<Tag>
+{
+    static constexpr const char * pftype = "s";
+
+    static void format(OutputBuffer & out, const ConvSpec &, char, const Tag & t)
+    {
+        const std::string fmt = std::string("<tag ") + std::string(40, '=') + " %d>";
+        format_to(out, fmt, t.n);
+    }
+};
+
+} // close namespace bpprint
+
+
 template<typename... Targs>
 void test_string(const std::string & fmt, Targs... args)
 {
@@ -21,6 +103,75 @@ void test_string(const std::string & fmt, Targs... args)
 
     if(std::string(refstr) != bpstr)
         throw std::runtime_error("!!!!! MISMATCHED OUTPUT !!!!!\n");
+
+    // Same thing, but compiled ahead of time
+    bpprint::CompiledFormat cf(fmt);
+    std::string cfstr = bpprint::format_string(cf, args...);
+
+    if(std::string(refstr) != cfstr)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (COMPILED) !!!!!\n");
+
+    // As a C string (through the format cache)
+    if(std::string(refstr) != bpprint::format_string(fmt.c_str(), args...))
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (C STRING) !!!!!\n");
+
+    // Only the length
+    const size_t reflen = strlen(refstr);
+    if(bpprint::formatted_size(fmt, args...) != reflen ||
+       bpprint::formatted_size(cf, args...) != reflen ||
+       bpprint::formatted_size(fmt.c_str(), args...) != reflen)
+        throw std::runtime_error("!!!!! WRONG SIZE !!!!!\n");
+
+    // Into fixed storage, with and without enough room
+    char fixed[1024];
+    const size_t n = bpprint::format_to_n(fixed, sizeof(fixed), fmt, args...);
+    if(std::string(refstr) != std::string(fixed, n))
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED) !!!!!\n");
+
+    const size_t half = n/2;
+    if(bpprint::format_to_n(fixed, half, cf, args...) != n ||
+       std::string(refstr, half) != std::string(fixed, half))
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (TRUNCATED) !!!!!\n");
+}
+
+template<typename... Targs>
+void test_throws(const std::string & fmt, Targs... args)
+{
+    bool threw = false;
+    try {
+        bpprint::format_string(fmt, args...);
+    }
+    catch(std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED EXCEPTION: " + fmt + " !!!!!\n");
+
+    threw = false;
+    try {
+        bpprint::format_string(bpprint::CompiledFormat(fmt), args...);
+    }
+    catch(std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED EXCEPTION (COMPILED): " + fmt + " !!!!!\n");
+
+    threw = false;
+    try {
+        bpprint::format_string(fmt.c_str(), args...);
+    }
+    catch(std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED EXCEPTION (C STRING): " + fmt + " !!!!!\n");
 }
 
 template<typename... Targs>
@@ -40,6 +191,1092 @@ void test_format(const std::string & fmt, Targs &&... args)
 }
 
 
+// Compare a compile-time format string with snprintf
+#define TEST_STATIC(fmt, ...) \
+    do { \
+        char refstr[1024]; \
+        snprintf(refstr, 1024, fmt, __VA_ARGS__); \
+        std::string bpstr = bpprint::format_string(BPPRINT_FMT(fmt), __VA_ARGS__); \
+        std::cout << "Static format string: " << fmt << "\n"; \
+        std::cout << "    Reference output: " << refstr << "\n"; \
+        std::cout << "      BPPrint output: " << bpstr << "\n"; \
+        if(std::string(refstr) != bpstr) \
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STATIC) !!!!!\n"); \
+        if(bpprint::formatted_size(BPPRINT_FMT(fmt), __VA_ARGS__) != bpstr.size()) \
+            throw std::runtime_error("!!!!! WRONG SIZE (STATIC) !!!!!\n"); \
+    } while(0)
+
+
+void test_static(void)
+{
+    const std::string str("a std::string");
+    const double d = 10.1;
+
+    TEST_STATIC("%s", "Hello");
+    TEST_STATIC("%-12s|%12s", "Hello", str.c_str());
+    TEST_STATIC("%%%d%%", 5);
+    TEST_STATIC("%% %% %5.2f %%", 1.2345);
+    TEST_STATIC("%lu %llx %#o %hhd", 10ul, 0xdeadbeefull, 8u,
+                static_cast<signed char>(-3));
+    TEST_STATIC("%s=%d, %s=%.2f\n", "a", 1, "b", 2.0);
+    TEST_STATIC("%p", static_cast<const void *>(&d));
+
+    // Things snprintf can't do
+    if(bpprint::format_string(BPPRINT_FMT("%? %? %? %?"), 5, 2.5, "x", str) != "5 2.500000 x a std::string")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STATIC AUTO) !!!!!\n");
+    if(bpprint::format_string(BPPRINT_FMT("[%s]"), str) != "[a std::string]")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STATIC STRING) !!!!!\n");
+    if(bpprint::format_string(BPPRINT_FMT("no arguments %%")) != "no arguments %")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STATIC NOARG) !!!!!\n");
+}
+
+
+// Compare with snprintf, only printing mismatches
+template<typename T>
+void check_quiet(const std::string & fmt, T value)
+{
+    char refstr[1024];
+    snprintf(refstr, 1024, fmt.c_str(), value);
+
+    const std::string bpstr = bpprint::format_string(fmt, value);
+    if(std::string(refstr) != bpstr)
+    {
+        std::cout << "Format string: " << fmt << "\n";
+        std::cout << "    Reference output: " << refstr << "\n";
+        std::cout << "      BPPrint output: " << bpstr << "\n";
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (CONVERSION) !!!!!\n");
+    }
+
+    if(bpprint::formatted_size(fmt, value) != bpstr.size())
+        throw std::runtime_error("!!!!! WRONG SIZE (CONVERSION): " + fmt + " !!!!!\n");
+}
+
+
+// All combinations of flags, widths, and precisions for some specifiers
+template<typename T>
+void check_conversions(const std::string & length, const std::string & specs,
+                       const std::vector<T> & values)
+{
+    const char * flags[] = { "", "-", "+", " ", "#", "0", "-+", "+0", " 0", "#0", "-#", "-0" };
+    const char * widths[] = { "", "1", "8", "25" };
+    const char * precs[] = { "", ".", ".0", ".1", ".5", ".17", ".19", ".30" };
+
+    for(auto f : flags)
+    for(auto w : widths)
+    for(auto p : precs)
+    for(auto spec : specs)
+    for(auto v : values)
+        check_quiet(std::string("%") + f + w + p + length + spec, v);
+}
+
+
+// Long literal text, with % at every position (vectorized scanning)
+void test_long_literals(void)
+{
+    for(size_t len = 0; len < 100; len++)
+    {
+        std::string lit(len, 'a');
+        for(size_t i = 0; i < len; i++)
+            lit[i] = static_cast<char>(i % 2 ? 0xE9 : 'a' + (i % 26));  // includes non-ASCII
+
+        if(bpprint::detail::find_percent_(lit.data(), len) != len)
+            throw std::runtime_error("!!!!! WRONG POSITION OF % !!!!!\n");
+
+        for(size_t pct = 0; pct < len; pct++)
+        {
+            std::string s(lit);
+            s[pct] = '%';
+            if(bpprint::detail::find_percent_(s.data(), len) != pct)
+                throw std::runtime_error("!!!!! WRONG POSITION OF % !!!!!\n");
+        }
+
+        // As part of a format, with escaped %%
+        const std::string fmt = lit + "%d" + lit + "%%" + lit + "%s" + lit;
+        const std::string expected = lit + "42" + lit + "%" + lit + "str" + lit;
+        if(bpprint::format_string(fmt, 42, "str") != expected ||
+           bpprint::format_string(bpprint::CompiledFormat(fmt), 42, "str") != expected)
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LONG LITERAL) !!!!!\n");
+    }
+}
+
+
+void test_conversions(void)
+{
+    std::mt19937_64 gen(12345);
+
+    std::vector<int> ints = { 0, 1, -1, 7, -8, 99, 100, -100, 12345,
+                              std::numeric_limits<int>::max(),
+                              std::numeric_limits<int>::min() };
+    std::vector<unsigned long long> ulls = { 0, 1, 7, 8, 255, 256, 1000000,
+                                             std::numeric_limits<unsigned long long>::max() };
+    std::vector<long long> lls = { 0, -1, std::numeric_limits<long long>::max(),
+                                   std::numeric_limits<long long>::min() };
+    std::vector<double> doubles = { 0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.05, 0.125, 1e-7,
+                                    3.14159265358979, 123456.789, 1e15, 1e19, 1e20, 1e300,
+                                    -1e-300, 5e-324, 0.1, 0.3, 9.9999995, 999999.9999995,
+                                    std::numeric_limits<double>::infinity(),
+                                    -std::numeric_limits<double>::infinity(),
+                                    std::numeric_limits<double>::quiet_NaN() };
+
+    for(int i = 0; i < 20; i++)
+    {
+        ints.push_back(static_cast<int>(gen()));
+        ulls.push_back(gen() >> (gen() % 64));
+        std::uniform_real_distribution<double> dist(-1e6, 1e6);
+        doubles.push_back(dist(gen));
+        doubles.push_back(dist(gen) / 1e6);
+    }
+
+    check_conversions("", "d", ints);
+    check_conversions("ll", "uoxX", ulls);
+    check_conversions("ll", "d", lls);
+    check_conversions("", "fFeEgG", doubles);
+    check_conversions("", "c", std::vector<char>{ 'a', ' ' });
+    check_conversions("", "s", std::vector<const char *>{ "", "a", "hello world" });
+
+    // Many values with the most common specifications
+    std::uniform_real_distribution<double> dist(-1e4, 1e4);
+    for(int i = 0; i < 100000; i++)
+    {
+        const double d = dist(gen);
+        check_quiet("%.6f", d);
+        check_quiet("%f", d * 1e-8);
+        check_quiet("%.3f", static_cast<double>(static_cast<int>(d)) + 0.0005);
+        check_quiet("%d", static_cast<int>(gen()));
+        check_quiet("%lx", static_cast<unsigned long>(gen()));
+    }
+}
+
+
+void test_buffers(void)
+{
+    // Grows past the inline storage
+    bpprint::BasicMemoryBuffer<8> buf;
+    for(int i = 0; i < 100; i++)
+        bpprint::format_to(buf, "%d,", i);
+
+    std::string ref;
+    for(int i = 0; i < 100; i++)
+        ref += std::to_string(i) + ",";
+
+    if(buf.str() != ref || buf.truncated())
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (MEMORY BUFFER) !!!!!\n");
+
+    // Output past the end of fixed storage is dropped
+    char fixed[4] = { 'x', 'x', 'x', 'x' };
+    bpprint::FixedBuffer fbuf(fixed, 3);
+    bpprint::format_to(fbuf, BPPRINT_FMT("%s%d"), "ab", 1234);
+    if(fbuf.size() != 6 || !fbuf.truncated() || fbuf.str() != "ab1" || fixed[3] != 'x')
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED BUFFER) !!!!!\n");
+}
+
+
+// Check that a function throws
+template<typename F>
+void test_throws_fn(F f)
+{
+    bool threw = false;
+    try {
+        f();
+    }
+    catch(std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED EXCEPTION !!!!!\n");
+}
+
+
+// Compare a (possibly very large) output with snprintf
+template<typename T>
+void check_large(const std::string & fmt, T value)
+{
+    const int n = snprintf(nullptr, 0, fmt.c_str(), value);
+    std::vector<char> ref(static_cast<size_t>(n)+1);
+    snprintf(ref.data(), ref.size(), fmt.c_str(), value);
+    const std::string refstr(ref.data(), static_cast<size_t>(n));
+
+    // after some text, so it doesn't start at the beginning of the buffer
+    bpprint::MemoryBuffer buf;
+    bpprint::format_to(buf, "%s", "prefix");
+    bpprint::format_to(buf, fmt, value);
+    if(buf.str() != "prefix" + refstr)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LARGE): " + fmt + " !!!!!\n");
+
+    // Fixed storage, truncated and not
+    std::vector<char> fixed(refstr.size() + 3, 'x');
+    for(size_t len : { size_t(100), refstr.size()/2, refstr.size()-1, refstr.size() })
+    {
+        if(bpprint::format_to_n(fixed.data(), len, fmt, value) != refstr.size() ||
+           std::string(fixed.data(), len) != refstr.substr(0, len) ||
+           fixed[len] != 'x')
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LARGE FIXED): " + fmt + " !!!!!\n");
+
+        // After some text
+        if(bpprint::format_to_n(fixed.data(), len+2, "ab" + fmt, value) != refstr.size()+2 ||
+           std::string(fixed.data(), len+2) != ("ab" + refstr).substr(0, len+2) ||
+           fixed[len+2] != 'x')
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LARGE FIXED, PREFIX): " + fmt + " !!!!!\n");
+        std::fill(fixed.begin(), fixed.end(), 'x');
+
+        // With a spare byte after the storage
+        bpprint::FixedBuffer fbuf(fixed.data(), len, true);
+        bpprint::format_to(fbuf, fmt, value);
+        if(fbuf.size() != refstr.size() || std::string(fixed.data(), len) != refstr.substr(0, len))
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LARGE FIXED, SPARE BYTE): " + fmt + " !!!!!\n");
+        fixed[len] = 'x';
+    }
+}
+
+
+void test_large(void)
+{
+    const std::vector<int> widths = { 254, 255, 256, 257, 300, 1000, 65536, 1 << 20, 5 << 20 };
+
+    for(int w : widths)
+    {
+        const std::string width = std::to_string(w);
+        check_large("%" + width + "e", 1.5);
+        check_large("%-" + width + ".3Lf", 2.25L);
+        check_large("%" + width + "d", -12);
+        check_large("%" + width + "s", "a string");
+        check_large("%s", std::string(static_cast<size_t>(w), 'z').c_str());
+        check_large("%0" + width + ".2f", -1.5);
+        check_large("%+0" + width + "a", 1.0);
+        check_large("% 0" + width + "Le", 3.5L);
+        check_large("%0" + width + "f", -HUGE_VAL);
+        check_large("%" + width + "p", static_cast<void *>(&w));
+    }
+
+    // Long without any padding
+    check_large("%f", 1e300);
+    check_large("%.3000e", 0.1);
+    check_large("%-+.500Lf", 1.0L/3);
+}
+
+
+void test_lazy(void)
+{
+    const std::string str("a std::string");
+    const std::string fmt("%s %d %.2f");
+    const bpprint::CompiledFormat cf(fmt);
+    const std::string expected = "a std::string 5 2.50";
+
+    std::ostringstream ss;
+    ss << bpprint::lazy("%s %d %.2f", str, 5, 2.5) << "|"
+       << bpprint::lazy(fmt, str, 5, 2.5) << "|"
+       << bpprint::lazy(cf, str, 5, 2.5) << "|"
+       << bpprint::lazy(BPPRINT_FMT("%s %d %.2f"), str, 5, 2.5);
+
+    if(ss.str() != expected + "|" + expected + "|" + expected + "|" + expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LAZY) !!!!!\n");
+
+    const std::string converted = bpprint::lazy("%s %d %.2f", str, 5, 2.5);
+    if(converted != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LAZY STRING) !!!!!\n");
+
+    // Errors only happen when formatting
+    const auto bad = bpprint::lazy("%d", str);
+    bool threw = false;
+    try {
+        bad.str();
+    }
+    catch(std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED EXCEPTION (LAZY) !!!!!\n");
+}
+
+
+void test_binary_log(void)
+{
+    const std::string str("a std::string");
+    const char * cstr = "a C string";
+    std::string expected;
+    char reused[16];
+
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+
+    {
+        bpprint::BinaryLogWriter writer(ss);
+
+        #define WRITE_AND_EXPECT(...) \
+            do { \
+                writer.write(__VA_ARGS__); \
+                expected += bpprint::format_string(__VA_ARGS__); \
+            } while(0)
+
+        for(int i = 0; i < 3; i++)
+        {
+            WRITE_AND_EXPECT("no arguments\n");
+            WRITE_AND_EXPECT("%d %u %ld %lu %lld %llu\n", -i, 2u, -3l, 4ul, -5ll, 6ull);
+            WRITE_AND_EXPECT("%hhd %hhu %hd %hu %c %d\n", static_cast<signed char>(-7),
+                             static_cast<unsigned char>(8), static_cast<short>(-9),
+                             static_cast<unsigned short>(10), 'x', true);
+            WRITE_AND_EXPECT("%f %e %.3g %Lf %f\n", 1.5*i, 2.5e-10, 3.14159, 4.5L, 0.25f);
+            WRITE_AND_EXPECT("%s|%-20s|%.4s|%p\n", str, cstr, cstr, static_cast<const void *>(cstr));
+            WRITE_AND_EXPECT("%? %? %?\n", i, str, bpprint::StringRef(cstr, 3));
+
+            // Same address, different format
+            strcpy(reused, i % 2 ? "odd %d\n" : "even %d\n");
+            WRITE_AND_EXPECT(reused, i);
+        }
+
+        #undef WRITE_AND_EXPECT
+
+        // std::string ends at the first null, as when formatting
+        const std::string nulstr("a\0b", 3);
+        writer.write("[%s]\n", nulstr);
+        expected += bpprint::format_string("[%s]\n", nulstr);
+
+        // C strings can also be used as pointers
+        writer.write("%p\n", cstr);
+        expected += bpprint::format_string("%p\n", cstr);
+
+        // Reported in the output
+        writer.write("%d\n", cstr);
+        expected += "[bpprint error: Bad type specifier for type const char * (argument 0, offset 0)]\n";
+        writer.write("%d\n", str);
+        expected += "[bpprint error: Bad type specifier for type std::string (argument 0, offset 0)]\n";
+        writer.write("%2$d %1$d\n", 1, 2);
+        expected += "[bpprint error: Positional arguments and '*' are not supported here (offset 0)]\n";
+
+        if(writer.nformats() != 13)
+            throw std::runtime_error("!!!!! WRONG NUMBER OF FORMATS (BINARY LOG) !!!!!\n");
+    }
+
+    bpprint::BinaryLogReader reader(ss);
+    bpprint::MemoryBuffer buf;
+    size_t nmsg = 0;
+    while(reader.next(buf))
+        nmsg++;
+
+    std::cout << "Binary log: " << ss.str().size() << " bytes, " << buf.size() << " bytes of text\n";
+    if(nmsg != 26 || buf.str().compare(0, expected.size(), expected) != 0)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (BINARY LOG) !!!!!\n");
+
+    // Not a log
+    std::stringstream notlog("this is not a binary log");
+    test_throws_fn([&]{ bpprint::BinaryLogReader r(notlog); });
+
+    // Truncated log
+    std::string truncated = ss.str();
+    truncated.resize(truncated.size() - 3);
+    std::stringstream tss(truncated);
+    test_throws_fn([&]{ bpprint::BinaryLogReader r(tss); while(r.next(buf)) { } });
+
+    // Damaged sizes are reported as corruption, without allocating them
+    const std::string header = ss.str().substr(0, 20);
+    static const char dict_record[] = "D\x00\xff\xff\xff\xff\xff\xff\xff\xff\x7f";
+    static const char msg_record[] = "D\x00\x01xM\x00\xff\xff\xff\xff\x0f";
+    for(const std::string & records : { std::string(dict_record, sizeof(dict_record) - 1),
+                                        std::string(msg_record, sizeof(msg_record) - 1) })
+    {
+        std::stringstream css(header + records);
+        std::string what;
+        try {
+            bpprint::BinaryLogReader r(css);
+            while(r.next(buf)) { }
+        }
+        catch(std::runtime_error & ex)
+        {
+            what = ex.what();
+        }
+
+        if(what != "Corrupt binary log")
+            throw std::runtime_error("!!!!! EXPECTED CORRUPT BINARY LOG: " + what + " !!!!!\n");
+    }
+}
+
+
+void test_batch(void)
+{
+    const size_t nrows = 100;
+    std::vector<int> ints;
+    std::vector<unsigned long> ulongs;
+    std::vector<double> doubles;
+    std::vector<std::string> strs;
+    std::vector<const char *> cstrs;
+    std::vector<std::tuple<int, std::string, float, const char *>> tuples;
+
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<int> idist(-100000, 100000);
+    std::uniform_real_distribution<double> ddist(-1.0e6, 1.0e6);
+    static const char * names[] = { "alpha", "beta", "gamma", "delta" };
+
+    for(size_t i = 0; i < nrows; i++)
+    {
+        ints.push_back(idist(gen));
+        ulongs.push_back(static_cast<unsigned long>(i*i*12345));
+        doubles.push_back(ddist(gen));
+        strs.push_back(std::string(i % 13, 'x'));
+        cstrs.push_back(names[i%4]);
+        tuples.emplace_back(ints.back(), strs.back(), static_cast<float>(doubles.back()), names[i%4]);
+    }
+
+    const std::string fmt1("%d,%lu,%.6f,%s,%-8s|%p\n");
+    const std::string fmt2("%? %10.3e [%5s] %x\n");
+    const std::string fmt3("%d:%s:%g:%s\n");
+
+    std::vector<unsigned int> masked;
+    for(auto u : ulongs)
+        masked.push_back(static_cast<unsigned int>(u & 0xFFFFu));
+
+    std::string expected1, expected2, expected3;
+    for(size_t i = 0; i < nrows; i++)
+    {
+        expected1 += bpprint::format_string(fmt1, ints[i], ulongs[i], doubles[i], strs[i], cstrs[i], cstrs[i]);
+        expected2 += bpprint::format_string(fmt2, ints[i], doubles[i], cstrs[i], masked[i]);
+        expected3 += bpprint::format_string(fmt3, std::get<0>(tuples[i]), std::get<1>(tuples[i]),
+                                            std::get<2>(tuples[i]), std::get<3>(tuples[i]));
+    }
+
+    bpprint::MemoryBuffer buf;
+    bpprint::format_columns(buf, fmt1, nrows, ints.data(), ulongs.data(), doubles.data(),
+                            strs.data(), cstrs.data(), cstrs.data());
+    if(buf.str() != expected1)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (BATCH COLUMNS) !!!!!\n");
+
+    buf.clear();
+    const bpprint::CompiledFormat cf2(fmt2);
+    bpprint::format_columns(buf, cf2, nrows, ints.data(), doubles.data(), cstrs.data(), masked.data());
+    if(buf.str() != expected2)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (BATCH COLUMNS) !!!!!\n");
+
+    buf.clear();
+    bpprint::format_rows(buf, fmt3, tuples.begin(), tuples.end());
+    if(buf.str() != expected3)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (BATCH ROWS) !!!!!\n");
+
+    // In parallel, with various numbers of threads and chunk sizes
+    for(size_t nthreads : { 1, 2, 5 })
+    {
+        for(size_t chunk_rows : { 1, 7, 1000 })
+        {
+            bpprint::ParallelOptions opts;
+            opts.nthreads = nthreads;
+            opts.chunk_rows = chunk_rows;
+
+            buf.clear();
+            bpprint::format_columns_parallel(buf, cf2, opts, nrows, ints.data(), doubles.data(),
+                                             cstrs.data(), masked.data());
+            if(buf.str() != expected2)
+                throw std::runtime_error("!!!!! MISMATCHED OUTPUT (PARALLEL COLUMNS) !!!!!\n");
+
+            std::ostringstream ss;
+            bpprint::format_rows_parallel(ss, bpprint::CompiledFormat(fmt3), opts, tuples.begin(), tuples.end());
+            if(ss.str() != expected3)
+                throw std::runtime_error("!!!!! MISMATCHED OUTPUT (PARALLEL ROWS) !!!!!\n");
+        }
+    }
+
+    // Empty batches and no arguments
+    buf.clear();
+    bpprint::format_columns(buf, fmt1, 0, ints.data(), ulongs.data(), doubles.data(),
+                            strs.data(), cstrs.data(), cstrs.data());
+    bpprint::format_rows(buf, fmt3, tuples.end(), tuples.end());
+    bpprint::format_columns(buf, "line\n", 3);
+    if(buf.str() != "line\nline\nline\n")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (EMPTY BATCH) !!!!!\n");
+
+    // Wrong number or type of columns
+    test_throws_fn([&]{ bpprint::format_columns(buf, fmt3, nrows, ints.data()); });
+    test_throws_fn([&]{ bpprint::format_columns(buf, "%2$d %1$d\n", nrows, ints.data(), ints.data()); });
+    test_throws_fn([&]{ bpprint::format_columns(buf, "%d", nrows, ints.data(), ints.data()); });
+    test_throws_fn([&]{ bpprint::format_columns(buf, "%s", nrows, ints.data()); });
+    test_throws_fn([&]{ bpprint::format_rows(buf, "%d %d", tuples.begin(), tuples.end()); });
+    test_throws_fn([&]{ bpprint::format_columns_parallel(buf, cf2, bpprint::ParallelOptions(), nrows,
+                                                         ints.data(), ints.data(), cstrs.data(), masked.data()); });
+}
+
+
+// Read everything written to a temporary file
+std::string read_file(FILE * f)
+{
+    fflush(f);
+    rewind(f);
+
+    std::string ret;
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        ret.append(buf, n);
+    return ret;
+}
+
+
+void test_fd_sink(void)
+{
+    const std::string longstr(2000, 'z');
+    const std::string sfmt("std::string %s %5.1f%%\n");
+    const bpprint::CompiledFormat cf("compiled [%-6d] %x\n");
+    std::string expected;
+
+    FILE * f = tmpfile();
+    if(f == nullptr)
+        throw std::runtime_error("!!!!! COULD NOT CREATE TEMPORARY FILE !!!!!\n");
+    const int fd = fileno(f);
+
+    // Each message written immediately, and batched
+    for(size_t batch_size : { 0, 100, 100000 })
+    {
+        {
+            bpprint::FdSink sink(fd, batch_size);
+
+            for(int i = 0; i < 200; i++)
+            {
+                sink.format("100%% C string %d %s|\n", i, "arg");
+                sink.format(sfmt, longstr.substr(0, static_cast<size_t>(i)*10), 0.5*i);
+                sink.format(cf, i, static_cast<unsigned int>(i));
+                sink.format(BPPRINT_FMT("static %c%c\n"), 'o', 'k');
+                sink.format("no arguments\n");
+
+                // Formatters using format strings that do not outlive the call
+                sink.format("tag %s %d\n", Tag{i}, UserId{static_cast<unsigned int>(i)});
+                sink.format(BPPRINT_FMT("static tag %s\n"), Tag{i});
+
+                expected += bpprint::format_string("100%% C string %d %s|\n", i, "arg");
+                expected += bpprint::format_string(sfmt, longstr.substr(0, static_cast<size_t>(i)*10), 0.5*i);
+                expected += bpprint::format_string(cf, i, static_cast<unsigned int>(i));
+                expected += "static ok\nno arguments\n";
+                expected += bpprint::format_string("tag %s %d\n", Tag{i}, UserId{static_cast<unsigned int>(i)});
+                expected += bpprint::format_string("static tag %s\n", Tag{i});
+
+                // Nothing from a bad message is written
+                test_throws_fn([&]{ sink.format("good %d, then bad %d\n", 1, "x"); });
+            }
+        }
+
+        bpprint::format_fd(fd, "format_fd %s %d\n", longstr, 42);
+        expected += bpprint::format_string("format_fd %s %d\n", longstr, 42);
+
+        bpprint::format_fd(fd, "a %s\n", Tag{1});
+        expected += bpprint::format_string("a %s\n", Tag{1});
+    }
+
+    if(read_file(f) != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FD SINK) !!!!!\n");
+
+    fclose(f);
+
+    // Writing to a bad file descriptor
+    test_throws_fn([&]{ bpprint::format_fd(-1, "%d\n", 1); });
+}
+
+
+void test_arena(void)
+{
+    const std::string longstr(3000, 'q');
+    const bpprint::CompiledFormat cf("%s|%5d|%s");
+
+    // Starts with a small caller buffer, then moves to heap blocks
+    char storage[256];
+    bpprint::Arena arena(storage, sizeof(storage), 128);
+    const bpprint::ArenaAllocator<char> alloc(arena);
+
+    for(int pass = 0; pass < 3; pass++)
+    {
+        for(int i = 0; i < 20; i++)
+        {
+            const std::string expected = bpprint::format_string(cf, longstr.substr(0, static_cast<size_t>(i)*150), i, "end");
+
+            bpprint::ArenaString s1 = bpprint::format_string(std::allocator_arg, alloc, cf,
+                                                             longstr.substr(0, static_cast<size_t>(i)*150), i, "end");
+            bpprint::ArenaString s2 = bpprint::format_string(std::allocator_arg, alloc, "%s|%5d|%s",
+                                                             longstr.substr(0, static_cast<size_t>(i)*150), i, "end");
+            bpprint::ArenaString s3 = bpprint::format_string(std::allocator_arg, alloc, BPPRINT_FMT("%s|%5d|%s"),
+                                                             longstr.substr(0, static_cast<size_t>(i)*150), i, "end");
+
+            if(std::string(s1.data(), s1.size()) != expected ||
+               std::string(s2.data(), s2.size()) != expected ||
+               std::string(s3.data(), s3.size()) != expected)
+                throw std::runtime_error("!!!!! MISMATCHED OUTPUT (ARENA) !!!!!\n");
+        }
+
+        // Blocks are kept for reuse
+        const size_t heap_size = arena.heap_size();
+        arena.reset();
+        if(arena.used() != 0 || (pass > 0 && heap_size != arena.heap_size()))
+            throw std::runtime_error("!!!!! BAD ARENA REUSE !!!!!\n");
+    }
+
+    // Alignment of allocations
+    for(size_t align : { 1, 2, 8, 16, 64 })
+    {
+        arena.allocate(1, 1);
+        void * p = arena.allocate(10, align);
+        if(reinterpret_cast<std::uintptr_t>(p) % align != 0)
+            throw std::runtime_error("!!!!! BAD ARENA ALIGNMENT !!!!!\n");
+    }
+
+    // Sizes too large for any block
+    bpprint::ArenaAllocator<double> dalloc(arena);
+    for(size_t n : { SIZE_MAX, SIZE_MAX - 16 })
+    {
+        bool threw = false;
+        try {
+            arena.allocate(n);
+        }
+        catch(std::bad_alloc &)
+        {
+            threw = true;
+        }
+
+        try {
+            dalloc.allocate(n / 4);
+            threw = false;
+        }
+        catch(std::bad_alloc &)
+        { }
+
+        if(!threw)
+            throw std::runtime_error("!!!!! EXPECTED EXCEPTION (ARENA SIZE) !!!!!\n");
+    }
+
+    arena.release();
+    if(arena.heap_size() != 0 || arena.used() != 0)
+        throw std::runtime_error("!!!!! BAD ARENA RELEASE !!!!!\n");
+
+    // Errors are still reported
+    test_throws_fn([&]{ bpprint::format_string(std::allocator_arg, alloc, "%d %d", 1); });
+}
+
+
+void test_user_types(void)
+{
+    const Price p{ 123456 };
+    const Price neg{ -5 };
+    const UserId u{ 255 };
+
+    const char * fmt = "[%f] [%s] [%10f] [%-9s|] [%.4f] [%?] [%d] [%x] [%?]";
+    const std::string expected = "[1234.56] [$1234.56] [   1234.56] [$-0.05   |] [1234] [1234.56] "
+                                 "[user-255] [user-ff] [user-255]";
+    const bpprint::CompiledFormat cf(fmt);
+
+    if(bpprint::format_string(std::string(fmt), p, p, p, neg, p, p, u, u, u) != expected ||
+       bpprint::format_string(fmt, p, p, p, neg, p, p, u, u, u) != expected ||
+       bpprint::format_string(cf, p, p, p, neg, p, p, u, u, u) != expected ||
+       bpprint::format_string(BPPRINT_FMT("[%f] [%s] [%10f] [%-9s|] [%.4f] [%?] [%d] [%x] [%?]"),
+                              p, p, p, neg, p, p, u, u, u) != expected ||
+       bpprint::lazy(fmt, p, p, p, neg, p, p, u, u, u).str() != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (USER TYPES) !!!!!\n");
+
+    // Mixed with basic types, in batches
+    std::vector<Price> prices;
+    std::vector<int> ints;
+    std::vector<std::tuple<UserId, Price>> rows;
+    std::string expected_cols, expected_rows;
+    for(int i = 0; i < 50; i++)
+    {
+        prices.push_back(Price{ i*1001 - 1000 });
+        ints.push_back(i);
+        rows.emplace_back(UserId{ static_cast<unsigned int>(i) }, prices.back());
+        expected_cols += bpprint::format_string("%d: %8f\n", i, prices.back());
+        expected_rows += bpprint::format_string("%x %s\n", std::get<0>(rows.back()), prices.back());
+    }
+
+    bpprint::MemoryBuffer buf;
+    bpprint::format_columns(buf, "%d: %8f\n", prices.size(), ints.data(), prices.data());
+    if(buf.str() != expected_cols)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (USER TYPE COLUMNS) !!!!!\n");
+
+    buf.clear();
+    bpprint::format_rows(buf, "%x %s\n", rows.begin(), rows.end());
+    if(buf.str() != expected_rows)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (USER TYPE ROWS) !!!!!\n");
+
+    // Specifiers are checked
+    test_throws("%d", p);
+    test_throws("%lf", p);
+    test_throws("%s", u);
+    test_throws_fn([&]{ bpprint::format_columns(buf, "%d\n", prices.size(), prices.data()); });
+}
+
+
+// Check the details of an error
+void check_error(const bpprint::FormatResult & res, bpprint::FormatErrc errc,
+                 size_t arg_index, size_t offset, const char * type_name, const char * what)
+{
+    if(res.errc != errc || res.arg_index != arg_index || res.offset != offset ||
+       (type_name == nullptr) != (res.type_name == nullptr) ||
+       (type_name != nullptr && strcmp(type_name, res.type_name) != 0))
+        throw std::runtime_error(std::string("!!!!! WRONG ERROR DETAILS: ") + what + " !!!!!\n");
+}
+
+
+template<typename... Targs>
+void test_error(const char * fmt, bpprint::FormatErrc errc, size_t arg_index, size_t offset,
+                const char * type_name, const Targs &... args)
+{
+    const bpprint::CompiledFormat cf(fmt);
+    bpprint::MemoryBuffer buf;
+
+    check_error(bpprint::try_format_to(buf, std::string(fmt), args...),
+                errc, arg_index, offset, type_name, fmt);
+    check_error(bpprint::try_format_to(buf, fmt, args...),
+                errc, arg_index, offset, type_name, fmt);
+    check_error(bpprint::try_format_to(buf, cf, args...),
+                errc, arg_index, offset, type_name, fmt);
+
+    bool threw = false;
+    try {
+        bpprint::format_to(buf, fmt, args...);
+    }
+    catch(bpprint::format_error & ex)
+    {
+        check_error(ex.result(), errc, arg_index, offset, type_name, fmt);
+        threw = ex.kind() == errc && ex.arg_index() == arg_index && ex.offset() == offset;
+    }
+
+    if(!threw)
+        throw std::runtime_error(std::string("!!!!! EXPECTED FORMAT_ERROR: ") + fmt + " !!!!!\n");
+}
+
+
+void test_errors(void)
+{
+    using bpprint::FormatErrc;
+    const size_t npos = bpprint::FormatResult::npos;
+
+    test_error("x %d y", FormatErrc::BadType, 0, 2, "double", 1.0);
+    test_error("%d %s", FormatErrc::BadType, 1, 3, "signed int", 1, 2);
+    test_error("%d %ld", FormatErrc::BadLength, 1, 3, "signed int", 1, 2);
+    test_error("%d %d!", FormatErrc::NotEnoughArgs, 1, 3, nullptr, 1);
+    test_error("%d!", FormatErrc::TooManyArgs, 1, 3, nullptr, 1, 2);
+    test_error("%s", FormatErrc::BadType, 0, 0, "user-defined type", UserId{ 1 });
+    test_error("%s", FormatErrc::BadType, 0, 0, "pointer", static_cast<const int *>(nullptr));
+    test_error("%2$s %1$s", FormatErrc::BadType, 0, 5, "signed int", 1, "x");
+    test_error("%1$d %3$d", FormatErrc::NotEnoughArgs, 2, 5, nullptr, 1, 2);
+    test_error("%1$d", FormatErrc::TooManyArgs, 1, 4, nullptr, 1, 2);
+    test_error("%s %*d", FormatErrc::BadType, 1, 3, "double", "a", 2.5, 3);
+
+    // Invalid length specifiers are rejected for any argument
+    test_throws("%lhd", 1);
+    test_throws("%hld", 1);
+
+    // Badly formed specifications
+    bpprint::MemoryBuffer buf;
+    check_error(bpprint::try_format_to(buf, "ab %y", 1),
+                FormatErrc::BadSpec, 0, 3, nullptr, "%y");
+    check_error(bpprint::try_format_to(buf, std::string("ab %y"), 1),
+                FormatErrc::BadSpec, 0, 3, nullptr, "%y");
+
+    // Field widths and precisions too large for an int
+    check_error(bpprint::try_format_to(buf, "%4294967297d|", 5),
+                FormatErrc::BadSpec, 0, 0, nullptr, "%4294967297d|");
+    check_error(bpprint::try_format_to(buf, std::string("x %.2147483648f"), 1.0),
+                FormatErrc::BadSpec, 0, 2, nullptr, "x %.2147483648f");
+    test_throws("%99999999999s", "x");
+
+    // Argument positions too large for an int are not wrapped around
+    check_error(bpprint::try_format_to(buf, "%4294967297$d", 5),
+                FormatErrc::BadSpec, npos, 0, nullptr, "%4294967297$d");
+    check_error(bpprint::try_format_to(buf, std::string("%1$*4294967298$d"), 5, 6),
+                FormatErrc::BadSpec, npos, 0, nullptr, "%1$*4294967298$d");
+    check_error(bpprint::try_format_to(buf, "%.*4294967297$f", 1.0, 2),
+                FormatErrc::BadSpec, 0, 0, nullptr, "%.*4294967297$f");
+    if(bpprint::format_string("%.2147483647s|", "a") != "a|")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (LARGEST PRECISION) !!!!!\n");
+
+    bool threw = false;
+    try {
+        bpprint::CompiledFormat cf("ab %y");
+    }
+    catch(bpprint::format_error & ex)
+    {
+        threw = ex.kind() == FormatErrc::BadSpec && ex.offset() == 3;
+    }
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED FORMAT_ERROR (COMPILED) !!!!!\n");
+
+    // The message is built from the details
+    try {
+        bpprint::format_string("%d %d", 1, "x");
+    }
+    catch(bpprint::format_error & ex)
+    {
+        if(std::string(ex.what()) != "Bad type specifier for type const char * (argument 1, offset 3)")
+            throw std::runtime_error("!!!!! WRONG ERROR MESSAGE !!!!!\n");
+    }
+
+    // Success
+    buf.clear();
+    const bpprint::FormatResult ok = bpprint::try_format_to(buf, "%d %s", 1, "x");
+    if(!ok.ok() || ok.arg_index != npos || buf.str() != "1 x" ||
+       !bpprint::try_format_to(buf, BPPRINT_FMT(" %d"), 2).ok() || buf.str() != "1 x 2")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (TRY_FORMAT_TO) !!!!!\n");
+}
+
+
+void test_ranges(void)
+{
+    const std::vector<int> ints = { 1, -2, 300 };
+    const std::array<double, 3> dbls = {{ 0.5, 1.25, -2.0 }};
+    const char * strs[] = { "a", "bc", "def" };
+    const std::vector<Price> prices = { Price{ 100 }, Price{ -250 } };
+    const std::vector<int> empty;
+
+    // Each element is formatted as if it were a separate argument
+    std::string expected_ints, expected_dbls;
+    for(size_t i = 0; i < ints.size(); i++)
+    {
+        expected_ints += bpprint::format_string(i ? "|%05d" : "%05d", ints[i]);
+        expected_dbls += bpprint::format_string(i ? " %+.1f" : "%+.1f", dbls[i]);
+    }
+
+    const bpprint::CompiledFormat cf("<%s> <%-8s|> <%.4s>");
+    const std::string expected = "<1, -2, 300> <a bc def|> <1.00>";
+
+    if(bpprint::format_string("[%s]", bpprint::join(ints, "|", "%05d")) != "[" + expected_ints + "]" ||
+       bpprint::format_string("%s", bpprint::join(dbls, " ", "%+.1f")) != expected_dbls ||
+       bpprint::format_string("%s", bpprint::join(ints.begin()+1, ints.end())) != "-2, 300" ||
+       bpprint::format_string("%?", bpprint::join(strs, "")) != "abcdef" ||
+       bpprint::format_string("[%s]", bpprint::join(empty)) != "[]" ||
+       bpprint::format_string("%s", bpprint::join(prices, "; ", "%s")) != "$1.00; $-2.50" ||
+       bpprint::format_string("%s", bpprint::join(prices, "; ", "%f")) != "1.00; -2.50" ||
+       bpprint::format_string(cf, bpprint::join(ints), bpprint::join(strs, " "), bpprint::join(prices, "")) != expected ||
+       bpprint::format_string(BPPRINT_FMT("<%s> <%-8s|> <%.4s>"),
+                              bpprint::join(ints), bpprint::join(strs, " "), bpprint::join(prices, "")) != expected ||
+       bpprint::format_string("%5s|%-5s|", bpprint::join(ints, "", "%d", 1), bpprint::join(strs, "")) != " 1...|abcdef|")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (RANGES) !!!!!\n");
+
+    // Truncation
+    if(bpprint::format_string("%s", bpprint::join(ints, ", ", "%d", 2)) != "1, -2, ..." ||
+       bpprint::format_string("%s", bpprint::join(ints, ", ", "%d", 3)) != "1, -2, 300" ||
+       bpprint::format_string("%s", bpprint::join(ints, ",", "%d", 0)) != "..." ||
+       bpprint::format_string("%s", bpprint::join(empty, ",", "%d", 0)) != "" ||
+       bpprint::format_string("[%5s]", bpprint::join(ints, ", ", "%d", 0)) != "[  ...]" ||
+       bpprint::format_string("%s", bpprint::join(ints.begin(), ints.begin()+1, ", ", "%d", 1)) != "1" ||
+       bpprint::formatted_size("%s", bpprint::join(ints, ", ", "%d", 0)) != 3 ||
+       bpprint::formatted_size("%s", bpprint::join(ints, ", ", "%d", 2)) != 10)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (RANGE LIMITS) !!!!!\n");
+
+    // The element specification is checked when the range is created
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "%s"); });
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "%ld"); });
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "%d "); });
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "d"); });
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "%1$d"); });
+    test_throws_fn([&]{ bpprint::join(ints, ", ", "%*d"); });
+    test_throws_fn([&]{ bpprint::join(prices, ", ", "%d"); });
+    test_throws("%d", bpprint::join(ints));
+
+    bool threw = false;
+    try {
+        bpprint::join(ints, ", ", "%f");
+    }
+    catch(bpprint::format_error & ex)
+    {
+        check_error(ex.result(), bpprint::FormatErrc::BadType, bpprint::FormatResult::npos, 0,
+                    "signed int", "join");
+        threw = true;
+    }
+
+    if(!threw)
+        throw std::runtime_error("!!!!! EXPECTED FORMAT_ERROR: join !!!!!\n");
+}
+
+
+void test_fixed(void)
+{
+    using bpprint::FixedOverflow;
+    using bpprint::FormatErrc;
+
+    static_assert(std::is_trivially_copyable<bpprint::FixedString<64>>::value,
+                  "FixedString must be trivially copyable");
+
+    const bpprint::CompiledFormat cf("%s:%05d");
+    const std::string sfmt("%s:%05d");
+
+    // Output that fits
+    const auto f1 = bpprint::format_fixed<16>("%s:%05d", "id", 42);
+    const auto f2 = bpprint::format_fixed<16>(cf, "id", 42);
+    const auto f3 = bpprint::format_fixed<16, FixedOverflow::Throw>(sfmt, "id", 42);
+    const auto f4 = bpprint::format_fixed<16, FixedOverflow::Report>(BPPRINT_FMT("%s:%05d"), "id", 42);
+    if(f1.str() != "id:00042" || f1 != f2 || f1 != f3 || f1 != f4 || f1.size() != 8 ||
+       strlen(f1.c_str()) != 8 || f1.truncated() || !f4.result().ok())
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED) !!!!!\n");
+
+    // Exactly full
+    const auto full = bpprint::format_fixed<8, FixedOverflow::Throw>(cf, "id", 42);
+    if(full.str() != "id:00042" || full.truncated())
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED, FULL) !!!!!\n");
+
+    // Output that does not fit
+    const auto t1 = bpprint::format_fixed<5>(cf, "id", 42);
+    const auto t2 = bpprint::format_fixed<5, FixedOverflow::Report>(cf, "id", 42);
+    const auto t3 = bpprint::format_fixed<10>("%300d|", 7);
+    if(t1.str() != "id:00" || !t1.truncated() || t1.length() != 8 || t1.c_str()[5] != '\0' ||
+       t2 != t1 || t2.result().errc != FormatErrc::Truncated ||
+       t3.str() != std::string(10, ' ') || t3.length() != 301)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED, TRUNCATED) !!!!!\n");
+
+    test_throws_fn([&]{ bpprint::format_fixed<5, FixedOverflow::Throw>(cf, "id", 42); });
+
+    // Conversions done by snprintf, cut off by the end of the storage
+    const std::string longe = bpprint::format_string("%400e|", 2.5);
+    const auto t4 = bpprint::format_fixed<300>("%400e|", 2.5);
+    if(t4.str() != longe.substr(0, 300) || t4.c_str()[300] != '\0' || t4.length() != longe.size())
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED, TRUNCATED CONVERSION) !!!!!\n");
+
+    // Copies are plain copies of the storage
+    bpprint::FixedString<16> copy;
+    memcpy(static_cast<void *>(&copy), &f1, sizeof(copy));
+    if(copy != f1 || copy.str() != f1.str())
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (FIXED COPY) !!!!!\n");
+
+    // Errors in the format are thrown, except with FixedOverflow::Report
+    test_throws_fn([&]{ bpprint::format_fixed<16>(cf, 1, 2); });
+    test_throws_fn([&]{ bpprint::format_fixed<16, FixedOverflow::Throw>("%d"); });
+    const auto e = bpprint::format_fixed<16, FixedOverflow::Report>("%d %d", 1, 2.0);
+    if(e.result().errc != FormatErrc::BadType || e.result().arg_index != 1 || e.str() != "1 ")
+        throw std::runtime_error("!!!!! WRONG ERROR DETAILS: format_fixed !!!!!\n");
+}
+
+
+void test_stats(void)
+{
+    bpprint::reset_format_stats();
+
+    const char * fmt = "%s=%d\n";
+    const bpprint::CompiledFormat cf("[%5.1f]");
+    bpprint::MemoryBuffer buf;
+
+    for(int i = 0; i < 10; i++)
+        bpprint::format_to(buf, fmt, "x", i);
+    bpprint::format_to(buf, cf, 2.5);
+    bpprint::format_to(buf, BPPRINT_FMT("[%5.1f]"), 2.5);
+    bpprint::format_to(buf, std::string("%1000e"), 1.0);
+    test_throws("%d", 1.0);
+
+    const bpprint::FormatStats ts = bpprint::thread_format_stats();
+    const bpprint::FormatStats s = bpprint::format_stats();
+
+    if(!bpprint::format_stats_enabled())
+    {
+        if(s.calls != 0 || s.bytes != 0 || s.exceptions != 0 || !s.sites.empty() ||
+           ts.calls != 0 || !ts.sites.empty())
+            throw std::runtime_error("!!!!! STATISTICS WITHOUT BPPRINT_STATS !!!!!\n");
+        return;
+    }
+
+    // test_throws makes a call with each kind of format string (and fails each time)
+    if(ts.calls != 16 || ts.bytes != buf.size() || ts.heap_fallbacks != 1 || ts.exceptions != 3 ||
+       ts.sites.size() != 4 || ts.sites[0].format != fmt || ts.sites[0].calls != 10 ||
+       ts.sites[0].bytes != 40 || ts.sites[1].format != "%d" || ts.sites[1].calls != 3 ||
+       ts.sites[2].format != "[%5.1f]" || ts.sites[2].bytes != 14 ||
+       ts.total_ns == 0 || ts.parse_ns == 0 || s.calls < ts.calls || s.bytes < ts.bytes)
+        throw std::runtime_error("!!!!! WRONG STATISTICS !!!!!\n");
+
+    // Counters of threads that have exited are kept
+    std::thread t([]{ bpprint::format_string("%d", 12345); });
+    t.join();
+
+    const bpprint::FormatStats s2 = bpprint::format_stats();
+    if(s2.calls != s.calls + 1 || s2.bytes != s.bytes + 5)
+        throw std::runtime_error("!!!!! WRONG STATISTICS (THREADS) !!!!!\n");
+
+    std::ostringstream ss;
+    bpprint::write_format_stats(ss, s2, 2);
+    std::cout << ss.str();
+    if(ss.str().find("\"%s=%d\\n\"") == std::string::npos || ss.str().find("more") == std::string::npos)
+        throw std::runtime_error("!!!!! WRONG STATISTICS SUMMARY !!!!!\n");
+
+    bpprint::reset_format_stats();
+    if(bpprint::format_stats().calls != 0 || !bpprint::thread_format_stats().sites.empty())
+        throw std::runtime_error("!!!!! STATISTICS NOT RESET !!!!!\n");
+}
+
+
+void test_cache(void)
+{
+#ifdef BPPRINT_NO_FORMAT_CACHE
+    // The cache is compiled out, so it is never used (but formatting still works)
+    const bool cache_used = false;
+#else
+    const bool cache_used = true;
+#endif
+
+    bpprint::clear_format_cache();
+
+    for(int i = 0; i < 10; i++)
+    {
+        if(bpprint::format_string("cached %d", i) != "cached " + std::to_string(i))
+            throw std::runtime_error("!!!!! MISMATCHED OUTPUT (CACHE) !!!!!\n");
+    }
+
+    bpprint::FormatCacheStats stats = bpprint::format_cache_stats();
+    if(cache_used ? (stats.misses != 1 || stats.hits != 9 || stats.size != 1)
+                  : (stats.misses != 0 || stats.hits != 0 || stats.size != 0))
+        throw std::runtime_error("!!!!! BAD CACHE STATISTICS !!!!!\n");
+
+    // Same address, different format
+    char reused[16];
+    strcpy(reused, "%d");
+    const std::string first = bpprint::format_string(reused, 5);
+    strcpy(reused, "[%x]");
+    const std::string second = bpprint::format_string(reused, 255u);
+    if(first != "5" || second != "[ff]")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (CACHE REUSED) !!!!!\n");
+
+    // More formats than fit in the cache
+    std::vector<std::string> fmts;
+    for(size_t i = 0; i < 2*stats.capacity; i++)
+        fmts.push_back("format " + std::to_string(i) + ": %d");
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(size_t i = 0; i < fmts.size(); i++)
+        {
+            if(bpprint::format_string(fmts[i].c_str(), pass) != "format " + std::to_string(i) + ": " + std::to_string(pass))
+                throw std::runtime_error("!!!!! MISMATCHED OUTPUT (CACHE EVICTION) !!!!!\n");
+        }
+    }
+
+    stats = bpprint::format_cache_stats();
+    if(cache_used ? (stats.evictions == 0 || stats.size != stats.capacity)
+                  : (stats.misses != 0 || stats.hits != 0 || stats.evictions != 0))
+        throw std::runtime_error("!!!!! BAD CACHE STATISTICS (EVICTION) !!!!!\n");
+
+    // Disabled cache is not used at all
+    bpprint::set_format_cache_enabled(false);
+    stats = bpprint::format_cache_stats();
+    if(bpprint::format_string("not cached %s", "x") != "not cached x")
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (CACHE DISABLED) !!!!!\n");
+    bpprint::FormatCacheStats stats2 = bpprint::format_cache_stats();
+    bpprint::set_format_cache_enabled(true);
+
+    if(stats2.hits != stats.hits || stats2.misses != stats.misses)
+        throw std::runtime_error("!!!!! BAD CACHE STATISTICS (DISABLED) !!!!!\n");
+}
+
+
+void test_stringref(void)
+{
+    // Not null terminated, and with an embedded null
+    const char chars[] = { 'a', 'b', 'c', 'd', 'e' };
+    const char withnull[] = { 'x', '\0', 'y' };
+    const bpprint::StringRef ref(chars, 3);
+    const bpprint::StringRef refnull(withnull, 3);
+    const std::string str("a std::string");
+
+    const std::string expected = "[abc] [  abc] [ab] [" + std::string(withnull, 3) + "] [a std::string]";
+
+    if(bpprint::format_string("[%s] [%5s] [%.2s] [%s] [%?]", ref, ref, ref, refnull, bpprint::StringRef(str)) != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STRINGREF) !!!!!\n");
+
+    if(bpprint::format_string(BPPRINT_FMT("[%s] [%5s] [%.2s] [%s] [%?]"), ref, ref, ref, refnull, bpprint::StringRef(str)) != expected)
+        throw std::runtime_error("!!!!! MISMATCHED OUTPUT (STATIC STRINGREF) !!!!!\n");
+
+    test_throws("%d", ref);
+    test_throws("%ls", ref);
+}
+
+
 int main(void)
 {
     try {
@@ -58,7 +1295,94 @@ int main(void)
         test_format("%%%d", 5);
         //test_format("%%%?", 5);
 
-        
+        // numbers
+        test_format("%d", 5);
+        test_format("%-5d|%+5d|% d", -12, 34, 56);
+        test_format("%08.3f %e %G", 3.14159, 1.0e-10, 2.5e20);
+        test_format("%lu %llx %#o %hhd", 10ul, 0xdeadbeefull, 8u,
+                    static_cast<signed char>(-3));
+        test_format("%s=%d, %s=%.2f", "a", 1, "b", 2.0);
+
+        // mismatched arguments
+        test_throws("%s", 5);
+        test_throws("%d", 5.0);
+        test_throws("%ld", 5);
+        test_throws("%d %d", 5);
+        test_throws("%d", 5, 6);
+
+        // positional arguments, and widths and precisions given by arguments
+        test_format("%2$s=%1$d", 5, "x");
+        test_format("%1$s %1$s %2$5.1f", "a", 2.25);
+        test_format("%3$s %1$0*2$d", 7, 5, "id");
+        test_format("%1$*2$.*3$f|%2$d", 2.5, 9, 2);
+        test_format("%*d|%-*d|%.*f|%*.*e", 6, 12, 4, 34, 2, 3.14159, 12, 3, 1.5e5);
+        test_format("%*d|%.*f", -6, 12, -1, 2.5);
+        test_format("%s %.*s", "head", 2, "abc");
+        test_format("%d %*ld", 1, 4, 20l);
+
+        // arguments given by position must all be
+        test_throws("%1$d %d", 1, 2);
+        test_throws("%d %1$d", 1, 2);
+        test_throws("%1$d %*2$d", 1, 2, 3);
+        test_throws("%0$d", 1);
+        test_throws("%*5d", 1, 2);
+        test_throws("%.*3f", 1, 2.0);
+        test_throws("%*d", 1.5, 2);
+        test_throws("%*d", 5000000000ll, 2);
+        test_throws("%1$d", 1, 2);
+        test_throws("%2$d", 1);
+        test_throws("%*d", 5);
+
+        // compile-time format strings
+        test_static();
+
+        // output buffers
+        test_buffers();
+
+        // string references
+        test_stringref();
+
+        // format cache
+        test_cache();
+
+        // deferred formatting
+        test_lazy();
+
+        // binary logs
+        test_binary_log();
+
+        // batches of rows
+        test_batch();
+
+        // output to file descriptors
+        test_fd_sink();
+
+        // output in an arena
+        test_arena();
+
+        // user-defined types
+        test_user_types();
+
+        // reporting of errors
+        test_errors();
+
+        // ranges
+        test_ranges();
+
+        // fixed-capacity results
+        test_fixed();
+
+        // statistics
+        test_stats();
+
+        // very long output
+        test_large();
+
+        // native conversions
+        test_conversions();
+
+        // scanning of literal text
+        test_long_literals();
 
     }
     catch(std::exception & ex)
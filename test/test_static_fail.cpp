@@ -0,0 +1,48 @@
+/*! \file
+ *
+ * Format strings checked at compile time. Each of the
+ * cases below should fail to compile.
+ */
+
+#include <bpprint/StaticFormat.hpp>
+
+
+// A user-defined type that can only be used with %s
+struct UserType { };
+
+namespace bpprint {
+template<>
+struct Formatter<UserType>
+{
+    static constexpr const char * pftype = "s";
+    static void format(OutputBuffer &, const ConvSpec &, char, const UserType &) { }
+};
+}
+
+
+int main(void)
+{
+#if defined(BPPRINT_FAIL_TYPE)
+    bpprint::format_string(BPPRINT_FMT("%s"), 5);
+#elif defined(BPPRINT_FAIL_LENGTH)
+    bpprint::format_string(BPPRINT_FMT("%ld"), 5);
+#elif defined(BPPRINT_FAIL_TOO_MANY)
+    bpprint::format_string(BPPRINT_FMT("%d"), 5, 6);
+#elif defined(BPPRINT_FAIL_TOO_FEW)
+    bpprint::format_string(BPPRINT_FMT("%d %d"), 5);
+#elif defined(BPPRINT_FAIL_SPEC)
+    bpprint::format_string(BPPRINT_FMT("%d %y"), 5, 6);
+#elif defined(BPPRINT_FAIL_USER_SPEC)
+    bpprint::format_string(BPPRINT_FMT("%d"), UserType());
+#elif defined(BPPRINT_FAIL_USER_LENGTH)
+    bpprint::format_string(BPPRINT_FMT("%ls"), UserType());
+#elif defined(BPPRINT_FAIL_POSITIONAL)
+    bpprint::format_string(BPPRINT_FMT("%2$d %1$d"), 5, 6);
+#elif defined(BPPRINT_FAIL_STAR)
+    bpprint::format_string(BPPRINT_FMT("%*d"), 5, 6);
+#elif defined(BPPRINT_FAIL_WIDTH)
+    bpprint::format_string(BPPRINT_FMT("%4294967297d"), 5);
+#endif
+
+    return 0;
+}
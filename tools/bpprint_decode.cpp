@@ -0,0 +1,58 @@
+/*! \file
+ *
+ * Converts a binary log (see BinaryLog.hpp) to text
+ *
+ * Usage: bpprint_decode [file]
+ *
+ * If no file is given, the log is read from standard input.
+ * The text is written to standard output.
+ */
+
+#include <bpprint/BinaryLog.hpp>
+#include <fstream>
+#include <iostream>
+
+
+int main(int argc, char ** argv)
+{
+    if(argc > 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [file]\n";
+        return 2;
+    }
+
+    std::ifstream file;
+    if(argc == 2)
+    {
+        file.open(argv[1], std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "Cannot open " << argv[1] << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        bpprint::BinaryLogReader reader(argc == 2 ? file : std::cin);
+        bpprint::MemoryBuffer buf;
+
+        while(reader.next(buf))
+        {
+            if(buf.size() >= 65536)
+            {
+                std::cout.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+                buf.clear();
+            }
+        }
+
+        std::cout.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    }
+    catch(std::exception & ex)
+    {
+        std::cout.flush();
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}